@@ -18,21 +18,30 @@
 */
 
 #include "jksn.hpp"
+#include <algorithm>
 #include <array>
+#include <bitset>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
-#include <list>
 #include <map>
 #include <memory>
-#include <sstream>
+#include <new>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 namespace JKSN {
 
@@ -41,125 +50,1071 @@ public:
     JKSNUnicodeError(const char *what) : JKSNError(what) {}
 };
 
-class JKSNProxy {
+/* Thrown when a buffer ends early, which only means more input is needed
+   to a JKSNIncrementalDecoder */
+class JKSNTruncatedError : public JKSNDecodeError {
 public:
-    JKSNProxy() = delete;
-    JKSNProxy(const JKSNValue *origin, uint8_t control, const std::string &data, const std::string &buf) :
-        origin(origin),
-        control(control),
-        data(data),
-        buf(buf) {
-    }
-    JKSNProxy(const JKSNValue *origin, uint8_t control, const std::string &data, std::string &&buf = std::string()) :
-        origin(origin),
-        control(control),
-        data(data),
-        buf(std::move(buf)) {
-    }
-    JKSNProxy(const JKSNValue *origin, uint8_t control, std::string &&data = std::string(), std::string &&buf = std::string()) :
-        origin(origin),
-        control(control),
-        data(std::move(data)),
-        buf(std::move(buf)) {
-    }
-    JKSNProxy(const JKSNValue *origin, uint8_t control, std::string &&data, const std::string &buf) :
-        origin(origin),
-        control(control),
-        data(std::move(data)),
-        buf(buf) {
-    }
-    std::ostream &output(std::ostream &stream, bool recursive = true) const {
-        if(!stream.put(char(this->control)))
-            return stream;
-        if(!(stream << this->data))
-            return stream;
-        if(!(stream << this->buf))
-            return stream;
-        if(recursive)
-            for(const JKSNProxy &i : this->children)
-                if(!i.output(stream))
-                    return stream;
-        return stream;
-    }
-    std::string toString(bool recursive = true) const {
-        std::string result;
-        result.reserve(1 + this->data.size() + this->buf.size());
-        result += char(this->control);
-        result += this->data;
-        result += this->buf;
-        if(recursive)
-            for(const JKSNProxy &i : this->children)
-                result += i.toString();
+    JKSNTruncatedError() : JKSNDecodeError("JKSN stream may be truncated or corrupted") {}
+};
+
+struct JKSNStringViewHash {
+    size_t operator()(const JKSNStringView &str) const {
+        /* FNV-1a */
+        size_t result = 2166136261u;
+        for(char c : str)
+            result = (result ^ uint8_t(c)) * 16777619u;
         return result;
     }
-    size_t size(size_t depth = 0) const {
-        size_t result = 1 + this->data.size() + this->buf.size();
-        if(depth == 0)
-            for(const JKSNProxy &i : this->children)
-                result += i.size();
-        else if(depth != 1)
-            for(const JKSNProxy &i : this->children)
-                result += i.size(depth-1);
-        return result;
+};
+
+class JKSNStringDictionary {
+    /* Strings of the dictionary extension, numbered for 16-bit references.
+       Once full, the CLOCK algorithm picks the entry to replace, a cheap
+       approximation of LRU that the encoder and the decoder run in step. */
+public:
+    static const size_t capacity = 65536;
+    /* Adds a string even if it is there already, and returns its number */
+    size_t insert(const std::shared_ptr<std::string> &str) {
+        size_t index = this->entries.size();
+        if(index < capacity) {
+            this->entries.push_back(str);
+            this->used.push_back(true);
+        } else {
+            while(this->used[this->hand]) {
+                this->log(this->hand);
+                this->used[this->hand] = false;
+                this->hand = (this->hand + 1) % capacity;
+            }
+            index = this->hand;
+            this->log(index);
+            if(this->track_indices) {
+                auto it = this->indices.find(*this->entries[index]);
+                if(it != this->indices.end() && it->second == index)
+                    this->indices.erase(it);
+            }
+            this->entries[index] = str;
+            this->used[index] = true;
+            this->hand = (this->hand + 1) % capacity;
+        }
+        if(this->track_indices) {
+            /* The key points into the entry, so it is replaced with the newest one */
+            this->indices.erase(JKSNStringView(*str));
+            this->indices.emplace(JKSNStringView(*str), index);
+        }
+        return index;
     }
-    const JKSNValue *origin = nullptr; /* weak reference */
-    uint8_t control;
-    std::string data;
-    std::string buf;
-    std::list<JKSNProxy> children;
-    uint8_t hash = 0;
+    /* Marks the entry as used */
+    const std::shared_ptr<std::string> &lookup(size_t index) {
+        if(index >= this->entries.size())
+            throw JKSNDecodeError("JKSN stream refers to a non-existing dictionary entry");
+        if(!this->used[index]) {
+            this->log(index);
+            this->used[index] = true;
+        }
+        return this->entries[index];
+    }
+    /* Encoder only, the number of the latest entry with the string, or -1 */
+    size_t find(const JKSNStringView &str) const {
+        auto it = this->indices.find(str);
+        return it != this->indices.end() ? it->second : size_t(-1);
+    }
+    void clear() {
+        if(this->journaling && !this->backup)
+            this->backup.reset(new Backup({std::move(this->entries), std::move(this->used), this->hand}));
+        this->entries.clear();
+        this->used.clear();
+        this->indices.clear();
+        this->hand = 0;
+    }
+    /* Keeps what is changed from now on, so that rollback() can put it back */
+    void mark() {
+        this->journal.clear();
+        this->journaling = true;
+        this->marked_size = this->entries.size();
+        this->marked_hand = this->hand;
+    }
+    void rollback() {
+        if(this->backup) {
+            this->entries = std::move(this->backup->entries);
+            this->used = std::move(this->backup->used);
+            this->hand = this->backup->hand;
+        }
+        for(auto it = this->journal.rbegin(); it != this->journal.rend(); ++it) {
+            this->entries[it->index] = std::move(it->entry);
+            this->used[it->index] = it->used;
+        }
+        this->entries.resize(this->marked_size);
+        this->used.resize(this->marked_size);
+        this->hand = this->marked_hand;
+        this->release();
+    }
+    void release() {
+        this->journal.clear();
+        this->backup.reset();
+        this->journaling = false;
+    }
+    bool track_indices = false;
+private:
+    std::vector<std::shared_ptr<std::string>> entries;
+    std::vector<bool> used;
+    size_t hand = 0;
+    /* Views into the entries, only kept by the encoder */
+    std::unordered_map<JKSNStringView, size_t, JKSNStringViewHash> indices;
+    struct Change {
+        size_t index;
+        std::shared_ptr<std::string> entry;
+        bool used;
+    };
+    std::vector<Change> journal;
+    /* Everything as it was before a clear(), after which nothing more is logged */
+    struct Backup {
+        std::vector<std::shared_ptr<std::string>> entries;
+        std::vector<bool> used;
+        size_t hand;
+    };
+    std::shared_ptr<Backup> backup;
+    bool journaling = false;
+    size_t marked_size = 0;
+    size_t marked_hand = 0;
+    void log(size_t index) {
+        if(this->journaling && !this->backup && index < this->marked_size)
+            this->journal.push_back(Change({index, this->entries[index], this->used[index]}));
+    }
+};
+
+class JKSNShapeCache {
+    /* Key sets of objects, numbered in the order they were first sent.
+       Once full, objects with new keys are sent as they are. */
+public:
+    typedef std::vector<std::shared_ptr<std::string>> Shape;
+    static const size_t capacity = 65536;
+    size_t size() const {
+        return this->shapes.size();
+    }
+    /* The decoder keeps the keys */
+    void insert(const std::shared_ptr<const Shape> &shape) {
+        if(this->shapes.size() >= capacity)
+            throw JKSNDecodeError("JKSN stream sends more shapes than can be kept");
+        this->shapes.push_back(shape);
+    }
+    std::shared_ptr<const Shape> lookup(size_t index) const {
+        if(index >= this->shapes.size())
+            throw JKSNDecodeError("JKSN stream refers to a non-existing shape");
+        return this->shapes[index];
+    }
+    /* The encoder only keeps a signature of the keys, and returns false once full */
+    bool insert(const std::string &signature) {
+        if(this->shapes.size() >= capacity)
+            return false;
+        this->indices.emplace(signature, this->shapes.size());
+        this->shapes.push_back(nullptr);
+        return true;
+    }
+    /* Encoder only, the number of the shape or -1 */
+    size_t find(const std::string &signature) const {
+        auto it = this->indices.find(signature);
+        return it != this->indices.end() ? it->second : size_t(-1);
+    }
+    void clear() {
+        if(this->journaling && !this->backup)
+            this->backup = std::make_shared<std::vector<std::shared_ptr<const Shape>>>(std::move(this->shapes));
+        this->shapes.clear();
+        this->indices.clear();
+    }
+    /* Shapes are only ever added, so rollback() drops the ones after mark() */
+    void mark() {
+        this->journaling = true;
+        this->marked_size = this->shapes.size();
+    }
+    void rollback() {
+        if(this->backup)
+            this->shapes = std::move(*this->backup);
+        this->shapes.resize(this->marked_size);
+        this->release();
+    }
+    void release() {
+        this->backup.reset();
+        this->journaling = false;
+    }
+private:
+    std::vector<std::shared_ptr<const Shape>> shapes;
+    std::unordered_map<std::string, size_t> indices;
+    /* Everything as it was before a clear() */
+    std::shared_ptr<std::vector<std::shared_ptr<const Shape>>> backup;
+    bool journaling = false;
+    size_t marked_size = 0;
+};
+
+class JKSNKeyInts {
+    /* The last integer in the value of each string key */
+public:
+    struct LastInt {
+        bool has;
+        intmax_t value;
+    };
+    LastInt get(const std::string &key) const {
+        auto it = this->ints.find(key);
+        return it != this->ints.end() ? it->second : LastInt({false, 0});
+    }
+    void set(const std::string &key, const LastInt &value) {
+        auto it = this->ints.find(key);
+        if(this->journaling && !this->backup && this->journal.find(key) == this->journal.end())
+            this->journal.emplace(key, it != this->ints.end() ? Saved({true, it->second}) : Saved({false, LastInt({false, 0})}));
+        if(it != this->ints.end())
+            it->second = value;
+        else
+            this->ints.emplace(key, value);
+    }
+    void clear() {
+        if(this->journaling && !this->backup)
+            this->backup = std::make_shared<std::unordered_map<std::string, LastInt>>(std::move(this->ints));
+        this->ints.clear();
+    }
+    /* Keys changed after mark() keep what they had, so that rollback() can put it back */
+    void mark() {
+        this->journaling = true;
+    }
+    void rollback() {
+        if(this->backup)
+            this->ints = std::move(*this->backup);
+        for(const std::pair<const std::string, Saved> &item : this->journal)
+            if(item.second.existed)
+                this->ints[item.first] = item.second.value;
+            else
+                this->ints.erase(item.first);
+        this->release();
+    }
+    void release() {
+        this->backup.reset();
+        this->journal.clear();
+        this->journaling = false;
+    }
+private:
+    struct Saved {
+        bool existed;
+        LastInt value;
+    };
+    std::unordered_map<std::string, LastInt> ints;
+    std::unordered_map<std::string, Saved> journal;
+    /* Everything as it was before a clear(), the journal covers what came before that */
+    std::shared_ptr<std::unordered_map<std::string, LastInt>> backup;
+    bool journaling = false;
 };
 
 class JKSNCache {
 public:
     bool haslastint = false;
-    intmax_t lastint;
+    intmax_t lastint = 0;
     std::array<std::shared_ptr<std::string>, 256> texthash {{nullptr}};
     std::array<std::shared_ptr<std::string>, 256> blobhash {{nullptr}};
+    /* Extensions turned on by the last pragma, see jksn_extension */
+    unsigned extensions = 0;
+    JKSNStringDictionary dictionary;
+    JKSNShapeCache shapes;
+    JKSNKeyInts key_ints;
+    void setExtensions(unsigned extensions) {
+        if((extensions ^ this->extensions) & JKSN_EXTENSION_DICTIONARY)
+            this->dictionary.clear();
+        if((extensions ^ this->extensions) & JKSN_EXTENSION_SHAPES)
+            this->shapes.clear();
+        if((extensions ^ this->extensions) & JKSN_EXTENSION_KEY_DELTAS)
+            this->key_ints.clear();
+        this->extensions = extensions;
+    }
+    /* Swaps in the lastint of a key, and returns the one it replaced */
+    JKSNKeyInts::LastInt enterKey(const std::string &key) {
+        JKSNKeyInts::LastInt outer = {this->haslastint, this->lastint};
+        JKSNKeyInts::LastInt inner = this->key_ints.get(key);
+        this->haslastint = inner.has;
+        this->lastint = inner.value;
+        return outer;
+    }
+    void leaveKey(const std::string &key, const JKSNKeyInts::LastInt &outer) {
+        this->key_ints.set(key, JKSNKeyInts::LastInt({this->haslastint, this->lastint}));
+        this->haslastint = outer.has;
+        this->lastint = outer.value;
+    }
+    /* Remembers the state a value is decoded from, so that it can be put back if the value is cut short */
+    void mark() {
+        this->marked_haslastint = this->haslastint;
+        this->marked_lastint = this->lastint;
+        this->marked_extensions = this->extensions;
+        this->dictionary.mark();
+        this->shapes.mark();
+        this->key_ints.mark();
+    }
+    void rollback() {
+        this->haslastint = this->marked_haslastint;
+        this->lastint = this->marked_lastint;
+        this->extensions = this->marked_extensions;
+        this->dictionary.rollback();
+        this->shapes.rollback();
+        this->key_ints.rollback();
+    }
+    void release() {
+        this->dictionary.release();
+        this->shapes.release();
+        this->key_ints.release();
+    }
+private:
+    bool marked_haslastint = false;
+    intmax_t marked_lastint = 0;
+    unsigned marked_extensions = 0;
+};
+
+class JKSNBitWriter {
+    /* Packs bits into bytes, the most significant first */
+public:
+    explicit JKSNBitWriter(std::string &result) :
+        result(result) {
+    }
+    /* Writes the lowest bits of value, which has nothing above them */
+    void write(uint64_t value, unsigned bits) {
+        if(bits > 32) {
+            this->write(value >> 32, bits - 32);
+            value &= 0xffffffffu;
+            bits = 32;
+        }
+        this->buffer = (this->buffer << bits) | value;
+        this->pending += bits;
+        while(this->pending >= 8) {
+            this->pending -= 8;
+            this->result.push_back(char(uint8_t(this->buffer >> this->pending)));
+        }
+        this->buffer &= (uint64_t(1) << this->pending) - 1;
+    }
+    /* Pads the last byte with zeros */
+    void flush() {
+        if(this->pending != 0)
+            this->result.push_back(char(uint8_t(this->buffer << (8 - this->pending))));
+        this->buffer = 0;
+        this->pending = 0;
+    }
+private:
+    std::string &result;
+    uint64_t buffer = 0;
+    unsigned pending = 0;
+};
+
+class JKSNBitReader {
+    /* Reads what JKSNBitWriter wrote, from a 64-bit window loaded at the current byte */
+public:
+    JKSNBitReader(const char *data, size_t size) :
+        data(reinterpret_cast<const uint8_t *>(data)),
+        size(size) {
+    }
+    uint64_t read(unsigned bits) {
+        if(bits > 56) {
+            uint64_t high = this->read(bits - 32);
+            return (high << 32) | this->read(32);
+        }
+        if(bits > this->size*8 - this->offset)
+            throw JKSNDecodeError("JKSN packed array is shorter than its items");
+        if(bits == 0)
+            return 0;
+        size_t byte = this->offset >> 3;
+        uint64_t window = 0;
+        if(byte + 8 <= this->size)
+            for(size_t i = 0; i < 8; ++i)
+                window = (window << 8) | this->data[byte + i];
+        else
+            for(size_t i = 0; i < 8; ++i)
+                window = (window << 8) | (byte + i < this->size ? this->data[byte + i] : 0);
+        uint64_t result = (window << (this->offset & 7)) >> (64 - bits);
+        this->offset += bits;
+        return result;
+    }
+    /* Reads count items of the same width, checking the size once */
+    void read(unsigned bits, size_t count, uint64_t *result) {
+        if(bits == 0 || bits > 56) {
+            for(size_t i = 0; i < count; ++i)
+                result[i] = this->read(bits);
+            return;
+        }
+        if(count > (this->size*8 - this->offset) / bits)
+            throw JKSNDecodeError("JKSN packed array is shorter than its items");
+        size_t i = 0;
+        for(; i < count && (this->offset >> 3) + 8 <= this->size; ++i) {
+            size_t byte = this->offset >> 3;
+            uint64_t window = 0;
+            for(size_t j = 0; j < 8; ++j)
+                window = (window << 8) | this->data[byte + j];
+            result[i] = (window << (this->offset & 7)) >> (64 - bits);
+            this->offset += bits;
+        }
+        for(; i < count; ++i)
+            result[i] = this->read(bits);
+    }
+    /* Skips to the next whole byte, as JKSNBitWriter::flush pads */
+    void align() {
+        this->offset = (this->offset + 7) & ~size_t(7);
+    }
+    /* A variable length integer starting at a whole byte */
+    uint64_t readVarInt() {
+        this->align();
+        uint64_t result = 0, thisbyte;
+        do {
+            if(result & ~(~ uint64_t(0) >> 7))
+                throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
+            thisbyte = this->read(8);
+            result = (result << 7) | (thisbyte & 0x7f);
+        } while(thisbyte & 0x80);
+        return result;
+    }
+private:
+    const uint8_t *data;
+    size_t size;
+    /* In bits */
+    size_t offset = 0;
+};
+
+/* Items of a typed array are stored as big-endian Bits, converted if they
+   are integers or copied bit for bit if they are floats */
+template<typename Bits, typename Integer>
+static inline Bits toBits(Integer number) {
+    return Bits(number);
+}
+
+template<typename Bits>
+static inline Bits toBits(float number) {
+    uint32_t bits;
+    std::memcpy(&bits, &number, 4);
+    return Bits(bits);
+}
+
+template<typename Bits>
+static inline Bits toBits(double number) {
+    uint64_t bits;
+    std::memcpy(&bits, &number, 8);
+    return Bits(bits);
+}
+
+/* A plain loop over the whole block, which compilers turn into byte swaps */
+template<typename Bits, typename Number>
+static void storeBigEndian(const Number *data, size_t size, char *output) {
+    for(size_t i = 0; i < size; ++i) {
+        Bits bits = toBits<Bits>(data[i]);
+        for(size_t j = 0; j < sizeof (Bits); ++j)
+            output[i*sizeof (Bits) + j] = char(uint8_t(bits >> (8*(sizeof (Bits)-1-j))));
+    }
+}
+
+template<typename Bits>
+static inline Bits loadBigEndian(const char *data) {
+    Bits result = 0;
+    for(size_t i = 0; i < sizeof (Bits); ++i)
+        result = Bits(result << 8) | uint8_t(data[i]);
+    return result;
+}
+
+class JKSNChecksum {
+public:
+    /* The control byte of an immediate or a delayed checksum */
+    explicit JKSNChecksum(uint8_t control);
+    static bool isChecksum(uint8_t control) {
+        return (control >= 0xf0 && control <= 0xf5) || (control >= 0xf8 && control <= 0xfd);
+    }
+    static size_t digestSize(uint8_t control) {
+        static const size_t checksum_size[6] = {1, 4, 16, 20, 32, 64};
+        return checksum_size[control & 0x7];
+    }
+    void update(const char *data, size_t size);
+    std::string digest();
+    /* MD5, SHA-1 and SHA-512 are read but not verified */
+    void verify(const char *expected);
+private:
+    uint8_t type;
+    uint8_t djb = 0;
+    uint32_t crc = 0xffffffff;
+    uint32_t sha_state[8];
+    uint8_t sha_block[64];
+    uint64_t sha_length = 0;
+    void shaTransform(const uint8_t *block);
+};
+
+class JKSNArena {
+    /* A monotonic allocator, everything it gives out is released at once by reset() */
+public:
+    void *allocate(size_t size, size_t align) {
+        if(!this->blocks.empty()) {
+            uintptr_t base = uintptr_t(this->blocks.back().first.get());
+            size_t offset = ((base + this->used + align - 1) & ~uintptr_t(align - 1)) - base;
+            if(offset <= this->blocks.back().second && size <= this->blocks.back().second - offset) {
+                this->used = offset + size;
+                return this->blocks.back().first.get() + offset;
+            }
+        }
+        size_t block_size = std::max(size + align, this->blocks.empty() ? size_t(4096) : this->blocks.back().second*2);
+        this->blocks.push_back(std::make_pair(std::unique_ptr<char[]>(new char[block_size]), block_size));
+        this->used = 0;
+        return this->allocate(size, align);
+    }
+    template<typename T>
+    T *allocate(size_t count) {
+        return static_cast<T *>(this->allocate(sizeof (T) * count, alignof (T)));
+    }
+    const char *copy(const char *data, size_t size) {
+        char *result = this->allocate<char>(size);
+        std::memcpy(result, data, size);
+        return result;
+    }
+    /* Blocks are merged into one as large as all of them, so a connection
+       that keeps receiving similar messages settles on a single block */
+    void reset() {
+        if(this->blocks.size() > 1) {
+            size_t total = this->capacity();
+            this->blocks.clear();
+            this->blocks.push_back(std::make_pair(std::unique_ptr<char[]>(new char[total]), total));
+        }
+        this->used = 0;
+    }
+    size_t capacity() const {
+        size_t result = 0;
+        for(const std::pair<std::unique_ptr<char[]>, size_t> &block : this->blocks)
+            result += block.second;
+        return result;
+    }
+private:
+    std::vector<std::pair<std::unique_ptr<char[]>, size_t>> blocks;
+    size_t used = 0;
+};
+
+class JKSNNode {
+public:
+    jksn_data_type data_type = JKSN_UNDEFINED;
+    /* Bytes of a string or blob, elements of an array, or members of an object */
+    size_t size = 0;
+    union {
+        bool data_bool;
+        intmax_t data_int;
+        float data_float;
+        double data_double;
+        long double data_long_double;
+        const char *data_string = nullptr;
+        /* Children in the arena, object members are stored as key, value, key, value... */
+        const JKSNNode *data_children;
+    };
+};
+
+class JKSNDocumentPrivate {
+public:
+    JKSNArena arena;
+    const JKSNNode *root = nullptr;
+    std::vector<std::shared_ptr<std::string>> retained;
+    bool copy_strings = false;
+    size_t bytes_parsed = 0;
+    JKSNNode *allocateNodes(size_t count) {
+        return this->arena.allocate<JKSNNode>(count);
+    }
+    void clear() {
+        this->arena.reset();
+        this->root = nullptr;
+        this->retained.clear();
+        this->bytes_parsed = 0;
+    }
+};
+
+class JKSNDocumentState {
+public:
+    JKSNDocumentState(JKSNDocumentPrivate &document) :
+        document(document) {
+    }
+    JKSNDocumentPrivate &document;
+    /* Hashtable entries seen in this document, pointing into the input */
+    std::array<JKSNStringView, 256> texthash;
+    std::array<JKSNStringView, 256> blobhash;
+    std::bitset<256> textdirty;
+    std::bitset<256> blobdirty;
+    /* Text entries from skimmed UTF-16 strings, transcoded when looked up */
+    std::bitset<256> textutf16;
+    void setText(uint8_t hash, const JKSNStringView &str, bool utf16 = false) {
+        this->texthash[hash] = str;
+        this->textdirty[hash] = true;
+        this->textutf16[hash] = utf16;
+    }
+    void setBlob(uint8_t hash, const JKSNStringView &str) {
+        this->blobhash[hash] = str;
+        this->blobdirty[hash] = true;
+    }
+    void refresh() {
+        this->texthash.fill(JKSNStringView());
+        this->blobhash.fill(JKSNStringView());
+        this->textdirty.set();
+        this->blobdirty.set();
+        this->textutf16.reset();
+    }
+    /* Puts back the hashtable of an earlier copy */
+    void restore(const JKSNDocumentState &that) {
+        this->texthash = that.texthash;
+        this->blobhash = that.blobhash;
+        this->textdirty = that.textdirty;
+        this->blobdirty = that.blobdirty;
+        this->textutf16 = that.textutf16;
+    }
+};
+
+class JKSNTapeEntry {
+public:
+    /* Scalars are fully decoded, containers only have their type and size */
+    JKSNNode node;
+    /* Offset of the control byte, not counting the header */
+    size_t offset;
+    /* The entry just past this one and everything in it */
+    size_t end;
+    uint8_t control;
+    /* A string still in UTF-16LE, whose size counts bytes */
+    bool utf16 = false;
+};
+
+class JKSNIndexPrivate {
+public:
+    std::vector<JKSNTapeEntry> tape;
+    /* Only keeps hashtable entries from earlier messages alive */
+    JKSNDocumentPrivate document;
+    size_t header_size = 0;
+    size_t bytes_parsed = 0;
+    const JKSNTapeEntry &getEntry(size_t entry) const;
+    JKSNNode materializeNode(size_t entry, JKSNDocumentPrivate &document) const;
+    void clear() {
+        this->tape.clear();
+        this->document.clear();
+        this->header_size = 0;
+        this->bytes_parsed = 0;
+    }
 };
 
 class JKSNEncoderPrivate {
 public:
-    JKSNProxy dumpToProxy(const JKSNValue &obj);
+    JKSNEncoderPrivate() {
+        this->cache.dictionary.track_indices = true;
+    }
+    std::string &dumpToBuffer(const JKSNValue &obj, std::string &result);
+    /* Exact or estimated sizes of an array of objects, to test estimateArray */
+    static void testEstimate(const JKSNValue &obj, bool estimate, size_t &straight, size_t &swapped);
+    /* Control byte of the checksum around each dump, 0 for none */
+    uint8_t checksum = 0;
+    /* Strings to send in a hashtable refresher before the next value */
+    std::vector<std::string> refresher;
+    bool refresher_clear = false;
+    void writeRefresher(std::string &result);
+    /* Extensions to announce before the next value, see jksn_extension */
+    unsigned extensions = 0;
+    void writeExtensions(std::string &result);
+    jksn_optimization_level optimization = JKSN_OPTIMIZE_DEFAULT;
+    jksn_dictionary_stats dictionary_stats = jksn_dictionary_stats();
+    /* Counts every string written, only during the first pass */
+    std::unordered_map<JKSNStringView, size_t, JKSNStringViewHash> *string_counts = nullptr;
+    /* Slots filled by the dictionary, only during the second pass */
+    std::bitset<256> pinned;
+    /* Encodes the value twice, the second time after a refresher with the most used strings */
+    void writeDictionary(const JKSNValue &obj, std::string &result);
+    /* Writes a string in UTF-8 or UTF-16, whichever is in the hashtable or else keeps out of pinned slots */
+    void writePinnedString(const JKSNStringView &obj, std::string &result);
+    /* Writes a literal, bytes being obj in UTF-8 or UTF-16 */
+    void writeText(const JKSNStringView &obj, const JKSNStringView &bytes, bool utf16, std::string &result);
+    /* Writes a reference to the dictionary instead of a literal of the size given, if that is shorter */
+    bool writeReference(const JKSNStringView &obj, size_t literal_size, std::string &result);
+    /* Adds a literal as the decoder does, which is every string longer than a byte */
+    void addToDictionary(const JKSNStringView &obj);
+    /* Writes an array of numbers of one type, packed by an extension if that
+       is shorter. Returns false if they are not. */
+    bool writeNumbers(const std::vector<const JKSNValue *> &obj, std::string &result);
+    template<typename Integer> void writeNumbers(const Integer *data, size_t size, std::string &result);
+    void writeNumbers(const float *data, size_t size, std::string &result);
+    void writeNumbers(const double *data, size_t size, std::string &result);
+    /* Writes an array of booleans eight to a byte, if that is shorter.
+       Returns false if they are not all booleans or Unspecified. */
+    bool writeBools(const std::vector<const JKSNValue *> &obj, std::string &result);
+    void writeBools(const std::vector<bool> &data, const std::vector<bool> *present, std::string &result);
+    static void packBits(const std::vector<bool> &data, std::string &result);
+    /* Writes the packed items with their header, if they are shorter than written straight */
+    bool writePacked(uint8_t control, size_t count, const std::string &packed, size_t straight, std::string &result);
+    static void packXorDoubles(const double *data, size_t size, std::string &result);
+    template<typename Integer> static void packTypedIntegers(const Integer *data, size_t size, std::string &result);
+    template<typename Integer> static void packBitPacked(const Integer *data, size_t size, std::string &result);
+    template<typename Number> static void packTyped(const Number *data, size_t size, uint8_t type, std::string &result);
+    static size_t measureDelta(intmax_t delta);
+    /* Writes the control byte and, if immediate, room for the digest */
+    void beginChecksum(std::string &result);
+    /* Fills in or appends the digest of the value after begin */
+    void endChecksum(std::string &result, size_t begin);
 private:
     JKSNCache cache;
-    static JKSNProxy dumpValue(const JKSNValue &obj);
-    static JKSNProxy dumpUndefined(const JKSNValue &obj);
-    static JKSNProxy dumpNull(const JKSNValue &obj);
-    static JKSNProxy dumpBool(const JKSNValue &obj);
-    static JKSNProxy dumpInt(const JKSNValue &obj);
-    static std::string encodeInt(uintmax_t number, size_t size);
-    static JKSNProxy dumpFloat(const JKSNValue &obj);
-    static JKSNProxy dumpDouble(const JKSNValue &obj);
-    static JKSNProxy dumpLongDouble(const JKSNValue &obj);
-    static JKSNProxy dumpString(const JKSNValue &obj);
-    static JKSNProxy dumpBlob(const JKSNValue &obj);
-    static JKSNProxy dumpArray(const JKSNValue &obj);
-    static JKSNProxy dumpArray(const std::vector<const JKSNValue *> &obj, const JKSNValue *origin = nullptr);
     static bool testSwapAvailability(const std::vector<const JKSNValue *> &obj);
-    static JKSNProxy encodeStraightArray(const std::vector<const JKSNValue *> &obj, const JKSNValue *origin = nullptr);
-    static JKSNProxy encodeSwappedArray(const std::vector<const JKSNValue *> &obj, const JKSNValue *origin = nullptr);
-    static JKSNProxy dumpObject(const JKSNValue &obj);
-    static JKSNProxy dumpUnspecified(const JKSNValue &obj);
-    JKSNProxy &optimize(JKSNProxy &obj);
+    /* Single-pass encoder, which picks the shortest form while writing */
+    void writeValue(const JKSNValue &obj, std::string &result);
+    void writeInt(intmax_t number, std::string &result);
+    static void writeFloat(float number, std::string &result);
+    static void writeDouble(double number, std::string &result);
+    static void writeLongDouble(long double number, std::string &result);
+    void writeString(const JKSNStringView &obj, std::string &result);
+    void writeBlob(const JKSNStringView &obj, std::string &result);
+    void writeArray(const std::vector<const JKSNValue *> &obj, std::string &result);
+    void writeStraightArray(const std::vector<const JKSNValue *> &obj, std::string &result);
+    void writeSwappedArray(const std::vector<const JKSNValue *> &obj, std::string &result);
+    void writeObject(const JKSNValue &obj, std::string &result);
+    /* Writes an object with string keys by the number of its key set, or
+       sends the keys to be numbered. Returns false if it cannot. */
+    bool writeShapedObject(const JKSNValue &obj, std::string &result);
+    static void writeLength(uint8_t control, uintmax_t length, uintmax_t max_inline, std::string &result);
+    static void appendInt(uintmax_t number, size_t size, std::string &result);
+    /* Predict the size written down to depth levels, 0 for all of them */
+    static size_t measureValue(const JKSNValue &obj, size_t depth);
+    static size_t measureArray(const std::vector<const JKSNValue *> &obj, size_t depth, bool *swapped = nullptr);
+    static size_t measureStraightArray(const std::vector<const JKSNValue *> &obj, size_t depth);
+    static size_t measureSwappedArray(const std::vector<const JKSNValue *> &obj, size_t depth);
+    /* Longer arrays of objects are not measured but estimated from a sample of rows */
+    static const size_t max_measured_rows = 256;
+    static void estimateArray(const std::vector<const JKSNValue *> &obj, size_t &straight, size_t &swapped);
+    static size_t measureSelf(const JKSNValue &obj);
+    static size_t measureInt(intmax_t number);
+    static size_t measureLength(uintmax_t length, uintmax_t max_inline);
+    static size_t measureVarInt(uintmax_t number);
+    static void listColumns(const std::vector<const JKSNValue *> &obj, std::vector<const JKSNValue *> &columns);
+    static void listColumnValues(const std::vector<const JKSNValue *> &obj, const JKSNValue &column, std::vector<const JKSNValue *> &columns_value);
+    friend class JKSNWriter;
+    friend class JKSNWriterPrivate;
+};
+
+class JKSNWriterPrivate {
+public:
+    JKSNWriterPrivate(JKSNEncoderPrivate *encoder, std::string *result, std::ostream *stream, bool header);
+    /* The encoder is owned unless it was borrowed from a JKSNEncoder */
+    std::unique_ptr<JKSNEncoderPrivate> own_encoder;
+    JKSNEncoderPrivate *encoder;
+    std::string buffer;
+    std::string *result;
+    std::ostream *stream;
+    enum FrameType { ARRAY, LENGTHLESS_ARRAY, OBJECT };
+    struct Frame {
+        FrameType type;
+        size_t remaining;
+        /* The last key of an object, if a string, and the lastint its value swapped out */
+        bool keyed;
+        bool entered;
+        std::string key;
+        JKSNKeyInts::LastInt outer;
+    };
+    std::vector<Frame> frames;
+    bool complete = false;
+    /* Where the checksummed value begins in buffer, and the digest so far of what was flushed before */
+    size_t checksum_begin = 0;
+    std::unique_ptr<JKSNChecksum> checksum;
+    /* Output to a stream is written out whenever this much is buffered */
+    static const size_t flush_size = 65536;
+    /* A string item passes itself, in case it is a key */
+    void beginItem(const JKSNStringView *key = nullptr);
+    void endItem();
+    void beginContainer(FrameType type, size_t remaining);
+    void flush();
+};
+
+class JKSNStreamInput {
+public:
+    JKSNStreamInput(std::istream &fp) :
+        fp(fp) {
+    }
+    uint8_t get() {
+        char result;
+        if(!this->fp.get(result))
+            throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
+        for(JKSNChecksum *checksum : this->checksums)
+            checksum->update(&result, 1);
+        return uint8_t(result);
+    }
+    /* The returned buffer is only valid until the next read */
+    const char *read(size_t size) {
+        this->buf.resize(size);
+        if(!this->fp.read(&this->buf[0], std::streamsize(size)))
+            throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
+        for(JKSNChecksum *checksum : this->checksums)
+            checksum->update(this->buf.data(), size);
+        return this->buf.data();
+    }
+    /* Bytes are checksummed as they are read, since they are not kept */
+    size_t beginChecksum(JKSNChecksum *checksum) {
+        this->checksums.push_back(checksum);
+        return 0;
+    }
+    void endChecksum(JKSNChecksum *, size_t) {
+        this->checksums.pop_back();
+    }
+private:
+    std::istream &fp;
+    std::string buf;
+    std::vector<JKSNChecksum *> checksums;
+};
+
+class JKSNBufferInput {
+public:
+    JKSNBufferInput(const char *buffer, size_t size) :
+        begin(buffer),
+        end(buffer + size),
+        pos(buffer) {
+    }
+    uint8_t get() {
+        if(this->pos == this->end)
+            throw JKSNTruncatedError();
+        return uint8_t(*this->pos++);
+    }
+    const char *read(size_t size) {
+        if(size_t(this->end - this->pos) < size)
+            throw JKSNTruncatedError();
+        const char *result = this->pos;
+        this->pos += size;
+        return result;
+    }
+    /* Steps back over the byte just read by get() */
+    void unget() {
+        --this->pos;
+    }
+    size_t tell() const {
+        return size_t(this->pos - this->begin);
+    }
+    size_t remaining() const {
+        return size_t(this->end - this->pos);
+    }
+    /* The bytes not read yet */
+    const char *current() const {
+        return this->pos;
+    }
+    /* Bytes are checksummed at once when the value ends */
+    size_t beginChecksum(JKSNChecksum *) {
+        return this->tell();
+    }
+    void endChecksum(JKSNChecksum *checksum, size_t mark) {
+        checksum->update(this->begin + mark, this->tell() - mark);
+    }
+private:
+    const char *begin;
+    const char *end;
+    const char *pos;
 };
 
 class JKSNDecoderPrivate {
 public:
-    JKSNValue parseValue(std::istream &fp);
+    template<typename Input> JKSNValue parseValue(Input &fp);
+    void parseDocument(JKSNBufferInput &fp, JKSNDocumentPrivate &document, bool keep_hashtable = true);
+    void findDocument(JKSNBufferInput &fp, JKSNDocumentPrivate &document, const JKSNStringView &path, bool keep_hashtable = true);
+    void parseIndex(JKSNBufferInput &fp, JKSNIndexPrivate &index, bool keep_hashtable = true);
+    /* Extensions a pragma may turn on, see jksn_extension */
+    unsigned accepted_extensions = JKSN_EXTENSION_ALL;
 private:
     JKSNCache cache;
-    static uintmax_t decodeInt(std::istream &fp, size_t size);
-    static JKSNValue parseFloat(std::istream &fp);
-    static JKSNValue parseDouble(std::istream &fp);
-    static JKSNValue parseLongDouble(std::istream &fp);
-    JKSNValue parseSwappedArray(std::istream &fp, size_t column_length);
+    /* Turns on the extensions of a ["jksn-extensions", mask] pragma, other pragmas are ignored */
+    void applyPragma(const JKSNValue &pragma);
+    void applyPragma(const JKSNNode &pragma);
+    void setExtensions(intmax_t extensions);
+    /* Adds a literal longer than a byte to the dictionary, if it is turned on, size is in bytes either way */
+    void addToDictionary(const char *data, size_t size, bool utf16);
+    /* Arrays packed by an extension that is turned on. Each is written as
+       the number of items and the size in bytes, then the packed items. */
+    bool isPackedArray(uint8_t control) const;
+    template<typename Input> void parsePackedArray(Input &fp, uint8_t control, std::vector<JKSNNode> &items);
+    static void unpackXorDoubles(const char *data, size_t size, size_t count, std::vector<double> &result);
+    static void unpackTyped(const char *data, size_t size, size_t count, std::vector<JKSNNode> &result);
+    static void unpackBitPacked(const char *data, size_t size, size_t count, std::vector<JKSNNode> &result);
+    static void unpackBools(const char *data, size_t size, size_t count, std::vector<JKSNNode> &result);
+    /* Objects whose keys are sent once by 0xe6 and numbered, then referred
+       to by 0xe7 and that number. The values follow in the order of the keys. */
+    bool isShapedObject(uint8_t control) const;
+    template<typename Input, typename ParseKey> std::shared_ptr<const JKSNShapeCache::Shape> parseShape(Input &fp, uint8_t control, ParseKey parseKey);
+    std::shared_ptr<const JKSNShapeCache::Shape> parseShape(JKSNBufferInput &fp, JKSNDocumentState &state, uint8_t control);
+    static JKSNNode shapeKeyNode(JKSNDocumentPrivate &document, const std::shared_ptr<std::string> &key);
+    JKSNNode parseNode(JKSNBufferInput &fp, JKSNDocumentState &state);
+    JKSNNode parseSwappedNodes(JKSNBufferInput &fp, JKSNDocumentState &state, size_t column_length);
+    JKSNStringView lookupHash(JKSNDocumentState &state, uint8_t hashvalue, bool is_blob);
+    template<typename Input> static size_t decodeLength(Input &fp, uint8_t control);
+    template<typename Input> static uintmax_t decodeInt(Input &fp, size_t size);
+    template<typename Input> static JKSNValue parseFloat(Input &fp);
+    template<typename Input> static JKSNValue parseDouble(Input &fp);
+    template<typename Input> static JKSNValue parseLongDouble(Input &fp);
+    template<typename Input> JKSNValue parseSwappedArray(Input &fp, size_t column_length);
+    void commitHashtable(const JKSNDocumentState &state);
+    /* Skimming reads past a value, only keeping the hashtable and the last
+       integer up to date. It returns whether the value was unspecified. */
+    bool skimNode(JKSNBufferInput &fp, JKSNDocumentState &state);
+    /* Keys and values of an object, or names and columns of a swapped array */
+    void skimMembers(JKSNBufferInput &fp, JKSNDocumentState &state, size_t count);
+    uint8_t skimPrefixes(JKSNBufferInput &fp, JKSNDocumentState &state);
+    /* Reads a value after a checksum prefix and verifies it */
+    template<typename Input, typename Parse> static auto checkValue(Input &fp, uint8_t control, Parse parse) -> decltype(parse());
+    /* Skims everything but the path, unless the rest is not needed once found */
+    bool findNode(JKSNBufferInput &fp, JKSNDocumentState &state, const std::vector<std::string> &path, size_t depth, bool finish, const JKSNNode *&result);
+    static std::vector<std::string> splitPath(const JKSNStringView &path);
+    static size_t parsePathIndex(const std::string &segment);
+    /* Appends a value to the tape and returns its entry */
+    size_t indexNode(JKSNBufferInput &fp, JKSNDocumentState &state, std::vector<JKSNTapeEntry> &tape);
+    void indexSwappedNodes(JKSNBufferInput &fp, JKSNDocumentState &state, std::vector<JKSNTapeEntry> &tape, size_t column_length);
+    friend class JKSNReaderPrivate;
+    friend class JKSNIncrementalDecoderPrivate;
+    friend class JKSNSessionReader;
+    friend class JKSNIndex;
 };
 
-static std::string UTF8ToUTF16LE(const std::string &utf8str, bool strict = false);
-static std::string UTF16ToUTF8(const std::u16string &utf16str);
+class JKSNReaderPrivate {
+public:
+    JKSNReaderPrivate(JKSNDecoderPrivate *decoder, const char *buffer, size_t size, bool header, bool transpose);
+    /* The decoder is owned unless it was borrowed from a JKSNDecoder */
+    std::unique_ptr<JKSNDecoderPrivate> own_decoder;
+    JKSNDecoderPrivate *decoder;
+    /* Holds transcoded strings and transposed swapped arrays */
+    JKSNDocumentPrivate document;
+    JKSNDocumentState state;
+    size_t header_size;
+    JKSNBufferInput fp;
+    bool transpose;
+    enum FrameType { ARRAY, LENGTHLESS_ARRAY, OBJECT, SWAPPED_ARRAY, ARRAY_NODES, OBJECT_NODES };
+    struct Frame {
+        FrameType type;
+        /* Items left, keys and values count separately */
+        size_t remaining;
+        /* Transposed children still to be read */
+        const JKSNNode *nodes;
+        /* The last key of an object or swapped array, if a string, and the lastint its value swapped out */
+        bool keyed;
+        bool entered;
+        std::string key;
+        JKSNKeyInts::LastInt outer;
+    };
+    std::vector<Frame> frames;
+    /* Checksums of values not finished yet, innermost last */
+    struct PendingChecksum {
+        JKSNChecksum checksum;
+        uint8_t control;
+        /* The digest of an immediate checksum, a delayed one is read at the end */
+        std::string expected;
+        size_t depth;
+        /* Offset in fp the checksum has been updated to */
+        size_t hashed;
+    };
+    std::vector<PendingChecksum> checksums;
+    jksn_token_type token = JKSN_TOKEN_NONE;
+    JKSNNode current;
+    size_t current_size = 0;
+    bool is_key = false;
+    bool complete = false;
+    bool finished = false;
+    jksn_token_type next();
+    /* Skims the rest of the innermost container */
+    void skip();
+    void beginItem();
+    /* Puts back the lastint a value swapped out, once the value is read */
+    void endItem();
+    jksn_token_type beginContainer(FrameType type, jksn_token_type token, size_t size, size_t remaining, const JKSNNode *nodes = nullptr);
+    jksn_token_type endContainer();
+    jksn_token_type emitNode(const JKSNNode &node);
+    /* Hashes the bytes read so far into every pending checksum */
+    void updateChecksums();
+    /* Verifies the checksums of a value that ended with the container depth given */
+    void endValue(size_t depth);
+};
+
+class JKSNSessionReaderPrivate {
+public:
+    JKSNSessionReaderPrivate(JKSNDecoderPrivate *decoder, const char *buffer, size_t size, bool header);
+    /* The decoder is owned unless it was borrowed from a JKSNDecoder */
+    std::unique_ptr<JKSNDecoderPrivate> own_decoder;
+    JKSNDecoderPrivate *decoder;
+    JKSNDocumentPrivate document;
+    const char *buffer;
+    size_t size;
+    bool header;
+    size_t value_begin = 0;
+    size_t value_end = 0;
+};
+
+class JKSNIncrementalDecoderPrivate {
+public:
+    JKSNIncrementalDecoderPrivate(JKSNDecoderPrivate *decoder, bool header);
+    std::unique_ptr<JKSNDecoderPrivate> own_decoder;
+    JKSNDecoderPrivate *decoder;
+    bool header;
+    /* Tokens are read without transposing, so each one needs little input */
+    JKSNReaderPrivate reader;
+    /* Bytes not consumed yet, only when a call ends inside a value */
+    std::string buffer;
+    bool message_begin = true;
+    /* Containers begun and not yet ended, object members are stored as key, value, key, value... */
+    struct Frame {
+        jksn_token_type token;
+        std::vector<JKSNValue> items;
+    };
+    std::vector<Frame> frames;
+    JKSNValue value;
+    std::string error;
+    jksn_feed_status status = JKSN_FEED_NEED_MORE;
+    jksn_feed_status feed(const char *buffer, size_t size);
+    jksn_feed_status readValue();
+    /* Returns false and puts everything back if the input ends inside the token */
+    bool readToken();
+    void pushValue(JKSNValue &&value);
+    JKSNValue endFrame(Frame &frame);
+};
+
+static size_t UTF8CountUTF16(const JKSNStringView &utf8str, size_t limit, bool strict, bool &valid);
+static std::string UTF8ToUTF16LE(const JKSNStringView &utf8str, bool strict = false);
+static bool UTF16IsShorter(const JKSNStringView &utf8str, size_t &utf16_length);
+static void UTF8WriteUTF16LE(const JKSNStringView &utf8str, char *output);
+static size_t UTF16LECountUTF8(const char *data, size_t length);
+static char *UTF16LEWriteUTF8(const char *data, size_t length, char *output);
+static std::string UTF16LEToUTF8(const char *data, size_t length);
 static uint8_t DJBHash(const std::string &obj, uint8_t iv = 0);
+static uint8_t DJBHash(const char *buf, size_t size, uint8_t iv = 0);
+static void storeHash(std::shared_ptr<std::string> &slot, const char *data, size_t size);
 static inline bool isLittleEndian();
+static inline unsigned countLeadingZeros(uint64_t number);
+static inline unsigned countTrailingZeros(uint64_t number);
+static inline unsigned bitWidth(uint64_t number);
+static inline uint64_t zigzagEncode(int64_t number);
+static inline int64_t zigzagDecode(uint64_t number);
+
+class JKSNKeyContext {
+    /* Keeps the lastint of a string key in place while its value is coded */
+public:
+    JKSNKeyContext(JKSNCache &cache, const JKSNStringView &key) :
+        cache(cache) {
+        this->enter(key);
+    }
+    JKSNKeyContext(JKSNCache &cache, const JKSNValue &key) :
+        cache(cache) {
+        if((cache.extensions & JKSN_EXTENSION_KEY_DELTAS) && key.getType() == JKSN_STRING)
+            this->enter(key.toStringView());
+    }
+    JKSNKeyContext(JKSNCache &cache, const JKSNNode &key) :
+        cache(cache) {
+        if(key.data_type == JKSN_STRING)
+            this->enter(JKSNStringView(key.data_string, key.size));
+    }
+    /* The key of a value in an index, UTF-16 strings are transcoded */
+    JKSNKeyContext(JKSNCache &cache, const JKSNTapeEntry &key) :
+        cache(cache) {
+        if(key.node.data_type == JKSN_STRING) {
+            if(key.utf16 && (cache.extensions & JKSN_EXTENSION_KEY_DELTAS))
+                this->enter(UTF16LEToUTF8(key.node.data_string, key.node.size/2));
+            else
+                this->enter(JKSNStringView(key.node.data_string, key.node.size));
+        }
+    }
+    JKSNKeyContext(const JKSNKeyContext &) = delete;
+    JKSNKeyContext &operator=(const JKSNKeyContext &) = delete;
+    ~JKSNKeyContext() {
+        if(this->active)
+            this->cache.leaveKey(this->key, this->outer);
+    }
+private:
+    void enter(const JKSNStringView &key) {
+        if(this->cache.extensions & JKSN_EXTENSION_KEY_DELTAS) {
+            this->key.assign(key.data(), key.size());
+            this->outer = this->cache.enterKey(this->key);
+            this->active = true;
+        }
+    }
+    JKSNCache &cache;
+    std::string key;
+    JKSNKeyInts::LastInt outer = {false, 0};
+    bool active = false;
+};
 
 JKSNEncoder::JKSNEncoder() :
     p(new JKSNEncoderPrivate) {
@@ -189,491 +1144,2077 @@ JKSNEncoder::~JKSNEncoder() {
 }
 
 std::ostream &JKSNEncoder::dump(const JKSNValue &obj, std::ostream &result, bool header) {
-    JKSNProxy proxy = this->p->dumpToProxy(obj);
-    if(header && !result.write("jk!", 3))
-        return result;
-    proxy.output(result);
+    std::string buffer;
+    this->dump(obj, buffer, header);
+    result.write(buffer.data(), std::streamsize(buffer.size()));
     return result;
 }
 
 std::string JKSNEncoder::dump(const JKSNValue &obj, bool header) {
-    std::ostringstream result;
-    if(!this->dump(obj, result, header))
-        throw JKSNEncodeError("no enough memory");
-    return result.str();
+    std::string result;
+    this->dump(obj, result, header);
+    return result;
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpToProxy(const JKSNValue &obj) {
-    JKSNProxy proxy = this->dumpValue(obj);
-    this->optimize(proxy);
-    return proxy;
+std::string &JKSNEncoder::dump(const JKSNValue &obj, std::string &result, bool header) {
+    if(header)
+        result.append("jk!", 3);
+    this->p->writeExtensions(result);
+    this->p->writeRefresher(result);
+    if(!this->p->checksum)
+        return this->p->dumpToBuffer(obj, result);
+    this->p->beginChecksum(result);
+    size_t begin = result.size();
+    this->p->dumpToBuffer(obj, result);
+    this->p->endChecksum(result, begin);
+    return result;
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpValue(const JKSNValue &obj) {
-    switch(obj.getType()) {
-    case JKSN_UNDEFINED:
-        return dumpUndefined(obj);
-    case JKSN_NULL:
-        return dumpNull(obj);
-    case JKSN_BOOL:
-        return dumpBool(obj);
-    case JKSN_INT:
-        return dumpInt(obj);
-    case JKSN_FLOAT:
-        return dumpFloat(obj);
-    case JKSN_DOUBLE:
-        return dumpDouble(obj);
-    case JKSN_LONG_DOUBLE:
-        return dumpLongDouble(obj);
-    case JKSN_STRING:
-        return dumpString(obj);
-    case JKSN_BLOB:
-        return dumpBlob(obj);
-    case JKSN_ARRAY:
-        return dumpArray(obj);
-    case JKSN_OBJECT:
-        return dumpObject(obj);
-    case JKSN_UNSPECIFIED:
-        return dumpUnspecified(obj);
-    default:
-        throw JKSNEncodeError("cannot encode unrecognizable type of value");
-    }
+void JKSNEncoder::setChecksum(jksn_checksum_type type, bool delayed) {
+    static const uint8_t controls[4] = {0x00, 0xf0, 0xf1, 0xf4};
+    this->p->checksum = controls[type];
+    if(type != JKSN_CHECKSUM_NONE && delayed)
+        this->p->checksum |= 0x08;
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpUndefined(const JKSNValue &obj) {
-    return JKSNProxy(&obj, 0x00);
+void JKSNEncoder::setOptimization(jksn_optimization_level level) {
+    this->p->optimization = level;
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpNull(const JKSNValue &obj) {
-    return JKSNProxy(&obj, 0x01);
+const jksn_dictionary_stats &JKSNEncoder::dictionaryStats() const {
+    return this->p->dictionary_stats;
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpBool(const JKSNValue &obj) {
-    return JKSNProxy(&obj, obj.toBool() ? 0x03 : 0x02);
+void JKSNEncoder::setExtensions(unsigned extensions) {
+    if(extensions & ~unsigned(JKSN_EXTENSION_ALL))
+        throw std::invalid_argument("JKSN encoder does not support this extension");
+    this->p->extensions = extensions;
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpInt(const JKSNValue &obj) {
-    const intmax_t number = obj.toInt();
-    if(number >= 0 && number <= 0xa)
-        return JKSNProxy(&obj, 0x10 | uint8_t(number));
-    else if(number >= -0x80 && number <= 0x7f)
-        return JKSNProxy(&obj, 0x1d, encodeInt(uintmax_t(number), 1));
-    else if(number >= -0x8000 && number <= 0x7fff)
-        return JKSNProxy(&obj, 0x1c, encodeInt(uintmax_t(number), 2));
-    else if((number >= -0x80000000LL && number <= -0x200000) ||
-            (number >= 0x200000 && number <= 0x7fffffff))
-        return JKSNProxy(&obj, 0x1b, encodeInt(uintmax_t(number), 4));
-    else if(number >= 0)
-        return JKSNProxy(&obj, 0x1f, encodeInt(uintmax_t(number), 0));
-    else
-        return JKSNProxy(&obj, 0x1e, encodeInt(uintmax_t(-number), 0));
+void JKSNEncoder::refreshHashtable(const std::vector<std::string> &strings, bool clear) {
+    this->p->refresher.insert(this->p->refresher.end(), strings.begin(), strings.end());
+    if(clear) {
+        /* Strings queued before are gone with the rest of the hashtable */
+        this->p->refresher.erase(this->p->refresher.begin(), this->p->refresher.end() - std::ptrdiff_t(strings.size()));
+        this->p->refresher_clear = true;
+    }
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpFloat(const JKSNValue &obj) {
-    const float number = obj.toFloat();
-    if(isnan(number))
-        return JKSNProxy(&obj, 0x20);
-    else if(isinf(number))
-        return JKSNProxy(&obj, number >= 0 ? 0x2f : 0x2e);
-    else {
-        static_assert(sizeof (float) == 4, "sizeof (float) should be 4");
-        const union {
-            float data_float;
-            char data_int[4];
-        } conv = {number};
-        if(isLittleEndian())
-            return JKSNProxy(&obj, 0x2d, std::string({
-                conv.data_int[3], conv.data_int[2], conv.data_int[1], conv.data_int[0]
-            }));
-        else
-            return JKSNProxy(&obj, 0x2d, std::string({
-                conv.data_int[0], conv.data_int[1], conv.data_int[2], conv.data_int[3]
-            }));
-    }
+JKSNWriter::JKSNWriter(std::string &result, bool header) :
+    p(new JKSNWriterPrivate(nullptr, &result, nullptr, header)) {
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpDouble(const JKSNValue &obj) {
-    const double number = obj.toDouble();
-    if(isnan(number))
-        return JKSNProxy(&obj, 0x20);
-    else if(isinf(number))
-        return JKSNProxy(&obj, number >= 0 ? 0x2f : 0x2e);
-    else {
-        static_assert(sizeof (double) == 8, "sizeof (double) should be 8");
-        const union {
-            double data_double;
-            char data_int[8];
-        } conv = {number};
-        if(isLittleEndian())
-            return JKSNProxy(&obj, 0x2c, std::string({
-                conv.data_int[7], conv.data_int[6], conv.data_int[5], conv.data_int[4],
-                conv.data_int[3], conv.data_int[2], conv.data_int[1], conv.data_int[0]
-            }));
-        else
-            return JKSNProxy(&obj, 0x2c, std::string({
-                conv.data_int[0], conv.data_int[1], conv.data_int[2], conv.data_int[3],
-                conv.data_int[4], conv.data_int[5], conv.data_int[6], conv.data_int[7]
-            }));
-    }
+JKSNWriter::JKSNWriter(std::ostream &result, bool header) :
+    p(new JKSNWriterPrivate(nullptr, nullptr, &result, header)) {
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpLongDouble(const JKSNValue &obj) {
-    const long double number = obj.toLongDouble();
-    if(isnan(number))
-        return JKSNProxy(&obj, 0x20);
-    else if(isinf(number))
-        return JKSNProxy(&obj, number >= 0 ? 0x2f : 0x2e);
-    else if(sizeof (long double) == 12) {
-        const union {
-            long double data_long_double;
-            char data_int[12];
-        } conv = {number};
-        if(isLittleEndian())
-            return JKSNProxy(&obj, 0x2b, std::string({
-                conv.data_int[9], conv.data_int[8],
-                conv.data_int[7], conv.data_int[6], conv.data_int[5], conv.data_int[4],
-                conv.data_int[3], conv.data_int[2], conv.data_int[1], conv.data_int[0]
-            }));
-        else
-            return JKSNProxy(&obj, 0x2b, std::string({
-                conv.data_int[2], conv.data_int[3],
-                conv.data_int[4], conv.data_int[5], conv.data_int[6], conv.data_int[7],
-                conv.data_int[8], conv.data_int[9], conv.data_int[10], conv.data_int[11]
-            }));
-    } else if(sizeof (long double) == 16) {
-        const union {
-            long double data_long_double;
-            char data_int[16];
-        } conv = {number};
-        if(isLittleEndian())
-            return JKSNProxy(&obj, 0x2b, std::string({
-                conv.data_int[9], conv.data_int[8],
-                conv.data_int[7], conv.data_int[6], conv.data_int[5], conv.data_int[4],
-                conv.data_int[3], conv.data_int[2], conv.data_int[1], conv.data_int[0]
-            }));
-        else
-            return JKSNProxy(&obj, 0x2b, std::string({
-                conv.data_int[6], conv.data_int[7],
-                conv.data_int[8], conv.data_int[9], conv.data_int[10], conv.data_int[11],
-                conv.data_int[12], conv.data_int[13], conv.data_int[14], conv.data_int[15]
-            }));
-    } else
-        throw JKSNEncodeError("this build of JKSN decoder does not support long double numbers");
+JKSNWriter::JKSNWriter(JKSNEncoder &encoder, std::string &result, bool header) :
+    p(new JKSNWriterPrivate(encoder.p.get(), &result, nullptr, header)) {
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpString(const JKSNValue &obj) {
-    std::string obj_short = obj.toString();
-    bool is_utf16 = false;
-    try {
-        std::string obj_utf16 = UTF8ToUTF16LE(obj_short, true);
-        if(obj_utf16.size() < obj_short.size()) {
-            obj_short = std::move(obj_utf16);
-            is_utf16 = true;
-        }
-    } catch(JKSNTypeError) {
-    }
-    uint8_t control = is_utf16 ? 0x30 : 0x40;
-    uintmax_t length = is_utf16 ? obj_short.size()/2 : obj_short.size();
-    std::unique_ptr<JKSNProxy> result;
-    if(length <= (is_utf16 ? 0xb : 0xc))
-        result.reset(new JKSNProxy(&obj, control | uint8_t(length), std::string(), std::move(obj_short)));
-    else if(length <= 0xff)
-        result.reset(new JKSNProxy(&obj, control | 0xe, encodeInt(length, 1), std::move(obj_short)));
-    else if(length <= 0xffff)
-        result.reset(new JKSNProxy(&obj, control | 0xd, encodeInt(length, 2), std::move(obj_short)));
-    else
-        result.reset(new JKSNProxy(&obj, control | 0xf, encodeInt(length, 0), std::move(obj_short)));
-    result->hash = DJBHash(result->buf);
-    return std::move(*result);
+JKSNWriter::JKSNWriter(JKSNEncoder &encoder, std::ostream &result, bool header) :
+    p(new JKSNWriterPrivate(encoder.p.get(), nullptr, &result, header)) {
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpBlob(const JKSNValue &obj) {
-    std::string blob = obj.toBlob();
-    size_t length = blob.size();
-    std::unique_ptr<JKSNProxy> result;
-    if(length <= 0xb)
-        result.reset(new JKSNProxy(&obj, 0x50 | uint8_t(length), std::string(), std::move(blob)));
-    else if(length <= 0xff)
-        result.reset(new JKSNProxy(&obj, 0x5e, encodeInt(length, 1), std::move(blob)));
-    else if(length <= 0xffff)
-        result.reset(new JKSNProxy(&obj, 0x5d, encodeInt(length, 2), std::move(blob)));
-    else
-        result.reset(new JKSNProxy(&obj, 0x5f, encodeInt(length, 0), std::move(blob)));
-    result->hash = DJBHash(result->buf);
-    return std::move(*result);
+JKSNWriter::JKSNWriter(JKSNWriter &&that) :
+    p(std::move(that.p)) {
 }
 
-bool JKSNEncoderPrivate::testSwapAvailability(const std::vector<const JKSNValue *> &obj) {
-    bool columns = false;
+JKSNWriter &JKSNWriter::operator=(JKSNWriter &&that) {
+    if(this != &that) {
+        if(this->p)
+            this->p->flush();
+        this->p = std::move(that.p);
+    }
+    return *this;
+}
+
+JKSNWriter::~JKSNWriter() {
+    if(this->p)
+        this->p->flush();
+}
+
+JKSNWriter &JKSNWriter::beginArray() {
+    this->p->beginItem();
+    this->p->result->push_back(char(0xc8));
+    this->p->beginContainer(JKSNWriterPrivate::LENGTHLESS_ARRAY, 0);
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::beginArray(size_t size) {
+    this->p->beginItem();
+    JKSNEncoderPrivate::writeLength(0x80, size, 0xc, *this->p->result);
+    this->p->beginContainer(JKSNWriterPrivate::ARRAY, size);
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::beginObject(size_t size) {
+    if(size > size_t(-1)/2)
+        throw JKSNEncodeError("JKSN object too large");
+    this->p->beginItem();
+    JKSNEncoderPrivate::writeLength(0x90, size, 0xc, *this->p->result);
+    this->p->beginContainer(JKSNWriterPrivate::OBJECT, size*2);
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::end() {
+    if(this->p->frames.empty())
+        throw JKSNEncodeError("JKSN writer has no container to end");
+    const JKSNWriterPrivate::Frame &frame = this->p->frames.back();
+    if(frame.type == JKSNWriterPrivate::LENGTHLESS_ARRAY)
+        this->p->result->push_back(char(0xa0));
+    else if(frame.remaining != 0)
+        throw JKSNEncodeError("JKSN writer ended a container before all of its items");
+    this->p->frames.pop_back();
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::key(const JKSNStringView &key) {
+    if(this->p->frames.empty() || this->p->frames.back().type != JKSNWriterPrivate::OBJECT || this->p->frames.back().remaining % 2 != 0)
+        throw JKSNEncodeError("JKSN writer expected a value instead of a key");
+    return this->value(key);
+}
+
+JKSNWriter &JKSNWriter::value(std::nullptr_t) {
+    this->p->beginItem();
+    this->p->result->push_back(char(0x01));
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::value(bool data) {
+    this->p->beginItem();
+    this->p->result->push_back(char(data ? 0x03 : 0x02));
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::value(intmax_t data) {
+    this->p->beginItem();
+    this->p->encoder->writeInt(data, *this->p->result);
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::value(uintmax_t data) {
+    if(static_cast<intmax_t>(data) < 0)
+        throw std::overflow_error("JKSN value too large");
+    return this->value(static_cast<intmax_t>(data));
+}
+
+JKSNWriter &JKSNWriter::value(int data) {
+    return this->value(intmax_t(data));
+}
+
+JKSNWriter &JKSNWriter::value(unsigned data) {
+    return this->value(intmax_t(data));
+}
+
+JKSNWriter &JKSNWriter::value(float data) {
+    this->p->beginItem();
+    JKSNEncoderPrivate::writeFloat(data, *this->p->result);
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::value(double data) {
+    this->p->beginItem();
+    JKSNEncoderPrivate::writeDouble(data, *this->p->result);
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::value(long double data) {
+    this->p->beginItem();
+    JKSNEncoderPrivate::writeLongDouble(data, *this->p->result);
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::value(const char *data) {
+    return this->value(JKSNStringView(data));
+}
+
+JKSNWriter &JKSNWriter::value(const std::string &data) {
+    return this->value(JKSNStringView(data));
+}
+
+JKSNWriter &JKSNWriter::value(const JKSNStringView &data) {
+    this->p->beginItem(&data);
+    this->p->encoder->writeString(data, *this->p->result);
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::value(const Unspecified &) {
+    if(!this->p->frames.empty() && this->p->frames.back().type == JKSNWriterPrivate::LENGTHLESS_ARRAY)
+        throw JKSNEncodeError("JKSN lengthless arrays cannot contain unspecified values");
+    this->p->beginItem();
+    this->p->result->push_back(char(0xa0));
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::value(const JKSNValue &data) {
+    if(data.isUnspecified())
+        return this->value(Unspecified());
+    if(data.getType() == JKSN_STRING) {
+        JKSNStringView key = data.toStringView();
+        this->p->beginItem(&key);
+    } else
+        this->p->beginItem();
+    this->p->encoder->writeValue(data, *this->p->result);
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::blob(const JKSNStringView &data) {
+    this->p->beginItem();
+    this->p->encoder->writeBlob(data, *this->p->result);
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::array(const int32_t *data, size_t size) {
+    this->p->beginItem();
+    this->p->encoder->writeNumbers(data, size, *this->p->result);
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::array(const int64_t *data, size_t size) {
+    this->p->beginItem();
+    this->p->encoder->writeNumbers(data, size, *this->p->result);
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::array(const float *data, size_t size) {
+    this->p->beginItem();
+    this->p->encoder->writeNumbers(data, size, *this->p->result);
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::array(const double *data, size_t size) {
+    this->p->beginItem();
+    this->p->encoder->writeNumbers(data, size, *this->p->result);
+    this->p->endItem();
+    return *this;
+}
+
+JKSNWriter &JKSNWriter::array(const std::vector<bool> &data) {
+    this->p->beginItem();
+    this->p->encoder->writeBools(data, nullptr, *this->p->result);
+    this->p->endItem();
+    return *this;
+}
+
+bool JKSNWriter::complete() const {
+    return this->p->complete;
+}
+
+void JKSNWriter::flush() {
+    this->p->flush();
+}
+
+JKSNWriterPrivate::JKSNWriterPrivate(JKSNEncoderPrivate *encoder, std::string *result, std::ostream *stream, bool header) :
+    own_encoder(encoder ? nullptr : new JKSNEncoderPrivate),
+    encoder(encoder ? encoder : own_encoder.get()),
+    result(result ? result : &this->buffer),
+    stream(stream) {
+    if(header)
+        this->result->append("jk!", 3);
+}
+
+void JKSNWriterPrivate::beginItem(const JKSNStringView *key) {
+    if(this->frames.empty()) {
+        if(this->complete)
+            throw JKSNEncodeError("JKSN writer already has a complete value");
+        this->encoder->writeExtensions(*this->result);
+        this->encoder->writeRefresher(*this->result);
+        if(this->encoder->checksum) {
+            this->encoder->beginChecksum(*this->result);
+            this->checksum_begin = this->result->size();
+            this->checksum.reset(new JKSNChecksum(this->encoder->checksum));
+        }
+    } else {
+        Frame &frame = this->frames.back();
+        if(frame.type != LENGTHLESS_ARRAY) {
+            if(frame.remaining == 0)
+                throw JKSNEncodeError("JKSN writer got more items than the container size");
+            --frame.remaining;
+        }
+        if(frame.type == OBJECT) {
+            if(frame.remaining % 2 != 0) {
+                frame.keyed = key && (this->encoder->cache.extensions & JKSN_EXTENSION_KEY_DELTAS);
+                if(frame.keyed)
+                    frame.key.assign(key->data(), key->size());
+            } else if(frame.keyed) {
+                frame.outer = this->encoder->cache.enterKey(frame.key);
+                frame.entered = true;
+            }
+        }
+    }
+}
+
+void JKSNWriterPrivate::endItem() {
+    if(!this->frames.empty() && this->frames.back().entered) {
+        Frame &frame = this->frames.back();
+        this->encoder->cache.leaveKey(frame.key, frame.outer);
+        frame.entered = false;
+    }
+    if(this->frames.empty()) {
+        this->complete = true;
+        if(this->checksum) {
+            if(this->encoder->checksum >= 0xf8) {
+                this->checksum->update(this->result->data() + this->checksum_begin, this->result->size() - this->checksum_begin);
+                this->result->append(this->checksum->digest());
+            } else
+                this->encoder->endChecksum(*this->result, this->checksum_begin);
+            this->checksum.reset();
+        }
+    }
+    if(this->stream && (this->complete || this->buffer.size() >= flush_size))
+        this->flush();
+}
+
+void JKSNWriterPrivate::beginContainer(FrameType type, size_t remaining) {
+    this->frames.push_back(Frame({type, remaining, false, false, std::string(), JKSNKeyInts::LastInt({false, 0})}));
+}
+
+void JKSNWriterPrivate::flush() {
+    if(this->stream && !this->buffer.empty()) {
+        if(this->checksum) {
+            /* The digest of an immediate checksum is written before the value */
+            if(this->encoder->checksum <= 0xf5)
+                return;
+            this->checksum->update(this->buffer.data() + this->checksum_begin, this->buffer.size() - this->checksum_begin);
+            this->checksum_begin = 0;
+        }
+        this->stream->write(this->buffer.data(), std::streamsize(this->buffer.size()));
+        this->buffer.clear();
+    }
+}
+
+bool JKSNEncoderPrivate::testSwapAvailability(const std::vector<const JKSNValue *> &obj) {
+    bool columns = false;
     for(const JKSNValue *const row : obj)
         if(!row->isObject())
             return false;
         else
-            columns = columns || !row->toMap().empty();
+            columns = columns || !row->toObject().empty();
     return columns;
 }
 
-JKSNProxy JKSNEncoderPrivate::encodeStraightArray(const std::vector<const JKSNValue *> &obj, const JKSNValue *origin) {
-    size_t length = obj.size();
-    std::unique_ptr<JKSNProxy> result;
-    if(length <= 0xc)
-        result.reset(new JKSNProxy(origin, 0x80 | uint8_t(length)));
-    else if(length <= 0xff)
-        result.reset(new JKSNProxy(origin, 0x8e, encodeInt(length, 1)));
-    else if(length <= 0xffff)
-        result.reset(new JKSNProxy(origin, 0x8d, encodeInt(length, 2)));
+std::string &JKSNEncoderPrivate::dumpToBuffer(const JKSNValue &obj, std::string &result) {
+    if(this->optimization == JKSN_OPTIMIZE_DICTIONARY)
+        this->writeDictionary(obj, result);
     else
-        result.reset(new JKSNProxy(origin, 0x8f, encodeInt(length, 0)));
-    for(const JKSNValue *const i : obj)
-        result->children.push_back(dumpValue(*i));
-    assert(result->children.size() == length);
-    return std::move(*result);
+        this->writeValue(obj, result);
+    return result;
 }
 
-JKSNProxy JKSNEncoderPrivate::encodeSwappedArray(const std::vector<const JKSNValue *> &obj, const JKSNValue *origin) {
-    std::list<JKSNValue> columns;
-    std::unordered_set<JKSNValue> columns_set;
-    for(const JKSNValue *const row : obj)
-        for(const std::pair<JKSNValue, JKSNValue> &column : row->toMap())
-            if(columns_set.find(column.first) == columns_set.end()) {
-                columns.push_back(column.first);
-                columns_set.insert(column.first);
-            }
-    size_t collen = columns.size();
-    std::unique_ptr<JKSNProxy> result;
-    if(collen <= 0xc)
-        result.reset(new JKSNProxy(origin, 0xa0 | uint8_t(collen)));
-    else if(collen <= 0xff)
-        result.reset(new JKSNProxy(origin, 0xae, encodeInt(collen, 1)));
-    else if(collen <= 0xffff)
-        result.reset(new JKSNProxy(origin, 0xad, encodeInt(collen, 2)));
-    else
-        result.reset(new JKSNProxy(origin, 0xaf, encodeInt(collen, 0)));
-    for(const JKSNValue &column : columns) {
-        result->children.push_back(dumpValue(column));
-        std::vector<const JKSNValue *> columns_value;
-        columns_value.reserve(obj.size());
-        for(const JKSNValue *const row : obj) {
-            static JKSNValue unspecified_value = JKSNValue::fromUnspecified();
-            std::map<JKSNValue, JKSNValue>::const_iterator it = row->toMap().find(column);
-            columns_value.push_back(it != row->toMap().end() ? &it->second : &unspecified_value);
+void JKSNEncoderPrivate::writeDictionary(const JKSNValue &obj, std::string &result) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    /* The first pass is an ordinary one, which is kept if the dictionary does not pay off */
+    JKSNCache saved_cache = this->cache;
+    std::unordered_map<JKSNStringView, size_t, JKSNStringViewHash> counts;
+    std::string plain;
+    this->string_counts = &counts;
+    this->writeValue(obj, plain);
+    this->string_counts = nullptr;
+    JKSNCache plain_cache = std::move(this->cache);
+    this->cache = std::move(saved_cache);
+
+    /* The most used strings take their own slot, each can be sent in UTF-8 or
+       in UTF-16, which gives it two slots to choose from. Slots are shared out
+       by cuckoo hashing, in order of how many bytes a string takes up. */
+    struct Candidate {
+        JKSNStringView str;
+        size_t value;
+        /* The shorter encoding first */
+        std::string bytes[2];
+        bool utf16[2];
+        uint8_t hash[2];
+        size_t choices;
+    };
+    std::vector<Candidate> candidates;
+    for(const std::pair<const JKSNStringView, size_t> &i : counts) {
+        if(i.second < 2)
+            continue;
+        Candidate candidate;
+        candidate.str = i.first;
+        candidate.value = i.second*i.first.size();
+        size_t utf16_length;
+        bool utf16 = UTF16IsShorter(i.first, utf16_length);
+        bool valid;
+        UTF8CountUTF16(i.first, size_t(-1), true, valid);
+        candidate.choices = 0;
+        for(bool use_utf16 : {utf16, !utf16})
+            if(valid || !use_utf16) {
+                std::string &bytes = candidate.bytes[candidate.choices];
+                bytes = use_utf16 ? UTF8ToUTF16LE(i.first) : std::string(i.first);
+                candidate.utf16[candidate.choices] = use_utf16;
+                candidate.hash[candidate.choices++] = DJBHash(bytes.data(), bytes.size());
+            }
+        candidates.push_back(std::move(candidate));
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.value > b.value || (a.value == b.value && a.bytes[0] < b.bytes[0]);
+    });
+    static const size_t max_kicks = 32;
+    std::array<std::pair<const Candidate *, size_t>, 256> slots;
+    for(const Candidate &candidate : candidates) {
+        const Candidate *current = &candidate;
+        size_t choice = 0;
+        for(size_t kick = 0; current && kick < max_kicks; ++kick) {
+            for(size_t i = 0; current && i < current->choices; ++i)
+                if(!this->pinned[current->hash[i]]) {
+                    this->pinned[current->hash[i]] = true;
+                    slots[current->hash[i]] = std::make_pair(current, i);
+                    current = nullptr;
+                }
+            if(!current)
+                break;
+            /* Take a slot and move whoever had it to its other one */
+            choice = std::min(choice, current->choices - 1);
+            std::pair<const Candidate *, size_t> &slot = slots[current->hash[choice]];
+            std::pair<const Candidate *, size_t> evicted = slot;
+            slot = std::make_pair(current, choice);
+            current = evicted.first;
+            choice = 1 - evicted.second;
         }
-        result->children.push_back(dumpArray(columns_value));
     }
-    assert(result->children.size() == collen*2);
-    return std::move(*result);
-}
+    std::string items;
+    size_t count = 0;
+    for(size_t hash = 0; hash < slots.size(); ++hash)
+        if(this->pinned[hash] && !(this->cache.texthash[hash] && JKSNStringView(*this->cache.texthash[hash]) == slots[hash].first->bytes[slots[hash].second])) {
+            this->writeText(slots[hash].first->str, slots[hash].first->bytes[slots[hash].second], slots[hash].first->utf16[slots[hash].second], items);
+            ++count;
+        }
+    this->dictionary_stats.strings = count;
+    this->dictionary_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-JKSNProxy JKSNEncoderPrivate::dumpArray(const JKSNValue &obj) {
-    std::vector<const JKSNValue *> obj_vector;
-    obj_vector.reserve(obj.toVector().size());
-    for(const JKSNValue &i : obj.toVector())
-        obj_vector.push_back(&i);
-    return dumpArray(obj_vector, &obj);
+    size_t begin = result.size();
+    if(count != 0) {
+        writeLength(0x70, count, 0xc, result);
+        result.append(items);
+    }
+    this->writeValue(obj, result);
+    this->pinned.reset();
+    if(result.size() - begin >= plain.size()) {
+        result.resize(begin);
+        result.append(plain);
+        this->cache = std::move(plain_cache);
+        this->dictionary_stats.strings = 0;
+        this->dictionary_stats.bytes_saved = 0;
+    } else
+        this->dictionary_stats.bytes_saved = plain.size() - (result.size() - begin);
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpArray(const std::vector<const JKSNValue *> &obj, const JKSNValue *origin) {
-    JKSNProxy result = encodeStraightArray(obj, origin);
-    if(testSwapAvailability(obj)) {
-        JKSNProxy result_swapped = encodeSwappedArray(obj);
-        if(result_swapped.size(3) < result.size(3))
-            result = std::move(result_swapped);
+void JKSNEncoderPrivate::writeRefresher(std::string &result) {
+    if(this->refresher_clear) {
+        result.push_back(char(0x70));
+        this->cache.texthash.fill(nullptr);
+        this->cache.blobhash.fill(nullptr);
+        this->refresher_clear = false;
+    }
+    /* Strings already in the hashtable are left out, the rest are never references */
+    std::string items;
+    size_t count = 0;
+    for(const std::string &str : this->refresher) {
+        if(str.size() <= 1)
+            continue;
+        size_t utf16_length;
+        bool utf16 = UTF16IsShorter(str, utf16_length);
+        std::string bytes = utf16 ? UTF8ToUTF16LE(str) : str;
+        uint8_t hash = DJBHash(bytes);
+        if(this->cache.texthash[hash] && *this->cache.texthash[hash] == bytes)
+            continue;
+        this->writeText(str, bytes, utf16, items);
+        ++count;
+    }
+    this->refresher.clear();
+    if(count != 0) {
+        writeLength(0x70, count, 0xc, result);
+        result.append(items);
     }
-    return result;
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpObject(const JKSNValue &obj) {
-    size_t length = obj.toMap().size();
-    std::unique_ptr<JKSNProxy> result;
-    if(length <= 0xc)
-        result.reset(new JKSNProxy(&obj, 0x90 | uint8_t(length)));
-    else if(length <= 0xff)
-        result.reset(new JKSNProxy(&obj, 0x9e, encodeInt(length, 1)));
-    else if(length <= 0xffff)
-        result.reset(new JKSNProxy(&obj, 0x9d, encodeInt(length, 2)));
-    else
-        result.reset(new JKSNProxy(&obj, 0x9f, encodeInt(length, 0)));
-    for(const std::pair<JKSNValue, JKSNValue> &item : obj.toMap()) {
-        result->children.push_back(dumpValue(item.first));
-        result->children.push_back(dumpValue(item.second));
-    }
-    assert(result->children.size() == length*2);
-    return std::move(*result);
+void JKSNEncoderPrivate::writeExtensions(std::string &result) {
+    if(this->extensions == this->cache.extensions)
+        return;
+    /* Written before the extensions change, as the decoder reads it */
+    result.push_back(char(0xff));
+    this->writeValue(JKSNValue({"jksn-extensions", intmax_t(this->extensions)}), result);
+    this->cache.setExtensions(this->extensions);
 }
 
-JKSNProxy JKSNEncoderPrivate::dumpUnspecified(const JKSNValue &obj) {
-    return JKSNProxy(&obj, 0xa0);
+void JKSNEncoderPrivate::beginChecksum(std::string &result) {
+    result.push_back(char(this->checksum));
+    if(this->checksum <= 0xf5)
+        result.append(JKSNChecksum::digestSize(this->checksum), '\0');
 }
 
-JKSNProxy &JKSNEncoderPrivate::optimize(JKSNProxy &obj) {
-    uint8_t control = obj.control & 0xf0;
-    switch(control) {
-        case 0x10:
-            if (this->cache.haslastint) {
-                intmax_t delta = obj.origin->toInt() - this->cache.lastint;
-                if(std::abs(delta) < std::abs(obj.origin->toInt())) {
-                    uint8_t new_control;
-                    std::string new_data;
-                    if(delta >= 0 && delta <= 0x5)
-                        new_control = 0xd0 | uint8_t(delta);
-                    else if(delta >= -0x5 && delta <= -0x1)
-                        new_control = 0xd0 | uint8_t(delta+11);
-                    else if(delta >= -0x80 && delta <= 0x7f) {
-                        new_control = 0xdd;
-                        new_data = encodeInt(uintmax_t(delta), 1);
-                    } else if(delta >= -0x8000 && delta <= 0x7fff) {
-                        new_control = 0xdc;
-                        new_data = encodeInt(uintmax_t(delta), 2);
-                    } else if((delta >= -0x80000000LL && delta <= -0x200000) ||
-                              (delta >= 0x200000 && delta <= 0x7fffffff)) {
-                        new_control = 0xdb;
-                        new_data = encodeInt(uintmax_t(delta), 4);
-                    } else if(delta >= 0) {
-                        new_control = 0xdf;
-                        new_data = encodeInt(uintmax_t(delta), 0);
-                    } else {
-                        new_control = 0xde;
-                        new_data = encodeInt(uintmax_t(-delta), 0);
-                    }
-                    if(new_data.size() < obj.data.size()) {
-                        obj.control = new_control;
-                        obj.data = std::move(new_data);
-                    }
-                }
-            }
-            this->cache.haslastint = true;
-            this->cache.lastint = obj.origin->toInt();
-            break;
-        case 0x30:
-        case 0x40:
-            if(obj.buf.size() > 1) {
-                if(this->cache.texthash[obj.hash] && *this->cache.texthash[obj.hash] == obj.buf) {
-                    obj.control = 0x3c;
-                    obj.data = encodeInt(obj.hash, 1);
-                    obj.buf.clear();
-                } else
-                    this->cache.texthash[obj.hash] = std::make_shared<std::string>(obj.buf);
-            }
-            break;
-        case 0x50:
-            if(obj.buf.size() > 1) {
-                if(this->cache.blobhash[obj.hash] && *this->cache.blobhash[obj.hash] == obj.buf) {
-                    obj.control = 0x3c;
-                    obj.data = encodeInt(obj.hash, 1);
-                    obj.buf.clear();
-                } else
-                    this->cache.blobhash[obj.hash] = std::make_shared<std::string>(obj.buf);
-            }
-            break;
-        default:
-            for(JKSNProxy &child : obj.children)
-                this->optimize(child);
+void JKSNEncoderPrivate::endChecksum(std::string &result, size_t begin) {
+    JKSNChecksum checksum(this->checksum);
+    checksum.update(result.data() + begin, result.size() - begin);
+    if(this->checksum >= 0xf8)
+        result.append(checksum.digest());
+    else {
+        size_t size = JKSNChecksum::digestSize(this->checksum);
+        result.replace(begin - size, size, checksum.digest());
     }
-    return obj;
 }
 
-std::string JKSNEncoderPrivate::encodeInt(uintmax_t number, size_t size) {
-    switch(size) {
-    case 1:
-        return std::string({
-            char(uint8_t(number))
-        });
-    case 2:
-        return std::string({
-            char(uint8_t(number >> 8)),
-            char(uint8_t(number))
-        });
-    case 4:
-        return std::string({
-            char(uint8_t(number >> 24)),
-            char(uint8_t(number >> 16)),
-            char(uint8_t(number >> 8)),
-            char(uint8_t(number))
-        });
-    case 0:
+void JKSNEncoderPrivate::writeValue(const JKSNValue &obj, std::string &result) {
+    switch(obj.getType()) {
+    case JKSN_UNDEFINED:
+        result.push_back(char(0x00));
+        break;
+    case JKSN_NULL:
+        result.push_back(char(0x01));
+        break;
+    case JKSN_BOOL:
+        result.push_back(char(obj.toBool() ? 0x03 : 0x02));
+        break;
+    case JKSN_INT:
+        this->writeInt(obj.toInt(), result);
+        break;
+    case JKSN_FLOAT:
+        writeFloat(obj.toFloat(), result);
+        break;
+    case JKSN_DOUBLE:
+        writeDouble(obj.toDouble(), result);
+        break;
+    case JKSN_LONG_DOUBLE:
+        writeLongDouble(obj.toLongDouble(), result);
+        break;
+    case JKSN_STRING:
+        this->writeString(obj.toStringView(), result);
+        break;
+    case JKSN_BLOB:
+        this->writeBlob(obj.toStringView(), result);
+        break;
+    case JKSN_ARRAY:
         {
-            std::string result(1, char(number & 0x7f));
-            number >>= 7;
-            while(number != 0) {
-                result.append(1, char((number & 0x7f) | 0x80));
-                number >>= 7;
-            }
-            return std::string(result.crbegin(), result.crend());
+            std::vector<const JKSNValue *> obj_vector;
+            obj_vector.reserve(obj.toVector().size());
+            for(const JKSNValue &i : obj.toVector())
+                obj_vector.push_back(&i);
+            this->writeArray(obj_vector, result);
         }
+        break;
+    case JKSN_OBJECT:
+        this->writeObject(obj, result);
+        break;
+    case JKSN_UNSPECIFIED:
+        result.push_back(char(0xa0));
+        break;
     default:
-        assert(size == 1 || size == 2 || size == 4 || size == 0);
-        abort();
+        throw JKSNEncodeError("cannot encode unrecognizable type of value");
     }
 }
 
-JKSNDecoder::JKSNDecoder() :
-    p(new JKSNDecoderPrivate) {
+void JKSNEncoderPrivate::writeInt(intmax_t number, std::string &result) {
+    uint8_t control;
+    uintmax_t payload = 0;
+    size_t size = 0;
+    size_t data_size = 0;
+    if(number >= 0 && number <= 0xa)
+        control = 0x10 | uint8_t(number);
+    else if(number >= -0x80 && number <= 0x7f) {
+        control = 0x1d;
+        payload = uintmax_t(number);
+        size = data_size = 1;
+    } else if(number >= -0x8000 && number <= 0x7fff) {
+        control = 0x1c;
+        payload = uintmax_t(number);
+        size = data_size = 2;
+    } else if((number >= -0x80000000LL && number <= -0x200000) ||
+              (number >= 0x200000 && number <= 0x7fffffff)) {
+        control = 0x1b;
+        payload = uintmax_t(number);
+        size = data_size = 4;
+    } else if(number >= 0) {
+        control = 0x1f;
+        payload = uintmax_t(number);
+        data_size = measureVarInt(payload);
+    } else {
+        control = 0x1e;
+        payload = 0 - uintmax_t(number);
+        data_size = measureVarInt(payload);
+    }
+    if(this->cache.haslastint) {
+        intmax_t delta = intmax_t(uintmax_t(number) - uintmax_t(this->cache.lastint));
+        /* Compared as unsigned, as INTMAX_MIN has no positive counterpart */
+        if((delta < 0 ? 0 - uintmax_t(delta) : uintmax_t(delta)) < (number < 0 ? 0 - uintmax_t(number) : uintmax_t(number))) {
+            uint8_t new_control;
+            uintmax_t new_payload = 0;
+            size_t new_size = 0;
+            size_t new_data_size = 0;
+            if(delta >= 0 && delta <= 0x5)
+                new_control = 0xd0 | uint8_t(delta);
+            else if(delta >= -0x5 && delta <= -0x1)
+                new_control = 0xd0 | uint8_t(delta+11);
+            else if(delta >= -0x80 && delta <= 0x7f) {
+                new_control = 0xdd;
+                new_payload = uintmax_t(delta);
+                new_size = new_data_size = 1;
+            } else if(delta >= -0x8000 && delta <= 0x7fff) {
+                new_control = 0xdc;
+                new_payload = uintmax_t(delta);
+                new_size = new_data_size = 2;
+            } else if((delta >= -0x80000000LL && delta <= -0x200000) ||
+                      (delta >= 0x200000 && delta <= 0x7fffffff)) {
+                new_control = 0xdb;
+                new_payload = uintmax_t(delta);
+                new_size = new_data_size = 4;
+            } else if(delta >= 0) {
+                new_control = 0xdf;
+                new_payload = uintmax_t(delta);
+                new_data_size = measureVarInt(new_payload);
+            } else {
+                new_control = 0xde;
+                new_payload = 0 - uintmax_t(delta);
+                new_data_size = measureVarInt(new_payload);
+            }
+            if(new_data_size < data_size) {
+                control = new_control;
+                payload = new_payload;
+                size = new_size;
+                data_size = new_data_size;
+            }
+        }
+    }
+    this->cache.haslastint = true;
+    this->cache.lastint = number;
+    result.push_back(char(control));
+    if(data_size != 0)
+        appendInt(payload, size, result);
 }
 
-JKSNDecoder::JKSNDecoder(const JKSNDecoder &that) :
-    p(new JKSNDecoderPrivate(*that.p)) {
+void JKSNEncoderPrivate::writeFloat(float number, std::string &result) {
+    if(std::isnan(number))
+        result.push_back(char(0x20));
+    else if(std::isinf(number))
+        result.push_back(char(number >= 0 ? 0x2f : 0x2e));
+    else {
+        static_assert(sizeof (float) == 4, "sizeof (float) should be 4");
+        uint32_t bits;
+        std::memcpy(&bits, &number, 4);
+        result.push_back(char(0x2d));
+        appendInt(bits, 4, result);
+    }
 }
 
-JKSNDecoder::JKSNDecoder(JKSNDecoder &&that) :
-    p(std::move(that.p)) {
+void JKSNEncoderPrivate::writeDouble(double number, std::string &result) {
+    if(std::isnan(number))
+        result.push_back(char(0x20));
+    else if(std::isinf(number))
+        result.push_back(char(number >= 0 ? 0x2f : 0x2e));
+    else {
+        static_assert(sizeof (double) == 8, "sizeof (double) should be 8");
+        uint64_t bits;
+        std::memcpy(&bits, &number, 8);
+        const char buffer[9] = {
+            char(0x2c),
+            char(uint8_t(bits >> 56)), char(uint8_t(bits >> 48)), char(uint8_t(bits >> 40)), char(uint8_t(bits >> 32)),
+            char(uint8_t(bits >> 24)), char(uint8_t(bits >> 16)), char(uint8_t(bits >> 8)), char(uint8_t(bits))
+        };
+        result.append(buffer, 9);
+    }
 }
 
-JKSNDecoder &JKSNDecoder::operator=(const JKSNDecoder &that) {
-    if(this != &that)
-        *this->p = *that.p;
-    return *this;
+void JKSNEncoderPrivate::writeLongDouble(long double number, std::string &result) {
+    if(std::isnan(number))
+        result.push_back(char(0x20));
+    else if(std::isinf(number))
+        result.push_back(char(number >= 0 ? 0x2f : 0x2e));
+    else if(sizeof (long double) == 12 || sizeof (long double) == 16) {
+        char conv[sizeof (long double)];
+        std::memcpy(conv, &number, sizeof (long double));
+        result.push_back(char(0x2b));
+        if(isLittleEndian())
+            for(size_t i = 10; i--; )
+                result.push_back(conv[i]);
+        else
+            result.append(conv + sizeof (long double) - 10, 10);
+    } else
+        throw JKSNEncodeError("this build of JKSN decoder does not support long double numbers");
 }
 
-JKSNDecoder &JKSNDecoder::operator=(JKSNDecoder &&that) {
-    if(this != &that)
-        this->p = std::move(that.p);
-    return *this;
+void JKSNEncoderPrivate::writeString(const JKSNStringView &obj, std::string &result) {
+    if(obj.size() > 1) {
+        if(this->string_counts)
+            ++(*this->string_counts)[obj];
+        else if(this->pinned.any())
+            return this->writePinnedString(obj, result);
+    }
+    size_t utf16_length;
+    if(UTF16IsShorter(obj, utf16_length)) {
+        /* Transcode straight into the output, then back out on a cache hit */
+        size_t start = result.size();
+        writeLength(0x30, utf16_length, 0xb, result);
+        size_t offset = result.size();
+        result.resize(offset + utf16_length*2);
+        UTF8WriteUTF16LE(obj, &result[offset]);
+        if(utf16_length*2 > 1) {
+            uint8_t hash = DJBHash(result.data() + offset, utf16_length*2);
+            if(this->cache.texthash[hash] && JKSNStringView(*this->cache.texthash[hash]) == JKSNStringView(result.data() + offset, utf16_length*2)) {
+                result.resize(start);
+                result.push_back(char(0x3c));
+                result.push_back(char(hash));
+            } else if(this->writeReference(obj, result.size() - start, result)) {
+                /* The reference went after the literal */
+                result.erase(start, offset + utf16_length*2 - start);
+            } else {
+                storeHash(this->cache.texthash[hash], result.data() + offset, utf16_length*2);
+                this->addToDictionary(obj);
+            }
+        }
+        return;
+    }
+    if(obj.size() > 1) {
+        uint8_t hash = DJBHash(obj.data(), obj.size());
+        if(this->cache.texthash[hash] && JKSNStringView(*this->cache.texthash[hash]) == obj) {
+            result.push_back(char(0x3c));
+            result.push_back(char(hash));
+            return;
+        } else if(this->writeReference(obj, 1 + measureLength(obj.size(), 0xc) + obj.size(), result))
+            return;
+        storeHash(this->cache.texthash[hash], obj.data(), obj.size());
+        this->addToDictionary(obj);
+    }
+    writeLength(0x40, obj.size(), 0xc, result);
+    result.append(obj.data(), obj.size());
 }
 
-JKSNDecoder::~JKSNDecoder() {
+void JKSNEncoderPrivate::writePinnedString(const JKSNStringView &obj, std::string &result) {
+    size_t utf16_length;
+    bool utf16 = UTF16IsShorter(obj, utf16_length);
+    std::string utf16str;
+    if(utf16)
+        utf16str = UTF8ToUTF16LE(obj);
+    JKSNStringView native = utf16 ? JKSNStringView(utf16str) : obj;
+    uint8_t hash = DJBHash(native.data(), native.size());
+    if(this->cache.texthash[hash] && JKSNStringView(*this->cache.texthash[hash]) == native) {
+        result.push_back(char(0x3c));
+        result.push_back(char(hash));
+        return;
+    }
+    /* Misses are rare, so only then is the other encoding tried */
+    bool valid = true;
+    if(!utf16) {
+        UTF8CountUTF16(obj, size_t(-1), true, valid);
+        if(valid)
+            utf16str = UTF8ToUTF16LE(obj);
+    }
+    if(valid) {
+        JKSNStringView other = utf16 ? obj : JKSNStringView(utf16str);
+        uint8_t other_hash = DJBHash(other.data(), other.size());
+        if(this->cache.texthash[other_hash] && JKSNStringView(*this->cache.texthash[other_hash]) == other) {
+            result.push_back(char(0x3c));
+            result.push_back(char(other_hash));
+            return;
+        } else if(this->pinned[hash] && !this->pinned[other_hash]) {
+            if(!this->writeReference(obj, 1 + (utf16 ? measureLength(other.size(), 0xc) : measureLength(other.size()/2, 0xb)) + other.size(), result))
+                this->writeText(obj, other, !utf16, result);
+            return;
+        }
+    }
+    if(!this->writeReference(obj, 1 + (utf16 ? measureLength(native.size()/2, 0xb) : measureLength(native.size(), 0xc)) + native.size(), result))
+        this->writeText(obj, native, utf16, result);
 }
 
-JKSNValue JKSNDecoder::parse(std::istream &fp, bool header) {
-    if(header) {
-        char header_buf[3];
-        if(!fp.read(header_buf, 3) || fp.gcount() != 3 || std::memcmp(header_buf, "jk!", 3))
-            fp.seekg(-fp.gcount(), fp.cur);
+void JKSNEncoderPrivate::writeText(const JKSNStringView &obj, const JKSNStringView &bytes, bool utf16, std::string &result) {
+    storeHash(this->cache.texthash[DJBHash(bytes.data(), bytes.size())], bytes.data(), bytes.size());
+    this->addToDictionary(obj);
+    if(utf16)
+        writeLength(0x30, bytes.size()/2, 0xb, result);
+    else
+        writeLength(0x40, bytes.size(), 0xc, result);
+    result.append(bytes.data(), bytes.size());
+}
+
+bool JKSNEncoderPrivate::writeReference(const JKSNStringView &obj, size_t literal_size, std::string &result) {
+    if(!(this->cache.extensions & JKSN_EXTENSION_DICTIONARY))
+        return false;
+    size_t index = this->cache.dictionary.find(obj);
+    if(index == size_t(-1) || (index <= 0xff ? 2 : 3) >= literal_size)
+        return false;
+    this->cache.dictionary.lookup(index);
+    if(index <= 0xff) {
+        result.push_back(char(0xe0));
+        result.push_back(char(index));
+    } else {
+        result.push_back(char(0xe1));
+        appendInt(index, 2, result);
     }
-    return this->p->parseValue(fp);
+    return true;
 }
 
-JKSNValue JKSNDecoder::parse(const std::string &str, bool header) {
-    std::istringstream stream(str);
-    return this->parse(stream, header);
+void JKSNEncoderPrivate::addToDictionary(const JKSNStringView &obj) {
+    if(this->cache.extensions & JKSN_EXTENSION_DICTIONARY)
+        this->cache.dictionary.insert(std::make_shared<std::string>(obj));
 }
 
-JKSNValue JKSNDecoderPrivate::parseValue(std::istream &fp) {
-    for(;;) {
-        char signed_control;
-        if(!fp.get(signed_control))
-            throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-        uint8_t control = uint8_t(signed_control);
-        uint8_t ctrlhi = control & 0xf0;
-        switch(ctrlhi) {
-        /* Special values */
-        case 0x00:
-            switch(control) {
-            case 0x00:
-                return JKSNValue();
-            case 0x01:
-                return JKSNValue(nullptr);
-            case 0x02:
-                return JKSNValue(false);
-            case 0x03:
-                return JKSNValue(true);
-            case 0x0f:
-                throw JKSNDecodeError("this JKSN decoder does not support JSON literals");
-            }
-            break;
-        /* Integers */
-        case 0x10:
-            this->cache.haslastint = true;
-            switch(control) {
+void JKSNEncoderPrivate::writeBlob(const JKSNStringView &obj, std::string &result) {
+    if(obj.size() > 1) {
+        uint8_t hash = DJBHash(obj.data(), obj.size());
+        if(this->cache.blobhash[hash] && JKSNStringView(*this->cache.blobhash[hash]) == obj) {
+            result.push_back(char(0x5c));
+            result.push_back(char(hash));
+            return;
+        } else
+            storeHash(this->cache.blobhash[hash], obj.data(), obj.size());
+    }
+    writeLength(0x50, obj.size(), 0xb, result);
+    result.append(obj.data(), obj.size());
+}
+
+void JKSNEncoderPrivate::writeArray(const std::vector<const JKSNValue *> &obj, std::string &result) {
+    bool swapped = false;
+    if(testSwapAvailability(obj))
+        measureArray(obj, 3, &swapped);
+    if(swapped)
+        this->writeSwappedArray(obj, result);
+    else
+        this->writeStraightArray(obj, result);
+}
+
+void JKSNEncoderPrivate::writeStraightArray(const std::vector<const JKSNValue *> &obj, std::string &result) {
+    if((this->cache.extensions & (JKSN_EXTENSION_FLOAT_ARRAY | JKSN_EXTENSION_TYPED_ARRAY | JKSN_EXTENSION_BIT_PACKED)) && this->writeNumbers(obj, result))
+        return;
+    if((this->cache.extensions & JKSN_EXTENSION_BOOL_ARRAY) && this->writeBools(obj, result))
+        return;
+    writeLength(0x80, obj.size(), 0xc, result);
+    for(const JKSNValue *const i : obj)
+        this->writeValue(*i, result);
+}
+
+bool JKSNEncoderPrivate::writeNumbers(const std::vector<const JKSNValue *> &obj, std::string &result) {
+    if(obj.size() < 2)
+        return false;
+    jksn_data_type type = obj[0]->getType();
+    for(const JKSNValue *const i : obj)
+        if(i->getType() != type)
+            return false;
+    switch(type) {
+    case JKSN_INT:
+        {
+            std::vector<int64_t> numbers;
+            numbers.reserve(obj.size());
+            for(const JKSNValue *const i : obj)
+                numbers.push_back(i->toInt());
+            this->writeNumbers(numbers.data(), numbers.size(), result);
+        }
+        return true;
+    case JKSN_FLOAT:
+        {
+            std::vector<float> numbers;
+            numbers.reserve(obj.size());
+            for(const JKSNValue *const i : obj)
+                numbers.push_back(i->toFloat());
+            this->writeNumbers(numbers.data(), numbers.size(), result);
+        }
+        return true;
+    case JKSN_DOUBLE:
+        {
+            std::vector<double> numbers;
+            numbers.reserve(obj.size());
+            for(const JKSNValue *const i : obj)
+                numbers.push_back(i->toDouble());
+            this->writeNumbers(numbers.data(), numbers.size(), result);
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+template<typename Integer>
+void JKSNEncoderPrivate::writeNumbers(const Integer *data, size_t size, std::string &result) {
+    /* Integers written straight may be deltas, so they are measured against the one before */
+    size_t straight = 1 + measureLength(size, 0xc);
+    bool haslastint = this->cache.haslastint;
+    intmax_t lastint = this->cache.lastint;
+    for(size_t i = 0; i < size; ++i) {
+        size_t delta = haslastint ? measureDelta(intmax_t(uintmax_t(data[i]) - uintmax_t(lastint))) : size_t(-1);
+        straight += std::min(measureInt(intmax_t(data[i])), delta);
+        haslastint = true;
+        lastint = intmax_t(data[i]);
+    }
+    /* Whichever extension packs it shorter */
+    std::string packed, bit_packed;
+    uint8_t control = 0xe3;
+    if(size >= 2 && (this->cache.extensions & JKSN_EXTENSION_TYPED_ARRAY))
+        packTypedIntegers(data, size, packed);
+    if(size >= 2 && (this->cache.extensions & JKSN_EXTENSION_BIT_PACKED)) {
+        packBitPacked(data, size, bit_packed);
+        if(packed.empty() || bit_packed.size() < packed.size()) {
+            packed.swap(bit_packed);
+            control = 0xe4;
+        }
+    }
+    if(this->writePacked(control, size, packed, straight, result))
+        return;
+    writeLength(0x80, size, 0xc, result);
+    for(size_t i = 0; i < size; ++i)
+        this->writeInt(intmax_t(data[i]), result);
+}
+
+void JKSNEncoderPrivate::writeNumbers(const float *data, size_t size, std::string &result) {
+    size_t straight = 1 + measureLength(size, 0xc);
+    for(size_t i = 0; i < size; ++i)
+        straight += std::isnan(data[i]) || std::isinf(data[i]) ? 1u : 5u;
+    std::string packed;
+    if(size >= 2 && (this->cache.extensions & JKSN_EXTENSION_TYPED_ARRAY))
+        packTyped(data, size, 4, packed);
+    if(this->writePacked(0xe3, size, packed, straight, result))
+        return;
+    writeLength(0x80, size, 0xc, result);
+    for(size_t i = 0; i < size; ++i)
+        writeFloat(data[i], result);
+}
+
+void JKSNEncoderPrivate::writeNumbers(const double *data, size_t size, std::string &result) {
+    size_t straight = 1 + measureLength(size, 0xc);
+    for(size_t i = 0; i < size; ++i)
+        straight += std::isnan(data[i]) || std::isinf(data[i]) ? 1u : 9u;
+    /* Whichever extension packs it shorter */
+    std::string packed, typed;
+    uint8_t control = 0xe2;
+    if(size >= 2 && (this->cache.extensions & JKSN_EXTENSION_FLOAT_ARRAY))
+        packXorDoubles(data, size, packed);
+    if(size >= 2 && (this->cache.extensions & JKSN_EXTENSION_TYPED_ARRAY)) {
+        packTyped(data, size, 5, typed);
+        if(packed.empty() || typed.size() < packed.size()) {
+            packed.swap(typed);
+            control = 0xe3;
+        }
+    }
+    if(this->writePacked(control, size, packed, straight, result))
+        return;
+    writeLength(0x80, size, 0xc, result);
+    for(size_t i = 0; i < size; ++i)
+        writeDouble(data[i], result);
+}
+
+bool JKSNEncoderPrivate::writeBools(const std::vector<const JKSNValue *> &obj, std::string &result) {
+    if(obj.size() < 2)
+        return false;
+    std::vector<bool> data(obj.size()), present(obj.size());
+    bool has_bool = false, has_unspecified = false;
+    for(size_t i = 0; i < obj.size(); ++i)
+        switch(obj[i]->getType()) {
+        case JKSN_BOOL:
+            data[i] = obj[i]->toBool();
+            present[i] = true;
+            has_bool = true;
+            break;
+        case JKSN_UNSPECIFIED:
+            has_unspecified = true;
+            break;
+        default:
+            return false;
+        }
+    if(!has_bool)
+        return false;
+    this->writeBools(data, has_unspecified ? &present : nullptr, result);
+    return true;
+}
+
+void JKSNEncoderPrivate::writeBools(const std::vector<bool> &data, const std::vector<bool> *present, std::string &result) {
+    /* A byte telling whether the bitmap of which items are there comes
+       before the items themselves */
+    size_t size = data.size();
+    std::string packed;
+    if(size >= 2 && (this->cache.extensions & JKSN_EXTENSION_BOOL_ARRAY)) {
+        packed.push_back(char(present ? 1 : 0));
+        if(present)
+            packBits(*present, packed);
+        packBits(data, packed);
+    }
+    if(this->writePacked(0xe5, size, packed, 1 + measureLength(size, 0xc) + size, result))
+        return;
+    writeLength(0x80, size, 0xc, result);
+    for(size_t i = 0; i < size; ++i)
+        result.push_back(char(present && !(*present)[i] ? 0xa0 : data[i] ? 0x03 : 0x02));
+}
+
+void JKSNEncoderPrivate::packBits(const std::vector<bool> &data, std::string &result) {
+    size_t start = result.size();
+    result.resize(start + (data.size() + 7)/8);
+    for(size_t i = 0; i < data.size(); ++i)
+        if(data[i])
+            result[start + i/8] = char(uint8_t(result[start + i/8]) | (0x80u >> (i % 8)));
+}
+
+bool JKSNEncoderPrivate::writePacked(uint8_t control, size_t count, const std::string &packed, size_t straight, std::string &result) {
+    if(packed.empty() || 1 + measureVarInt(count) + measureVarInt(packed.size()) + packed.size() >= straight)
+        return false;
+    result.push_back(char(control));
+    appendInt(count, 0, result);
+    appendInt(packed.size(), 0, result);
+    result.append(packed);
+    return true;
+}
+
+void JKSNEncoderPrivate::packXorDoubles(const double *data, size_t size, std::string &result) {
+    /* Each value after the first is XORed with the one before. 0 means
+       they are the same, 10 is followed by the bits between the leading and
+       trailing zeros of the last 11, and 11 by a new count of leading zeros
+       in 5 bits, the number of bits in between less one in 6, then them. */
+    JKSNBitWriter writer(result);
+    uint64_t previous = 0;
+    unsigned leading = 64, trailing = 64;
+    for(size_t i = 0; i < size; ++i) {
+        uint64_t bits;
+        std::memcpy(&bits, &data[i], 8);
+        uint64_t delta = bits ^ previous;
+        previous = bits;
+        if(i == 0)
+            writer.write(bits, 64);
+        else if(delta == 0)
+            writer.write(0, 1);
+        else {
+            unsigned delta_leading = std::min(countLeadingZeros(delta), 31u);
+            unsigned delta_trailing = countTrailingZeros(delta);
+            if(delta_leading >= leading && delta_trailing >= trailing)
+                writer.write(0x2, 2);
+            else {
+                leading = delta_leading;
+                trailing = delta_trailing;
+                writer.write(0x3, 2);
+                writer.write(leading, 5);
+                writer.write(63 - leading - trailing, 6);
+            }
+            writer.write(delta >> trailing, 64 - leading - trailing);
+        }
+    }
+    writer.flush();
+}
+
+template<typename Integer>
+void JKSNEncoderPrivate::packTypedIntegers(const Integer *data, size_t size, std::string &result) {
+    /* The narrowest type that holds every one of them */
+    int64_t min = 0, max = 0;
+    for(size_t i = 0; i < size; ++i) {
+        min = std::min(min, int64_t(data[i]));
+        max = std::max(max, int64_t(data[i]));
+    }
+    if(min >= INT8_MIN && max <= INT8_MAX)
+        packTyped(data, size, 0, result);
+    else if(min >= INT16_MIN && max <= INT16_MAX)
+        packTyped(data, size, 1, result);
+    else if(min >= INT32_MIN && max <= INT32_MAX)
+        packTyped(data, size, 2, result);
+    else
+        packTyped(data, size, 3, result);
+}
+
+template<typename Integer>
+void JKSNEncoderPrivate::packBitPacked(const Integer *data, size_t size, std::string &result) {
+    /* Each block of 128 starts with a byte of how many bits each item
+       takes, the top bit set if they are deltas. Then comes the smallest
+       item, or the first item and the smallest delta, as zigzag variable
+       length integers, then what the items are above that, padded to a
+       whole byte. */
+    static const size_t block_size = 128;
+    for(size_t start = 0; start < size; start += block_size) {
+        const Integer *block = data + start;
+        size_t count = std::min(size - start, block_size);
+        int64_t min = int64_t(block[0]), max = int64_t(block[0]);
+        for(size_t i = 0; i < count; ++i) {
+            min = std::min(min, int64_t(block[i]));
+            max = std::max(max, int64_t(block[i]));
+        }
+        unsigned bits = bitWidth(uint64_t(max) - uint64_t(min));
+        size_t block_packed = measureVarInt(zigzagEncode(min)) + (count*bits + 7)/8;
+        /* Deltas are only tried where they cannot overflow */
+        int64_t min_delta = 0, max_delta = 0;
+        size_t delta_packed = size_t(-1);
+        if(count >= 2 && min >= -(int64_t(1) << 62) && max < (int64_t(1) << 62)) {
+            min_delta = max_delta = int64_t(block[1]) - int64_t(block[0]);
+            for(size_t i = 2; i < count; ++i) {
+                min_delta = std::min(min_delta, int64_t(block[i]) - int64_t(block[i-1]));
+                max_delta = std::max(max_delta, int64_t(block[i]) - int64_t(block[i-1]));
+            }
+            delta_packed = measureVarInt(zigzagEncode(int64_t(block[0]))) + measureVarInt(zigzagEncode(min_delta)) +
+                ((count-1)*bitWidth(uint64_t(max_delta) - uint64_t(min_delta)) + 7)/8;
+        }
+        JKSNBitWriter writer(result);
+        if(delta_packed < block_packed) {
+            unsigned delta_bits = bitWidth(uint64_t(max_delta) - uint64_t(min_delta));
+            result.push_back(char(0x80 | delta_bits));
+            appendInt(zigzagEncode(int64_t(block[0])), 0, result);
+            appendInt(zigzagEncode(min_delta), 0, result);
+            for(size_t i = 1; i < count; ++i)
+                writer.write(uint64_t(int64_t(block[i]) - int64_t(block[i-1])) - uint64_t(min_delta), delta_bits);
+        } else {
+            result.push_back(char(bits));
+            appendInt(zigzagEncode(min), 0, result);
+            for(size_t i = 0; i < count; ++i)
+                writer.write(uint64_t(int64_t(block[i])) - uint64_t(min), bits);
+        }
+        writer.flush();
+    }
+}
+
+template<typename Number>
+void JKSNEncoderPrivate::packTyped(const Number *data, size_t size, uint8_t type, std::string &result) {
+    static const size_t widths[6] = {1, 2, 4, 8, 4, 8};
+    size_t width = widths[type];
+    result.resize(1 + size*width);
+    result[0] = char(type);
+    char *output = &result[1];
+    switch(type) {
+    case 0:
+        for(size_t i = 0; i < size; ++i)
+            output[i] = char(int8_t(data[i]));
+        break;
+    case 1:
+        storeBigEndian<uint16_t>(data, size, output);
+        break;
+    case 2:
+        storeBigEndian<uint32_t>(data, size, output);
+        break;
+    case 3:
+        storeBigEndian<uint64_t>(data, size, output);
+        break;
+    case 4:
+        storeBigEndian<uint32_t>(data, size, output);
+        break;
+    default:
+        storeBigEndian<uint64_t>(data, size, output);
+    }
+}
+
+void JKSNEncoderPrivate::writeSwappedArray(const std::vector<const JKSNValue *> &obj, std::string &result) {
+    std::vector<const JKSNValue *> columns;
+    listColumns(obj, columns);
+    writeLength(0xa0, columns.size(), 0xc, result);
+    std::vector<const JKSNValue *> columns_value;
+    for(const JKSNValue *const column : columns) {
+        this->writeValue(*column, result);
+        listColumnValues(obj, *column, columns_value);
+        JKSNKeyContext context(this->cache, *column);
+        this->writeArray(columns_value, result);
+    }
+}
+
+void JKSNEncoderPrivate::writeObject(const JKSNValue &obj, std::string &result) {
+    if((this->cache.extensions & JKSN_EXTENSION_SHAPES) && this->writeShapedObject(obj, result))
+        return;
+    writeLength(0x90, obj.toObject().size(), 0xc, result);
+    for(const JKSNObject::value_type &item : obj.toObject()) {
+        this->writeValue(item.first, result);
+        JKSNKeyContext context(this->cache, item.first);
+        this->writeValue(item.second, result);
+    }
+}
+
+bool JKSNEncoderPrivate::writeShapedObject(const JKSNValue &obj, std::string &result) {
+    const JKSNObject &object = obj.toObject();
+    if(object.empty())
+        return false;
+    /* Keys in insertion order, which the decoder rebuilds from the shape,
+       so listing the same keys in another order makes another shape */
+    std::string signature;
+    for(const JKSNObject::value_type &item : object) {
+        if(item.first.getType() != JKSN_STRING)
+            return false;
+        appendInt(item.first.toStringView().size(), 0, signature);
+        signature.append(item.first.toStringView().data(), item.first.toStringView().size());
+    }
+    size_t shape = this->cache.shapes.find(signature);
+    if(shape != size_t(-1)) {
+        result.push_back(char(0xe7));
+        appendInt(shape, 0, result);
+    } else if(this->cache.shapes.insert(signature)) {
+        result.push_back(char(0xe6));
+        appendInt(object.size(), 0, result);
+        for(const JKSNObject::value_type &item : object)
+            this->writeValue(item.first, result);
+    } else
+        return false;
+    for(const JKSNObject::value_type &item : object) {
+        JKSNKeyContext context(this->cache, item.first.toStringView());
+        this->writeValue(item.second, result);
+    }
+    return true;
+}
+
+void JKSNEncoderPrivate::writeLength(uint8_t control, uintmax_t length, uintmax_t max_inline, std::string &result) {
+    if(length <= max_inline)
+        result.push_back(char(control | uint8_t(length)));
+    else if(length <= 0xff) {
+        result.push_back(char(control | 0xe));
+        appendInt(length, 1, result);
+    } else if(length <= 0xffff) {
+        result.push_back(char(control | 0xd));
+        appendInt(length, 2, result);
+    } else {
+        result.push_back(char(control | 0xf));
+        appendInt(length, 0, result);
+    }
+}
+
+void JKSNEncoderPrivate::appendInt(uintmax_t number, size_t size, std::string &result) {
+    switch(size) {
+    case 1:
+        result.push_back(char(uint8_t(number)));
+        break;
+    case 2:
+        {
+            const char buffer[2] = {
+                char(uint8_t(number >> 8)),
+                char(uint8_t(number))
+            };
+            result.append(buffer, 2);
+        }
+        break;
+    case 4:
+        {
+            const char buffer[4] = {
+                char(uint8_t(number >> 24)),
+                char(uint8_t(number >> 16)),
+                char(uint8_t(number >> 8)),
+                char(uint8_t(number))
+            };
+            result.append(buffer, 4);
+        }
+        break;
+    case 0:
+        {
+            char buffer[(sizeof (uintmax_t)*8+6)/7];
+            size_t i = sizeof buffer;
+            buffer[--i] = char(number & 0x7f);
+            number >>= 7;
+            while(number != 0) {
+                buffer[--i] = char((number & 0x7f) | 0x80);
+                number >>= 7;
+            }
+            result.append(buffer + i, sizeof buffer - i);
+        }
+        break;
+    default:
+        assert(size == 1 || size == 2 || size == 4 || size == 0);
+        abort();
+    }
+}
+
+namespace {
+
+struct JKSNValuePointerHash {
+    size_t operator()(const JKSNValue *value) const {
+        return std::hash<JKSNValue>()(*value);
+    }
+};
+
+struct JKSNValuePointerEqual {
+    bool operator()(const JKSNValue *a, const JKSNValue *b) const {
+        return *a == *b;
+    }
+};
+
+}
+
+size_t JKSNEncoderPrivate::measureValue(const JKSNValue &obj, size_t depth) {
+    switch(obj.getType()) {
+    case JKSN_INT:
+        return measureInt(obj.toInt());
+    case JKSN_FLOAT:
+        return std::isnan(obj.toFloat()) || std::isinf(obj.toFloat()) ? 1 : 5;
+    case JKSN_DOUBLE:
+        return std::isnan(obj.toDouble()) || std::isinf(obj.toDouble()) ? 1 : 9;
+    case JKSN_LONG_DOUBLE:
+        return std::isnan(obj.toLongDouble()) || std::isinf(obj.toLongDouble()) ? 1 : 11;
+    case JKSN_STRING:
+        {
+            JKSNStringView obj_utf8 = obj.toStringView();
+            size_t utf16_length;
+            if(UTF16IsShorter(obj_utf8, utf16_length))
+                return 1 + measureLength(utf16_length, 0xb) + utf16_length*2;
+            return 1 + measureLength(obj_utf8.size(), 0xc) + obj_utf8.size();
+        }
+    case JKSN_BLOB:
+        {
+            size_t length = obj.toStringView().size();
+            return 1 + measureLength(length, 0xb) + length;
+        }
+    case JKSN_ARRAY:
+        {
+            std::vector<const JKSNValue *> obj_vector;
+            obj_vector.reserve(obj.toVector().size());
+            for(const JKSNValue &i : obj.toVector())
+                obj_vector.push_back(&i);
+            return measureArray(obj_vector, depth);
+        }
+    case JKSN_OBJECT:
+        {
+            size_t result = 1 + measureLength(obj.toObject().size(), 0xc);
+            if(depth != 1)
+                for(const JKSNObject::value_type &item : obj.toObject())
+                    result += measureValue(item.first, depth == 0 ? 0 : depth-1) +
+                              measureValue(item.second, depth == 0 ? 0 : depth-1);
+            return result;
+        }
+    default:
+        return 1;
+    }
+}
+
+size_t JKSNEncoderPrivate::measureArray(const std::vector<const JKSNValue *> &obj, size_t depth, bool *swapped) {
+    if(!testSwapAvailability(obj)) {
+        if(swapped)
+            *swapped = false;
+        return measureStraightArray(obj, depth);
+    }
+    size_t result, result_swapped;
+    if(obj.size() > max_measured_rows)
+        estimateArray(obj, result, result_swapped);
+    else {
+        result = measureStraightArray(obj, 3);
+        result_swapped = measureSwappedArray(obj, 3);
+    }
+    bool is_swapped = result_swapped < result;
+    if(is_swapped)
+        result = result_swapped;
+    if(swapped)
+        *swapped = is_swapped;
+    if(depth == 3)
+        return result;
+    else if(is_swapped)
+        return measureSwappedArray(obj, depth);
+    else
+        return measureStraightArray(obj, depth);
+}
+
+size_t JKSNEncoderPrivate::measureStraightArray(const std::vector<const JKSNValue *> &obj, size_t depth) {
+    size_t result = 1 + measureLength(obj.size(), 0xc);
+    if(depth != 1)
+        for(const JKSNValue *const i : obj)
+            result += measureValue(*i, depth == 0 ? 0 : depth-1);
+    return result;
+}
+
+size_t JKSNEncoderPrivate::measureSwappedArray(const std::vector<const JKSNValue *> &obj, size_t depth) {
+    std::vector<const JKSNValue *> columns;
+    listColumns(obj, columns);
+    size_t result = 1 + measureLength(columns.size(), 0xc);
+    if(depth != 1) {
+        std::vector<const JKSNValue *> columns_value;
+        for(const JKSNValue *const column : columns) {
+            listColumnValues(obj, *column, columns_value);
+            result += measureValue(*column, depth == 0 ? 0 : depth-1) +
+                      measureArray(columns_value, depth == 0 ? 0 : depth-1);
+        }
+    }
+    return result;
+}
+
+void JKSNEncoderPrivate::estimateArray(const std::vector<const JKSNValue *> &obj, size_t &straight, size_t &swapped) {
+    /* Like measureArray, this looks at the array, its rows and their members.
+       Row headers, keys and missing cells are counted exactly, while member
+       values are measured on about one in stride rows and on the first
+       occurrence of each column, then scaled up to the whole column. Rows are
+       picked by a multiplicative hash of their index, which keeps the output
+       deterministic without following periodic patterns in the data. */
+    struct ColumnStats {
+        const JKSNValue *name;
+        size_t count;
+        size_t sampled;
+        size_t sampled_size;
+    };
+    static const size_t max_linear_search = 16;
+    std::vector<ColumnStats> columns;
+    std::unordered_map<const JKSNValue *, size_t, JKSNValuePointerHash, JKSNValuePointerEqual> columns_index;
+    size_t stride = (obj.size() + max_measured_rows - 1) / max_measured_rows;
+    straight = 1 + measureLength(obj.size(), 0xc);
+    for(size_t i = 0; i < obj.size(); ++i) {
+        const JKSNObject &row = obj[i]->toObject();
+        straight += 1 + measureLength(row.size(), 0xc);
+        for(const JKSNObject::value_type &item : row) {
+            size_t column = columns.size();
+            if(columns.size() <= max_linear_search) {
+                for(size_t j = 0; j < columns.size(); ++j)
+                    if(*columns[j].name == item.first) {
+                        column = j;
+                        break;
+                    }
+            } else {
+                if(columns_index.empty())
+                    for(size_t j = 0; j < columns.size(); ++j)
+                        columns_index[columns[j].name] = j;
+                column = columns_index.insert(std::make_pair(&item.first, columns.size())).first->second;
+            }
+            if(column == columns.size())
+                columns.push_back(ColumnStats{&item.first, 0, 0, 0});
+            ColumnStats &stats = columns[column];
+            if(stats.sampled == 0 || (uint64_t(i) * 0x9e3779b97f4a7c15 >> 40) % stride == 0) {
+                stats.sampled_size += measureSelf(item.second);
+                ++stats.sampled;
+            }
+            ++stats.count;
+        }
+    }
+    swapped = 1 + measureLength(columns.size(), 0xc);
+    for(const ColumnStats &stats : columns) {
+        size_t name_size = measureValue(*stats.name, 1);
+        size_t values_size = (stats.sampled_size * stats.count + stats.sampled/2) / stats.sampled;
+        straight += stats.count * name_size + values_size;
+        swapped += name_size + 1 + measureLength(obj.size(), 0xc) + values_size + (obj.size() - stats.count);
+    }
+}
+
+void JKSNEncoderPrivate::testEstimate(const JKSNValue &obj, bool estimate, size_t &straight, size_t &swapped) {
+    std::vector<const JKSNValue *> obj_vector;
+    obj_vector.reserve(obj.toVector().size());
+    for(const JKSNValue &i : obj.toVector())
+        obj_vector.push_back(&i);
+    if(!testSwapAvailability(obj_vector))
+        throw JKSNTypeError();
+    if(estimate)
+        estimateArray(obj_vector, straight, swapped);
+    else {
+        straight = measureStraightArray(obj_vector, 3);
+        swapped = measureSwappedArray(obj_vector, 3);
+    }
+}
+
+size_t JKSNEncoderPrivate::measureSelf(const JKSNValue &obj) {
+    /* Nested arrays are assumed to stay straight, rather than measured for a swap */
+    if(obj.isArray())
+        return 1 + measureLength(obj.toVector().size(), 0xc);
+    else
+        return measureValue(obj, 1);
+}
+
+size_t JKSNEncoderPrivate::measureInt(intmax_t number) {
+    if(number >= 0 && number <= 0xa)
+        return 1;
+    else if(number >= -0x80 && number <= 0x7f)
+        return 2;
+    else if(number >= -0x8000 && number <= 0x7fff)
+        return 3;
+    else if((number >= -0x80000000LL && number <= -0x200000) ||
+            (number >= 0x200000 && number <= 0x7fffffff))
+        return 5;
+    else if(number >= 0)
+        return 1 + measureVarInt(uintmax_t(number));
+    else
+        return 1 + measureVarInt(0 - uintmax_t(number));
+}
+
+size_t JKSNEncoderPrivate::measureDelta(intmax_t delta) {
+    /* As writeInt() writes it */
+    if(delta >= -0x5 && delta <= 0x5)
+        return 1;
+    else if(delta >= -0x80 && delta <= 0x7f)
+        return 2;
+    else if(delta >= -0x8000 && delta <= 0x7fff)
+        return 3;
+    else if((delta >= -0x80000000LL && delta <= -0x200000) ||
+            (delta >= 0x200000 && delta <= 0x7fffffff))
+        return 5;
+    else
+        return 1 + measureVarInt(delta >= 0 ? uintmax_t(delta) : 0 - uintmax_t(delta));
+}
+
+size_t JKSNEncoderPrivate::measureLength(uintmax_t length, uintmax_t max_inline) {
+    if(length <= max_inline)
+        return 0;
+    else if(length <= 0xff)
+        return 1;
+    else if(length <= 0xffff)
+        return 2;
+    else
+        return measureVarInt(length);
+}
+
+size_t JKSNEncoderPrivate::measureVarInt(uintmax_t number) {
+    size_t result = 1;
+    while(number >>= 7)
+        ++result;
+    return result;
+}
+
+void JKSNEncoderPrivate::listColumns(const std::vector<const JKSNValue *> &obj, std::vector<const JKSNValue *> &columns) {
+    /* Rows usually have a few columns, where a linear search beats hashing */
+    static const size_t max_linear_search = 16;
+    std::unordered_set<const JKSNValue *, JKSNValuePointerHash, JKSNValuePointerEqual> columns_set;
+    columns.clear();
+    for(const JKSNValue *const row : obj)
+        for(const JKSNObject::value_type &column : row->toObject())
+            if(columns.size() < max_linear_search) {
+                bool found = false;
+                for(const JKSNValue *const i : columns)
+                    if(*i == column.first) {
+                        found = true;
+                        break;
+                    }
+                if(!found)
+                    columns.push_back(&column.first);
+            } else {
+                if(columns_set.empty())
+                    columns_set.insert(columns.cbegin(), columns.cend());
+                if(columns_set.insert(&column.first).second)
+                    columns.push_back(&column.first);
+            }
+}
+
+void JKSNEncoderPrivate::listColumnValues(const std::vector<const JKSNValue *> &obj, const JKSNValue &column, std::vector<const JKSNValue *> &columns_value) {
+    static const JKSNValue unspecified_value = JKSNValue::fromUnspecified();
+    columns_value.clear();
+    columns_value.reserve(obj.size());
+    for(const JKSNValue *const row : obj) {
+        JKSNObject::const_iterator it = row->toObject().find(column);
+        columns_value.push_back(it != row->toObject().end() ? &it->second : &unspecified_value);
+    }
+}
+
+JKSNDecoder::JKSNDecoder() :
+    p(new JKSNDecoderPrivate) {
+}
+
+JKSNDecoder::JKSNDecoder(const JKSNDecoder &that) :
+    p(new JKSNDecoderPrivate(*that.p)) {
+}
+
+JKSNDecoder::JKSNDecoder(JKSNDecoder &&that) :
+    p(std::move(that.p)) {
+}
+
+JKSNDecoder &JKSNDecoder::operator=(const JKSNDecoder &that) {
+    if(this != &that)
+        *this->p = *that.p;
+    return *this;
+}
+
+JKSNDecoder &JKSNDecoder::operator=(JKSNDecoder &&that) {
+    if(this != &that)
+        this->p = std::move(that.p);
+    return *this;
+}
+
+JKSNDecoder::~JKSNDecoder() {
+}
+
+JKSNValue JKSNDecoder::parse(std::istream &fp, bool header) {
+    if(header) {
+        char header_buf[3];
+        if(!fp.read(header_buf, 3) || fp.gcount() != 3 || std::memcmp(header_buf, "jk!", 3)) {
+            std::streamsize header_size = fp.gcount();
+            fp.clear();
+            fp.seekg(-header_size, fp.cur);
+        }
+    }
+    JKSNStreamInput input(fp);
+    return this->p->parseValue(input);
+}
+
+JKSNValue JKSNDecoder::parse(const std::string &str, bool header) {
+    return this->parse(str.data(), str.size(), header);
+}
+
+JKSNValue JKSNDecoder::parse(const char *buffer, size_t size, bool header) {
+    size_t bytes_parsed;
+    return this->parse(buffer, size, bytes_parsed, header);
+}
+
+JKSNView JKSNDecoder::parse(const char *buffer, size_t size, JKSNDocument &document, bool header) {
+    size_t header_size = 0;
+    if(header && size >= 3 && std::memcmp(buffer, "jk!", 3) == 0)
+        header_size = 3;
+    JKSNBufferInput input(buffer + header_size, size - header_size);
+    document.clear();
+    this->p->parseDocument(input, *document.p);
+    document.p->bytes_parsed = header_size + input.tell();
+    return document.root();
+}
+
+JKSNView parse(const char *buffer, size_t size, JKSNDocument &document, bool header) {
+    size_t header_size = 0;
+    if(header && size >= 3 && std::memcmp(buffer, "jk!", 3) == 0)
+        header_size = 3;
+    JKSNBufferInput input(buffer + header_size, size - header_size);
+    document.clear();
+    JKSNDecoderPrivate().parseDocument(input, *document.p, false);
+    document.p->bytes_parsed = header_size + input.tell();
+    return document.root();
+}
+
+JKSNView JKSNDecoder::find(const char *buffer, size_t size, const JKSNStringView &path, JKSNDocument &document, bool header) {
+    size_t header_size = 0;
+    if(header && size >= 3 && std::memcmp(buffer, "jk!", 3) == 0)
+        header_size = 3;
+    JKSNBufferInput input(buffer + header_size, size - header_size);
+    document.clear();
+    this->p->findDocument(input, *document.p, path);
+    document.p->bytes_parsed = header_size + input.tell();
+    return document.root();
+}
+
+JKSNValue JKSNDecoder::find(const char *buffer, size_t size, const JKSNStringView &path, bool header) {
+    JKSNDocument document;
+    return this->find(buffer, size, path, document, header).toValue();
+}
+
+JKSNView find(const char *buffer, size_t size, const JKSNStringView &path, JKSNDocument &document, bool header) {
+    size_t header_size = 0;
+    if(header && size >= 3 && std::memcmp(buffer, "jk!", 3) == 0)
+        header_size = 3;
+    JKSNBufferInput input(buffer + header_size, size - header_size);
+    document.clear();
+    JKSNDecoderPrivate().findDocument(input, *document.p, path, false);
+    document.p->bytes_parsed = header_size + input.tell();
+    return document.root();
+}
+
+JKSNValue find(const char *buffer, size_t size, const JKSNStringView &path, bool header) {
+    JKSNDocument document;
+    return find(buffer, size, path, document, header).toValue();
+}
+
+void JKSNDecoder::index(const char *buffer, size_t size, JKSNIndex &result, bool header) {
+    size_t header_size = 0;
+    if(header && size >= 3 && std::memcmp(buffer, "jk!", 3) == 0)
+        header_size = 3;
+    JKSNBufferInput input(buffer + header_size, size - header_size);
+    result.clear();
+    this->p->parseIndex(input, *result.p);
+    result.p->header_size = header_size;
+    result.p->bytes_parsed = header_size + input.tell();
+}
+
+void index(const char *buffer, size_t size, JKSNIndex &result, bool header) {
+    size_t header_size = 0;
+    if(header && size >= 3 && std::memcmp(buffer, "jk!", 3) == 0)
+        header_size = 3;
+    JKSNBufferInput input(buffer + header_size, size - header_size);
+    result.clear();
+    JKSNDecoderPrivate().parseIndex(input, *result.p, false);
+    result.p->header_size = header_size;
+    result.p->bytes_parsed = header_size + input.tell();
+}
+
+void JKSNDecoder::setExtensions(unsigned extensions) {
+    this->p->accepted_extensions = extensions;
+}
+
+JKSNValue JKSNDecoder::parse(const char *buffer, size_t size, size_t &bytes_parsed, bool header) {
+    size_t header_size = 0;
+    if(header && size >= 3 && std::memcmp(buffer, "jk!", 3) == 0)
+        header_size = 3;
+    JKSNBufferInput input(buffer + header_size, size - header_size);
+    bytes_parsed = 0;
+    JKSNValue result = this->p->parseValue(input);
+    bytes_parsed = header_size + input.tell();
+    return result;
+}
+
+template<typename Input>
+JKSNValue JKSNDecoderPrivate::parseValue(Input &fp) {
+    for(;;) {
+        uint8_t control = fp.get();
+        uint8_t ctrlhi = control & 0xf0;
+        switch(ctrlhi) {
+        /* Special values */
+        case 0x00:
+            switch(control) {
+            case 0x00:
+                return JKSNValue();
+            case 0x01:
+                return JKSNValue(nullptr);
+            case 0x02:
+                return JKSNValue(false);
+            case 0x03:
+                return JKSNValue(true);
+            case 0x0f:
+                throw JKSNDecodeError("this JKSN decoder does not support JSON literals");
+            }
+            break;
+        /* Integers */
+        case 0x10:
+            this->cache.haslastint = true;
+            switch(control) {
+            case 0x1b:
+                this->cache.lastint = intmax_t(int32_t(this->decodeInt(fp, 4)));
+                break;
+            case 0x1c:
+                this->cache.lastint = intmax_t(int16_t(this->decodeInt(fp, 2)));
+                break;
+            case 0x1d:
+                this->cache.lastint = intmax_t(int8_t(this->decodeInt(fp, 1)));
+                break;
+            case 0x1e:
+                this->cache.lastint = -intmax_t(this->decodeInt(fp, 0));
+                if(this->cache.lastint >= 0)
+                    throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
+                break;
+            case 0x1f:
+                this->cache.lastint = intmax_t(this->decodeInt(fp, 0));
+                if(this->cache.lastint < 0)
+                    throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
+                break;
+            default:
+                this->cache.lastint = control & 0xf;
+            }
+            return JKSNValue(this->cache.lastint);
+        /* Floating point numbers */
+        case 0x20:
+            switch(control) {
+            case 0x20:
+                return JKSNValue(NAN);
+            case 0x2b:
+                return this->parseLongDouble(fp);
+            case 0x2c:
+                return this->parseDouble(fp);
+            case 0x2d:
+                return this->parseFloat(fp);
+            case 0x2e:
+                return JKSNValue(-INFINITY);
+            case 0x2f:
+                return JKSNValue(INFINITY);
+            }
+            break;
+        /* UTF-16 strings */
+        case 0x30:
+            {
+                size_t strsize;
+                switch(control) {
+                case 0x3c:
+                    {
+                        uint8_t hashvalue = fp.get();
+                        if(this->cache.texthash[hashvalue])
+                            return JKSNValue(*this->cache.texthash[hashvalue]);
+                        else
+                            throw JKSNDecodeError("JKSN stream requires a non-existing hash");
+                    }
+                case 0x3d:
+                    strsize = this->decodeInt(fp, 2);
+                    break;
+                case 0x3e:
+                    strsize = this->decodeInt(fp, 1);
+                    break;
+                case 0x3f:
+                    strsize = this->decodeInt(fp, 0);
+                    break;
+                default:
+                    strsize = control & 0xf;
+                }
+                const char *strbuf = fp.read(strsize*2);
+                uint8_t hash = DJBHash(strbuf, strsize*2);
+                std::string result = UTF16LEToUTF8(strbuf, strsize);
+                storeHash(this->cache.texthash[hash], result.data(), result.size());
+                this->addToDictionary(strbuf, strsize*2, true);
+                return JKSNValue(std::move(result));
+            }
+        /* UTF-8 strings */
+        case 0x40:
+            {
+                size_t strsize;
+                switch(control) {
+                case 0x4d:
+                    strsize = this->decodeInt(fp, 2);
+                    break;
+                case 0x4e:
+                    strsize = this->decodeInt(fp, 1);
+                    break;
+                case 0x4f:
+                    strsize = this->decodeInt(fp, 0);
+                    break;
+                default:
+                    strsize = control & 0xf;
+                }
+                const char *strbuf = fp.read(strsize);
+                storeHash(this->cache.texthash[DJBHash(strbuf, strsize)], strbuf, strsize);
+                this->addToDictionary(strbuf, strsize, false);
+                return JKSNValue(JKSNStringView(strbuf, strsize));
+            }
+        /* Blob strings */
+        case 0x50:
+            {
+                size_t strsize;
+                switch(control) {
+                case 0x5c:
+                    {
+                        uint8_t hashvalue = fp.get();
+                        if(this->cache.blobhash[hashvalue])
+                            return JKSNValue(*this->cache.blobhash[hashvalue], true);
+                        else
+                            throw JKSNDecodeError("JKSN stream requires a non-existing hash");
+                    }
+                case 0x5d:
+                    strsize = this->decodeInt(fp, 2);
+                    break;
+                case 0x5e:
+                    strsize = this->decodeInt(fp, 1);
+                    break;
+                case 0x5f:
+                    strsize = this->decodeInt(fp, 0);
+                    break;
+                default:
+                    strsize = control & 0xf;
+                }
+                const char *strbuf = fp.read(strsize);
+                storeHash(this->cache.blobhash[DJBHash(strbuf, strsize)], strbuf, strsize);
+                return JKSNValue(JKSNStringView(strbuf, strsize), true);
+            }
+        /* Hashtable refreshers */
+        case 0x70:
+            {
+                size_t objlen;
+                switch(control) {
+                case 0x70:
+                    this->cache.texthash.fill(nullptr);
+                    this->cache.blobhash.fill(nullptr);
+                    continue;
+                case 0x7d:
+                    objlen = this->decodeInt(fp, 2);
+                    break;
+                case 0x7e:
+                    objlen = this->decodeInt(fp, 1);
+                    break;
+                case 0x7f:
+                    objlen = this->decodeInt(fp, 0);
+                    break;
+                default:
+                    objlen = control & 0xf;
+                }
+                while(objlen--)
+                    this->parseValue(fp);
+                continue;
+            }
+        /* Arrays */
+        case 0x80:
+            {
+                size_t objlen;
+                switch(control) {
+                case 0x8d:
+                    objlen = this->decodeInt(fp, 2);
+                    break;
+                case 0x8e:
+                    objlen = this->decodeInt(fp, 1);
+                    break;
+                case 0x8f:
+                    objlen = this->decodeInt(fp, 0);
+                    break;
+                default:
+                    objlen = control & 0xf;
+                }
+                std::vector<JKSNValue> result;
+                result.reserve(objlen);
+                while(objlen--)
+                    result.push_back(this->parseValue(fp));
+                return JKSNValue(std::move(result));
+            }
+        /* Objects */
+        case 0x90:
+            {
+                size_t objlen;
+                switch(control) {
+                case 0x9d:
+                    objlen = this->decodeInt(fp, 2);
+                    break;
+                case 0x9e:
+                    objlen = this->decodeInt(fp, 1);
+                    break;
+                case 0x9f:
+                    objlen = this->decodeInt(fp, 0);
+                    break;
+                default:
+                    objlen = control & 0xf;
+                }
+                JKSNObject result;
+                result.reserve(objlen);
+                while(objlen--) {
+                    JKSNValue key = this->parseValue(fp);
+                    JKSNKeyContext context(this->cache, key);
+                    result[std::move(key)] = this->parseValue(fp);
+                }
+                return JKSNValue(std::move(result));
+            }
+        /* Row-col swapped arrays */
+        case 0xa0:
+            {
+                size_t collen;
+                switch(control) {
+                case 0xa0:
+                    return JKSNValue::fromUnspecified();
+                case 0xad:
+                    collen = this->decodeInt(fp, 2);
+                    break;
+                case 0xae:
+                    collen = this->decodeInt(fp, 1);
+                    break;
+                case 0xaf:
+                    collen = this->decodeInt(fp, 0);
+                    break;
+                default:
+                    collen = control & 0xf;
+                }
+                return this->parseSwappedArray(fp, collen);
+            }
+        case 0xc0:
+            switch(control) {
+            /* Lengthless arrays */
+            case 0xc8:
+                {
+                    std::vector<JKSNValue> result;
+                    for(;;) {
+                        JKSNValue item = this->parseValue(fp);
+                        if(!item.isUnspecified())
+                            result.push_back(std::move(item));
+                        else
+                            return JKSNValue(std::move(result));
+                    }
+                    break;
+                }
+            /* Padding byte */
+            case 0xca:
+                continue;
+            }
+            break;
+        /* Delta encoded integers */
+        case 0xd0:
+            {
+                intmax_t delta;
+                switch(control) {
+                case 0xd0: case 0xd1: case 0xd2: case 0xd3: case 0xd4: case 0xd5:
+                    delta = control & 0xf;
+                    break;
+                case 0xd6: case 0xd7: case 0xd8: case 0xd9: case 0xda:
+                    delta = intmax_t(control & 0xf)-11;
+                    break;
+                case 0xdb:
+                    delta = intmax_t(int32_t(this->decodeInt(fp, 4)));
+                    break;
+                case 0xdc:
+                    delta = intmax_t(int16_t(this->decodeInt(fp, 2)));
+                    break;
+                case 0xdd:
+                    delta = intmax_t(int8_t(this->decodeInt(fp, 1)));
+                    break;
+                case 0xde:
+                    delta = -intmax_t(this->decodeInt(fp, 0));
+                    if(delta >= 0)
+                        throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
+                    break;
+                case 0xdf:
+                    delta = intmax_t(this->decodeInt(fp, 0));
+                    if(delta < 0)
+                        throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
+                    break;
+                }
+                if(!this->cache.haslastint)
+                    throw JKSNDecodeError("JKSN stream contains an invalid delta encoded integer");
+                this->cache.haslastint = true;
+                this->cache.lastint = intmax_t(uintmax_t(this->cache.lastint) + uintmax_t(delta));
+                return JKSNValue(this->cache.lastint);
+            }
+        /* Extensions */
+        case 0xe0:
+            /* Dictionary references */
+            if(control <= 0xe1 && (this->cache.extensions & JKSN_EXTENSION_DICTIONARY))
+                return JKSNValue(*this->cache.dictionary.lookup(this->decodeInt(fp, control == 0xe0 ? 1 : 2)));
+            /* Packed arrays */
+            if(this->isPackedArray(control)) {
+                std::vector<JKSNNode> items;
+                this->parsePackedArray(fp, control, items);
+                std::vector<JKSNValue> result;
+                result.reserve(items.size());
+                for(const JKSNNode &item : items)
+                    result.push_back(JKSNView(&item).toValue());
+                return JKSNValue(std::move(result));
+            }
+            /* Shaped objects */
+            if(this->isShapedObject(control)) {
+                std::shared_ptr<const JKSNShapeCache::Shape> shape = this->parseShape(fp, control, [&] {
+                    JKSNValue key = this->parseValue(fp);
+                    if(key.getType() != JKSN_STRING)
+                        throw JKSNDecodeError("JKSN stream contains a shape with a key that is not a string");
+                    return key.toString();
+                });
+                JKSNObject result;
+                result.reserve(shape->size());
+                for(const std::shared_ptr<std::string> &key : *shape) {
+                    JKSNKeyContext context(this->cache, JKSNStringView(*key));
+                    result[JKSNValue(*key)] = this->parseValue(fp);
+                }
+                return JKSNValue(std::move(result));
+            }
+            break;
+        case 0xf0:
+            /* Checksums */
+            if(JKSNChecksum::isChecksum(control))
+                return checkValue(fp, control, [&] {
+                    return this->parseValue(fp);
+                });
+            /* Pragmas, only the extensions are understood */
+            if(control == 0xff) {
+                this->applyPragma(this->parseValue(fp));
+                continue;
+            }
+        }
+        throw JKSNDecodeError("cannot encode unrecognizable type of value");
+    }
+}
+
+void JKSNDecoderPrivate::parseDocument(JKSNBufferInput &fp, JKSNDocumentPrivate &document, bool keep_hashtable) {
+    JKSNDocumentState state(document);
+    JKSNNode *root = document.allocateNodes(1);
+    new(root) JKSNNode(this->parseNode(fp, state));
+    document.root = root;
+    if(keep_hashtable)
+        this->commitHashtable(state);
+}
+
+void JKSNDecoderPrivate::commitHashtable(const JKSNDocumentState &state) {
+    /* Strings that remain in the hashtable are copied once, so that
+       later messages can refer to them after the input is gone */
+    for(size_t i = 0; i < 256; ++i) {
+        if(state.textutf16[i])
+            this->cache.texthash[i] = std::make_shared<std::string>(UTF16LEToUTF8(state.texthash[i].data(), state.texthash[i].size()/2));
+        else if(state.textdirty[i])
+            this->cache.texthash[i] = state.texthash[i].data() ? std::make_shared<std::string>(state.texthash[i].toString()) : nullptr;
+        if(state.blobdirty[i])
+            this->cache.blobhash[i] = state.blobhash[i].data() ? std::make_shared<std::string>(state.blobhash[i].toString()) : nullptr;
+    }
+}
+
+JKSNNode JKSNDecoderPrivate::parseNode(JKSNBufferInput &fp, JKSNDocumentState &state) {
+    JKSNNode result;
+    JKSNDocumentPrivate &document = state.document;
+    for(;;) {
+        uint8_t control = fp.get();
+        uint8_t ctrlhi = control & 0xf0;
+        switch(ctrlhi) {
+        /* Special values */
+        case 0x00:
+            switch(control) {
+            case 0x00:
+                return result;
+            case 0x01:
+                result.data_type = JKSN_NULL;
+                return result;
+            case 0x02:
+            case 0x03:
+                result.data_type = JKSN_BOOL;
+                result.data_bool = control == 0x03;
+                return result;
+            case 0x0f:
+                throw JKSNDecodeError("this JKSN decoder does not support JSON literals");
+            }
+            break;
+        /* Integers */
+        case 0x10:
+            this->cache.haslastint = true;
+            switch(control) {
             case 0x1b:
                 this->cache.lastint = intmax_t(int32_t(this->decodeInt(fp, 4)));
                 break;
@@ -688,1101 +3229,3331 @@ JKSNValue JKSNDecoderPrivate::parseValue(std::istream &fp) {
                 if(this->cache.lastint >= 0)
                     throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
                 break;
-            case 0x1f:
-                this->cache.lastint = intmax_t(this->decodeInt(fp, 0));
-                if(this->cache.lastint < 0)
+            case 0x1f:
+                this->cache.lastint = intmax_t(this->decodeInt(fp, 0));
+                if(this->cache.lastint < 0)
+                    throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
+                break;
+            default:
+                this->cache.lastint = control & 0xf;
+            }
+            result.data_type = JKSN_INT;
+            result.data_int = this->cache.lastint;
+            return result;
+        /* Floating point numbers */
+        case 0x20:
+            switch(control) {
+            case 0x20:
+                result.data_type = JKSN_DOUBLE;
+                result.data_double = NAN;
+                return result;
+            case 0x2b:
+                result.data_type = JKSN_LONG_DOUBLE;
+                result.data_long_double = this->parseLongDouble(fp).toLongDouble();
+                return result;
+            case 0x2c:
+                result.data_type = JKSN_DOUBLE;
+                result.data_double = this->parseDouble(fp).toDouble();
+                return result;
+            case 0x2d:
+                result.data_type = JKSN_FLOAT;
+                result.data_float = this->parseFloat(fp).toFloat();
+                return result;
+            case 0x2e:
+                result.data_type = JKSN_DOUBLE;
+                result.data_double = -INFINITY;
+                return result;
+            case 0x2f:
+                result.data_type = JKSN_DOUBLE;
+                result.data_double = INFINITY;
+                return result;
+            }
+            break;
+        /* UTF-16 strings, the only ones that need to be transcoded */
+        case 0x30:
+            {
+                JKSNStringView str;
+                if(control == 0x3c)
+                    str = this->lookupHash(state, fp.get(), false);
+                else {
+                    size_t strsize = this->decodeLength(fp, control);
+                    const char *strbuf = fp.read(strsize*2);
+                    size_t utf8size = UTF16LECountUTF8(strbuf, strsize);
+                    char *utf8buf = document.arena.allocate<char>(utf8size);
+                    UTF16LEWriteUTF8(strbuf, strsize, utf8buf);
+                    str = JKSNStringView(utf8buf, utf8size);
+                    state.setText(DJBHash(strbuf, strsize*2), str);
+                    this->addToDictionary(strbuf, strsize*2, true);
+                }
+                result.data_type = JKSN_STRING;
+                result.data_string = str.data();
+                result.size = str.size();
+                return result;
+            }
+        /* UTF-8 strings */
+        case 0x40:
+            {
+                size_t strsize = this->decodeLength(fp, control);
+                result.data_type = JKSN_STRING;
+                result.data_string = fp.read(strsize);
+                if(document.copy_strings)
+                    result.data_string = document.arena.copy(result.data_string, strsize);
+                result.size = strsize;
+                state.setText(DJBHash(result.data_string, strsize), JKSNStringView(result.data_string, strsize));
+                this->addToDictionary(result.data_string, strsize, false);
+                return result;
+            }
+        /* Blob strings */
+        case 0x50:
+            {
+                result.data_type = JKSN_BLOB;
+                if(control == 0x5c) {
+                    JKSNStringView str = this->lookupHash(state, fp.get(), true);
+                    result.data_string = str.data();
+                    result.size = str.size();
+                } else {
+                    size_t strsize = this->decodeLength(fp, control);
+                    result.data_string = fp.read(strsize);
+                    if(document.copy_strings)
+                        result.data_string = document.arena.copy(result.data_string, strsize);
+                    result.size = strsize;
+                    state.setBlob(DJBHash(result.data_string, strsize), JKSNStringView(result.data_string, strsize));
+                }
+                return result;
+            }
+        /* Hashtable refreshers */
+        case 0x70:
+            if(control == 0x70)
+                state.refresh();
+            else
+                for(size_t objlen = this->decodeLength(fp, control); objlen--; )
+                    this->parseNode(fp, state);
+            continue;
+        /* Arrays */
+        case 0x80:
+            {
+                size_t objlen = this->decodeLength(fp, control);
+                if(objlen > fp.remaining())
+                    throw JKSNTruncatedError();
+                JKSNNode *children = document.allocateNodes(objlen);
+                for(size_t i = 0; i < objlen; ++i)
+                    new(&children[i]) JKSNNode(this->parseNode(fp, state));
+                result.data_type = JKSN_ARRAY;
+                result.size = objlen;
+                result.data_children = children;
+                return result;
+            }
+        /* Objects */
+        case 0x90:
+            {
+                size_t objlen = this->decodeLength(fp, control);
+                if(objlen > fp.remaining()/2)
+                    throw JKSNTruncatedError();
+                JKSNNode *children = document.allocateNodes(objlen*2);
+                for(size_t i = 0; i < objlen; ++i) {
+                    new(&children[i*2]) JKSNNode(this->parseNode(fp, state));
+                    JKSNKeyContext context(this->cache, children[i*2]);
+                    new(&children[i*2+1]) JKSNNode(this->parseNode(fp, state));
+                }
+                result.data_type = JKSN_OBJECT;
+                result.size = objlen;
+                result.data_children = children;
+                return result;
+            }
+        /* Row-col swapped arrays */
+        case 0xa0:
+            if(control == 0xa0) {
+                result.data_type = JKSN_UNSPECIFIED;
+                return result;
+            } else
+                return this->parseSwappedNodes(fp, state, this->decodeLength(fp, control));
+        case 0xc0:
+            switch(control) {
+            /* Lengthless arrays */
+            case 0xc8:
+                {
+                    std::vector<JKSNNode> items;
+                    for(;;) {
+                        JKSNNode item = this->parseNode(fp, state);
+                        if(item.data_type == JKSN_UNSPECIFIED)
+                            break;
+                        items.push_back(item);
+                    }
+                    JKSNNode *children = document.allocateNodes(items.size());
+                    std::uninitialized_copy(items.cbegin(), items.cend(), children);
+                    result.data_type = JKSN_ARRAY;
+                    result.size = items.size();
+                    result.data_children = children;
+                    return result;
+                }
+            /* Padding byte */
+            case 0xca:
+                continue;
+            }
+            break;
+        /* Delta encoded integers */
+        case 0xd0:
+            {
+                intmax_t delta;
+                switch(control) {
+                case 0xd0: case 0xd1: case 0xd2: case 0xd3: case 0xd4: case 0xd5:
+                    delta = control & 0xf;
+                    break;
+                case 0xd6: case 0xd7: case 0xd8: case 0xd9: case 0xda:
+                    delta = intmax_t(control & 0xf)-11;
+                    break;
+                case 0xdb:
+                    delta = intmax_t(int32_t(this->decodeInt(fp, 4)));
+                    break;
+                case 0xdc:
+                    delta = intmax_t(int16_t(this->decodeInt(fp, 2)));
+                    break;
+                case 0xdd:
+                    delta = intmax_t(int8_t(this->decodeInt(fp, 1)));
+                    break;
+                case 0xde:
+                    delta = -intmax_t(this->decodeInt(fp, 0));
+                    if(delta >= 0)
+                        throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
+                    break;
+                default:
+                    delta = intmax_t(this->decodeInt(fp, 0));
+                    if(delta < 0)
+                        throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
+                }
+                if(!this->cache.haslastint)
+                    throw JKSNDecodeError("JKSN stream contains an invalid delta encoded integer");
+                this->cache.lastint = intmax_t(uintmax_t(this->cache.lastint) + uintmax_t(delta));
+                result.data_type = JKSN_INT;
+                result.data_int = this->cache.lastint;
+                return result;
+            }
+        /* Extensions */
+        case 0xe0:
+            /* Dictionary references, kept alive by the document */
+            if(control <= 0xe1 && (this->cache.extensions & JKSN_EXTENSION_DICTIONARY)) {
+                const std::shared_ptr<std::string> &str = this->cache.dictionary.lookup(this->decodeInt(fp, control == 0xe0 ? 1 : 2));
+                result.data_type = JKSN_STRING;
+                if(document.copy_strings)
+                    result.data_string = document.arena.copy(str->data(), str->size());
+                else {
+                    document.retained.push_back(str);
+                    result.data_string = str->data();
+                }
+                result.size = str->size();
+                return result;
+            }
+            /* Packed arrays */
+            if(this->isPackedArray(control)) {
+                std::vector<JKSNNode> items;
+                this->parsePackedArray(fp, control, items);
+                JKSNNode *children = document.allocateNodes(items.size());
+                std::uninitialized_copy(items.cbegin(), items.cend(), children);
+                result.data_type = JKSN_ARRAY;
+                result.size = items.size();
+                result.data_children = children;
+                return result;
+            }
+            /* Shaped objects */
+            if(this->isShapedObject(control)) {
+                std::shared_ptr<const JKSNShapeCache::Shape> shape = this->parseShape(fp, state, control);
+                JKSNNode *children = document.allocateNodes(shape->size()*2);
+                for(size_t i = 0; i < shape->size(); ++i) {
+                    new(&children[i*2]) JKSNNode(shapeKeyNode(document, (*shape)[i]));
+                    JKSNKeyContext context(this->cache, JKSNStringView(*(*shape)[i]));
+                    new(&children[i*2+1]) JKSNNode(this->parseNode(fp, state));
+                }
+                result.data_type = JKSN_OBJECT;
+                result.size = shape->size();
+                result.data_children = children;
+                return result;
+            }
+            break;
+        case 0xf0:
+            /* Checksums */
+            if(JKSNChecksum::isChecksum(control))
+                return checkValue(fp, control, [&] {
+                    return this->parseNode(fp, state);
+                });
+            /* Pragmas, only the extensions are understood */
+            if(control == 0xff) {
+                this->applyPragma(this->parseNode(fp, state));
+                continue;
+            }
+        }
+        throw JKSNDecodeError("cannot decode unrecognizable type of value");
+    }
+}
+
+JKSNNode JKSNDecoderPrivate::parseSwappedNodes(JKSNBufferInput &fp, JKSNDocumentState &state, size_t column_length) {
+    JKSNDocumentPrivate &document = state.document;
+    std::vector<std::pair<JKSNNode, JKSNNode>> columns;
+    size_t rows = 0;
+    while(column_length--) {
+        JKSNNode column_name = this->parseNode(fp, state);
+        JKSNNode column_values;
+        {
+            JKSNKeyContext context(this->cache, column_name);
+            column_values = this->parseNode(fp, state);
+        }
+        if(column_values.data_type != JKSN_ARRAY)
+            throw JKSNDecodeError("JKSN row-col swapped array requires an array but not found");
+        rows = std::max(rows, column_values.size);
+        columns.push_back(std::make_pair(column_name, column_values));
+    }
+    JKSNNode *children = document.allocateNodes(rows);
+    for(size_t i = 0; i < rows; ++i) {
+        JKSNNode row;
+        row.data_type = JKSN_OBJECT;
+        for(const std::pair<JKSNNode, JKSNNode> &column : columns)
+            if(i < column.second.size && column.second.data_children[i].data_type != JKSN_UNSPECIFIED)
+                ++row.size;
+        JKSNNode *members = document.allocateNodes(row.size*2);
+        row.data_children = members;
+        for(const std::pair<JKSNNode, JKSNNode> &column : columns)
+            if(i < column.second.size && column.second.data_children[i].data_type != JKSN_UNSPECIFIED) {
+                new(members++) JKSNNode(column.first);
+                new(members++) JKSNNode(column.second.data_children[i]);
+            }
+        new(&children[i]) JKSNNode(row);
+    }
+    JKSNNode result;
+    result.data_type = JKSN_ARRAY;
+    result.size = rows;
+    result.data_children = children;
+    return result;
+}
+
+bool JKSNDecoderPrivate::skimNode(JKSNBufferInput &fp, JKSNDocumentState &state) {
+    JKSNDocumentPrivate &document = state.document;
+    uint8_t control = this->skimPrefixes(fp, state);
+    if(JKSNChecksum::isChecksum(control))
+        return checkValue(fp, control, [&] {
+            return this->skimNode(fp, state);
+        });
+    if(this->isPackedArray(control)) {
+        /* Packed arrays are skipped without unpacking them */
+        this->decodeInt(fp, 0);
+        fp.read(this->decodeInt(fp, 0));
+        return false;
+    }
+    if(this->isShapedObject(control)) {
+        for(const std::shared_ptr<std::string> &key : *this->parseShape(fp, state, control)) {
+            JKSNKeyContext context(this->cache, JKSNStringView(*key));
+            this->skimNode(fp, state);
+        }
+        return false;
+    }
+    bool unspecified = false;
+    switch(control & 0xf0) {
+    /* UTF-16 strings are kept as they are, until they are looked up */
+    case 0x30:
+        if(control == 0x3c)
+            fp.get();
+        else {
+            size_t strsize = this->decodeLength(fp, control);
+            const char *strbuf = fp.read(strsize*2);
+            state.setText(DJBHash(strbuf, strsize*2), JKSNStringView(strbuf, strsize*2), true);
+            this->addToDictionary(strbuf, strsize*2, true);
+        }
+        break;
+    case 0x40:
+        {
+            size_t strsize = this->decodeLength(fp, control);
+            const char *strbuf = fp.read(strsize);
+            uint8_t hash = DJBHash(strbuf, strsize);
+            this->addToDictionary(strbuf, strsize, false);
+            if(document.copy_strings)
+                strbuf = document.arena.copy(strbuf, strsize);
+            state.setText(hash, JKSNStringView(strbuf, strsize));
+        }
+        break;
+    case 0x50:
+        if(control == 0x5c)
+            fp.get();
+        else {
+            size_t strsize = this->decodeLength(fp, control);
+            const char *strbuf = fp.read(strsize);
+            uint8_t hash = DJBHash(strbuf, strsize);
+            if(document.copy_strings)
+                strbuf = document.arena.copy(strbuf, strsize);
+            state.setBlob(hash, JKSNStringView(strbuf, strsize));
+        }
+        break;
+    case 0x80:
+        for(size_t objlen = this->decodeLength(fp, control); objlen--; )
+            this->skimNode(fp, state);
+        break;
+    case 0x90:
+        this->skimMembers(fp, state, this->decodeLength(fp, control));
+        break;
+    case 0xa0:
+        if(control == 0xa0)
+            unspecified = true;
+        else
+            this->skimMembers(fp, state, this->decodeLength(fp, control));
+        break;
+    case 0xc0:
+        if(control != 0xc8)
+            throw JKSNDecodeError("cannot decode unrecognizable type of value");
+        while(!this->skimNode(fp, state)) {
+        }
+        break;
+    default:
+        /* Other scalars are cheap to decode, and integers update lastint */
+        fp.unget();
+        this->parseNode(fp, state);
+    }
+    return unspecified;
+}
+
+void JKSNDecoderPrivate::skimMembers(JKSNBufferInput &fp, JKSNDocumentState &state, size_t count) {
+    if(this->cache.extensions & JKSN_EXTENSION_KEY_DELTAS)
+        /* Keys are read, as each value is decoded against the lastint of its key */
+        while(count--) {
+            JKSNNode key = this->parseNode(fp, state);
+            JKSNKeyContext context(this->cache, key);
+            this->skimNode(fp, state);
+        }
+    else
+        while(count--) {
+            this->skimNode(fp, state);
+            this->skimNode(fp, state);
+        }
+}
+
+uint8_t JKSNDecoderPrivate::skimPrefixes(JKSNBufferInput &fp, JKSNDocumentState &state) {
+    for(;;) {
+        uint8_t control = fp.get();
+        if(control == 0xca)
+            continue;
+        else if(control == 0x70)
+            state.refresh();
+        else if((control & 0xf0) == 0x70)
+            for(size_t objlen = this->decodeLength(fp, control); objlen--; )
+                this->skimNode(fp, state);
+        else if(control == 0xff)
+            this->applyPragma(this->parseNode(fp, state));
+        else
+            return control;
+    }
+}
+
+void JKSNDecoderPrivate::findDocument(JKSNBufferInput &fp, JKSNDocumentPrivate &document, const JKSNStringView &path, bool keep_hashtable) {
+    JKSNDocumentState state(document);
+    const JKSNNode *result = nullptr;
+    this->findNode(fp, state, splitPath(path), 0, keep_hashtable, result);
+    if(keep_hashtable)
+        this->commitHashtable(state);
+    if(!result)
+        throw std::out_of_range("JKSN path not found");
+    document.root = result;
+}
+
+bool JKSNDecoderPrivate::findNode(JKSNBufferInput &fp, JKSNDocumentState &state, const std::vector<std::string> &path, size_t depth, bool finish, const JKSNNode *&result) {
+    uint8_t control = this->skimPrefixes(fp, state);
+    if(depth == path.size()) {
+        fp.unget();
+        JKSNNode *node = state.document.allocateNodes(1);
+        new(node) JKSNNode(this->parseNode(fp, state));
+        result = node;
+        return node->data_type == JKSN_UNSPECIFIED;
+    } else if(JKSNChecksum::isChecksum(control)) {
+        if(finish)
+            return checkValue(fp, control, [&] {
+                return this->findNode(fp, state, path, depth, finish, result);
+            });
+        /* Reading stops at the value found, so the checksum is not verified */
+        if(control <= 0xf5)
+            fp.read(JKSNChecksum::digestSize(control));
+        bool unspecified = this->findNode(fp, state, path, depth, finish, result);
+        if(control >= 0xf8 && !result)
+            fp.read(JKSNChecksum::digestSize(control));
+        return unspecified;
+    } else if(this->isPackedArray(control)) {
+        fp.unget();
+        JKSNNode array = this->parseNode(fp, state);
+        size_t index = parsePathIndex(path[depth]);
+        if(!result && depth+1 == path.size() && index < array.size)
+            result = &array.data_children[index];
+        return false;
+    } else if(this->isShapedObject(control)) {
+        std::shared_ptr<const JKSNShapeCache::Shape> shape = this->parseShape(fp, state, control);
+        for(const std::shared_ptr<std::string> &key : *shape) {
+            JKSNKeyContext context(this->cache, JKSNStringView(*key));
+            if(!result && *key == path[depth]) {
+                this->findNode(fp, state, path, depth+1, finish, result);
+                if(result && !finish)
+                    return false;
+            } else
+                this->skimNode(fp, state);
+        }
+        return false;
+    }
+    bool unspecified = false;
+    switch(control & 0xf0) {
+    case 0x80:
+        {
+            size_t objlen = this->decodeLength(fp, control);
+            size_t index = parsePathIndex(path[depth]);
+            for(size_t i = 0; i < objlen; ++i)
+                if(i == index) {
+                    this->findNode(fp, state, path, depth+1, finish, result);
+                    if(result && !finish)
+                        return false;
+                } else
+                    this->skimNode(fp, state);
+        }
+        break;
+    case 0x90:
+        for(size_t objlen = this->decodeLength(fp, control); objlen--; ) {
+            JKSNNode key = this->parseNode(fp, state);
+            JKSNKeyContext context(this->cache, key);
+            if(!result && key.data_type == JKSN_STRING && JKSNStringView(key.data_string, key.size) == path[depth]) {
+                this->findNode(fp, state, path, depth+1, finish, result);
+                if(result && !finish)
+                    return false;
+            } else
+                this->skimNode(fp, state);
+        }
+        break;
+    case 0xa0:
+        if(control == 0xa0)
+            unspecified = true;
+        else {
+            size_t collen = this->decodeLength(fp, control);
+            size_t index = parsePathIndex(path[depth]);
+            if(depth+1 == path.size()) {
+                /* A whole row is spread over every column */
+                JKSNNode rows = this->parseSwappedNodes(fp, state, collen);
+                if(!result && index < rows.size)
+                    result = &rows.data_children[index];
+            } else {
+                /* Otherwise only one column is searched, at the row index */
+                std::vector<std::string> column_path(1, path[depth]);
+                column_path.insert(column_path.end(), path.begin() + std::ptrdiff_t(depth+2), path.end());
+                while(collen--) {
+                    JKSNNode column_name = this->parseNode(fp, state);
+                    JKSNKeyContext context(this->cache, column_name);
+                    if(!result && index != size_t(-1) && column_name.data_type == JKSN_STRING && JKSNStringView(column_name.data_string, column_name.size) == path[depth+1]) {
+                        const JKSNNode *found = nullptr;
+                        this->findNode(fp, state, column_path, 0, finish, found);
+                        if(found && (column_path.size() > 1 || found->data_type != JKSN_UNSPECIFIED))
+                            result = found;
+                    } else
+                        this->skimNode(fp, state);
+                    if(result && !finish)
+                        return false;
+                }
+            }
+        }
+        break;
+    case 0xc0:
+        if(control != 0xc8)
+            throw JKSNDecodeError("cannot decode unrecognizable type of value");
+        {
+            size_t index = parsePathIndex(path[depth]);
+            for(size_t i = 0; ; ++i)
+                if(i == index) {
+                    if(this->findNode(fp, state, path, depth+1, finish, result)) {
+                        /* That was the end of the array */
+                        result = nullptr;
+                        break;
+                    }
+                    if(result && !finish)
+                        return false;
+                } else if(this->skimNode(fp, state))
+                    break;
+        }
+        break;
+    default:
+        fp.unget();
+        unspecified = this->skimNode(fp, state);
+    }
+    return unspecified;
+}
+
+std::vector<std::string> JKSNDecoderPrivate::splitPath(const JKSNStringView &path) {
+    std::vector<std::string> result;
+    if(path.size() == 0)
+        return result;
+    else if(path[0] != '/')
+        throw std::invalid_argument("JKSN path should start with /");
+    for(size_t i = 0; i < path.size(); ++i)
+        if(path[i] == '/')
+            result.push_back(std::string());
+        else if(path[i] == '~' && i+1 < path.size() && (path[i+1] == '0' || path[i+1] == '1'))
+            result.back().push_back(path[++i] == '0' ? '~' : '/');
+        else
+            result.back().push_back(path[i]);
+    return result;
+}
+
+size_t JKSNDecoderPrivate::parsePathIndex(const std::string &segment) {
+    /* Anything but a plain decimal number never matches */
+    if(segment.empty() || segment.size() > 19)
+        return size_t(-1);
+    size_t result = 0;
+    for(char c : segment)
+        if(c >= '0' && c <= '9')
+            result = result*10 + size_t(c - '0');
+        else
+            return size_t(-1);
+    return result;
+}
+
+void JKSNDecoderPrivate::parseIndex(JKSNBufferInput &fp, JKSNIndexPrivate &index, bool keep_hashtable) {
+    JKSNDocumentState state(index.document);
+    this->indexNode(fp, state, index.tape);
+    if(keep_hashtable)
+        this->commitHashtable(state);
+}
+
+size_t JKSNDecoderPrivate::indexNode(JKSNBufferInput &fp, JKSNDocumentState &state, std::vector<JKSNTapeEntry> &tape) {
+    uint8_t control = this->skimPrefixes(fp, state);
+    if(JKSNChecksum::isChecksum(control))
+        return checkValue(fp, control, [&] {
+            return this->indexNode(fp, state, tape);
+        });
+    size_t result = tape.size();
+    tape.push_back(JKSNTapeEntry());
+    tape[result].offset = fp.tell() - 1;
+    tape[result].control = control;
+    if(this->isPackedArray(control)) {
+        /* The items have no control byte of their own, so they share the one of the array */
+        std::vector<JKSNNode> items;
+        this->parsePackedArray(fp, control, items);
+        tape[result].node.data_type = JKSN_ARRAY;
+        tape[result].node.size = items.size();
+        for(const JKSNNode &item : items) {
+            JKSNTapeEntry entry;
+            entry.node = item;
+            entry.offset = tape[result].offset;
+            entry.control = control;
+            entry.end = tape.size() + 1;
+            tape.push_back(entry);
+        }
+        tape[result].end = tape.size();
+        return result;
+    }
+    if(this->isShapedObject(control)) {
+        /* So do the keys of a shaped object */
+        std::shared_ptr<const JKSNShapeCache::Shape> shape = this->parseShape(fp, state, control);
+        tape[result].node.data_type = JKSN_OBJECT;
+        tape[result].node.size = shape->size();
+        for(const std::shared_ptr<std::string> &key : *shape) {
+            JKSNTapeEntry entry;
+            entry.node = shapeKeyNode(state.document, key);
+            entry.offset = tape[result].offset;
+            entry.control = control;
+            entry.end = tape.size() + 1;
+            tape.push_back(entry);
+            JKSNKeyContext context(this->cache, JKSNStringView(*key));
+            this->indexNode(fp, state, tape);
+        }
+        tape[result].end = tape.size();
+        return result;
+    }
+    switch(control & 0xf0) {
+    /* UTF-16 strings are transcoded when materialized */
+    case 0x30:
+        {
+            JKSNNode &node = tape[result].node;
+            node.data_type = JKSN_STRING;
+            if(control == 0x3c) {
+                uint8_t hash = fp.get();
+                if(state.textdirty[hash] && state.textutf16[hash]) {
+                    node.data_string = state.texthash[hash].data();
+                    node.size = state.texthash[hash].size();
+                    tape[result].utf16 = true;
+                } else {
+                    JKSNStringView str = this->lookupHash(state, hash, false);
+                    node.data_string = str.data();
+                    node.size = str.size();
+                }
+            } else {
+                size_t strsize = this->decodeLength(fp, control);
+                node.data_string = fp.read(strsize*2);
+                node.size = strsize*2;
+                tape[result].utf16 = true;
+                state.setText(DJBHash(node.data_string, node.size), JKSNStringView(node.data_string, node.size), true);
+                this->addToDictionary(node.data_string, node.size, true);
+            }
+        }
+        break;
+    case 0x80:
+        {
+            size_t objlen = this->decodeLength(fp, control);
+            if(objlen > fp.remaining())
+                throw JKSNTruncatedError();
+            tape[result].node.data_type = JKSN_ARRAY;
+            tape[result].node.size = objlen;
+            while(objlen--)
+                this->indexNode(fp, state, tape);
+        }
+        break;
+    case 0x90:
+        {
+            size_t objlen = this->decodeLength(fp, control);
+            if(objlen > fp.remaining()/2)
+                throw JKSNTruncatedError();
+            tape[result].node.data_type = JKSN_OBJECT;
+            tape[result].node.size = objlen;
+            while(objlen--) {
+                size_t key = this->indexNode(fp, state, tape);
+                JKSNKeyContext context(this->cache, tape[key]);
+                this->indexNode(fp, state, tape);
+            }
+        }
+        break;
+    case 0xa0:
+        if(control == 0xa0)
+            tape[result].node.data_type = JKSN_UNSPECIFIED;
+        else {
+            size_t collen = this->decodeLength(fp, control);
+            if(collen > fp.remaining()/2)
+                throw JKSNTruncatedError();
+            this->indexSwappedNodes(fp, state, tape, collen);
+        }
+        break;
+    case 0xc0:
+        if(control != 0xc8)
+            throw JKSNDecodeError("cannot decode unrecognizable type of value");
+        tape[result].node.data_type = JKSN_ARRAY;
+        for(;;) {
+            size_t item = this->indexNode(fp, state, tape);
+            if(tape[item].node.data_type == JKSN_UNSPECIFIED) {
+                tape.pop_back();
+                break;
+            }
+            ++tape[result].node.size;
+        }
+        break;
+    default:
+        fp.unget();
+        tape[result].node = this->parseNode(fp, state);
+    }
+    tape[result].end = tape.size();
+    return result;
+}
+
+void JKSNDecoderPrivate::indexSwappedNodes(JKSNBufferInput &fp, JKSNDocumentState &state, std::vector<JKSNTapeEntry> &tape, size_t column_length) {
+    /* Columns are indexed aside, then copied row by row */
+    const JKSNTapeEntry swapped = tape.back();
+    tape.pop_back();
+    std::vector<JKSNTapeEntry> columns_tape;
+    std::vector<std::pair<size_t, std::vector<size_t>>> columns;
+    size_t rows = 0;
+    while(column_length--) {
+        size_t column_name = this->indexNode(fp, state, columns_tape);
+        size_t column_values;
+        {
+            JKSNKeyContext context(this->cache, columns_tape[column_name]);
+            column_values = this->indexNode(fp, state, columns_tape);
+        }
+        if(columns_tape[column_values].node.data_type != JKSN_ARRAY)
+            throw JKSNDecodeError("JKSN row-col swapped array requires an array but not found");
+        std::vector<size_t> cells;
+        cells.reserve(columns_tape[column_values].node.size);
+        for(size_t i = column_values+1; i != columns_tape[column_values].end; i = columns_tape[i].end)
+            cells.push_back(i);
+        rows = std::max(rows, cells.size());
+        columns.push_back(std::make_pair(column_name, std::move(cells)));
+    }
+    auto copySubtree = [&](size_t entry) {
+        size_t shift = tape.size() - entry;
+        for(size_t i = entry; i != columns_tape[entry].end; ++i) {
+            tape.push_back(columns_tape[i]);
+            tape.back().end += shift;
+        }
+    };
+    tape.push_back(swapped);
+    size_t result = tape.size()-1;
+    tape[result].node.data_type = JKSN_ARRAY;
+    tape[result].node.size = rows;
+    for(size_t i = 0; i < rows; ++i) {
+        size_t row = tape.size();
+        tape.push_back(swapped);
+        tape[row].node.data_type = JKSN_OBJECT;
+        for(const std::pair<size_t, std::vector<size_t>> &column : columns)
+            if(i < column.second.size() && columns_tape[column.second[i]].node.data_type != JKSN_UNSPECIFIED) {
+                copySubtree(column.first);
+                copySubtree(column.second[i]);
+                ++tape[row].node.size;
+            }
+        tape[row].end = tape.size();
+    }
+}
+
+template<typename Input, typename Parse>
+auto JKSNDecoderPrivate::checkValue(Input &fp, uint8_t control, Parse parse) -> decltype(parse()) {
+    JKSNChecksum checksum(control);
+    size_t size = JKSNChecksum::digestSize(control);
+    std::string expected;
+    if(control <= 0xf5)
+        expected.assign(fp.read(size), size);
+    size_t mark = fp.beginChecksum(&checksum);
+    decltype(parse()) result = parse();
+    fp.endChecksum(&checksum, mark);
+    if(control >= 0xf8)
+        expected.assign(fp.read(size), size);
+    checksum.verify(expected.data());
+    return result;
+}
+
+void JKSNDecoderPrivate::applyPragma(const JKSNValue &pragma) {
+    if(pragma.getType() != JKSN_ARRAY)
+        return;
+    const std::vector<JKSNValue> &items = pragma.toVector();
+    if(items.size() == 2 && items[0].getType() == JKSN_STRING && items[0].toString() == "jksn-extensions" && items[1].getType() == JKSN_INT)
+        this->setExtensions(items[1].toInt());
+}
+
+void JKSNDecoderPrivate::applyPragma(const JKSNNode &pragma) {
+    if(pragma.data_type != JKSN_ARRAY || pragma.size != 2)
+        return;
+    const JKSNNode &name = pragma.data_children[0];
+    const JKSNNode &extensions = pragma.data_children[1];
+    if(name.data_type == JKSN_STRING && JKSNStringView(name.data_string, name.size) == "jksn-extensions" && extensions.data_type == JKSN_INT)
+        this->setExtensions(extensions.data_int);
+}
+
+void JKSNDecoderPrivate::setExtensions(intmax_t extensions) {
+    if(extensions < 0 || (uintmax_t(extensions) & ~uintmax_t(this->accepted_extensions)))
+        throw JKSNDecodeError("JKSN stream requires an extension that is not accepted");
+    this->cache.setExtensions(unsigned(extensions));
+}
+
+void JKSNDecoderPrivate::addToDictionary(const char *data, size_t size, bool utf16) {
+    if(size > 1 && (this->cache.extensions & JKSN_EXTENSION_DICTIONARY))
+        this->cache.dictionary.insert(std::make_shared<std::string>(utf16 ? UTF16LEToUTF8(data, size/2) : std::string(data, size)));
+}
+
+bool JKSNDecoderPrivate::isPackedArray(uint8_t control) const {
+    return (control == 0xe2 && (this->cache.extensions & JKSN_EXTENSION_FLOAT_ARRAY)) ||
+        (control == 0xe3 && (this->cache.extensions & JKSN_EXTENSION_TYPED_ARRAY)) ||
+        (control == 0xe4 && (this->cache.extensions & JKSN_EXTENSION_BIT_PACKED)) ||
+        (control == 0xe5 && (this->cache.extensions & JKSN_EXTENSION_BOOL_ARRAY));
+}
+
+template<typename Input>
+void JKSNDecoderPrivate::parsePackedArray(Input &fp, uint8_t control, std::vector<JKSNNode> &items) {
+    size_t count = this->decodeInt(fp, 0);
+    size_t size = this->decodeInt(fp, 0);
+    const char *data = fp.read(size);
+    switch(control) {
+    case 0xe2:
+        {
+            std::vector<double> numbers;
+            unpackXorDoubles(data, size, count, numbers);
+            items.resize(count);
+            for(size_t i = 0; i < count; ++i) {
+                items[i].data_type = JKSN_DOUBLE;
+                items[i].data_double = numbers[i];
+            }
+        }
+        break;
+    case 0xe3:
+        unpackTyped(data, size, count, items);
+        break;
+    case 0xe4:
+        unpackBitPacked(data, size, count, items);
+        break;
+    case 0xe5:
+        unpackBools(data, size, count, items);
+        break;
+    }
+}
+
+void JKSNDecoderPrivate::unpackBools(const char *data, size_t size, size_t count, std::vector<JKSNNode> &result) {
+    if(size == 0 || uint8_t(data[0]) > 1)
+        throw JKSNDecodeError("JKSN stream contains an invalid boolean array");
+    bool has_present = data[0] != 0;
+    size_t bytes = count/8 + (count % 8 != 0);
+    if((size - 1) / (has_present ? 2 : 1) != bytes || (size - 1) % (has_present ? 2 : 1) != 0)
+        throw JKSNDecodeError("JKSN packed array is shorter than its items");
+    const uint8_t *present = has_present ? reinterpret_cast<const uint8_t *>(data + 1) : nullptr;
+    const uint8_t *items = reinterpret_cast<const uint8_t *>(data + 1) + (has_present ? bytes : 0);
+    result.resize(count);
+    for(size_t i = 0; i < count; ++i)
+        if(present && !((present[i/8] >> (7 - i%8)) & 1))
+            result[i].data_type = JKSN_UNSPECIFIED;
+        else {
+            result[i].data_type = JKSN_BOOL;
+            result[i].data_bool = (items[i/8] >> (7 - i%8)) & 1;
+        }
+}
+
+void JKSNDecoderPrivate::unpackBitPacked(const char *data, size_t size, size_t count, std::vector<JKSNNode> &result) {
+    /* Every block takes two bytes at least */
+    static const size_t block_size = 128;
+    if((count + block_size - 1) / block_size > size / 2)
+        throw JKSNDecodeError("JKSN packed array is shorter than its items");
+    result.resize(count);
+    JKSNBitReader reader(data, size);
+    uint64_t items[block_size];
+    for(size_t start = 0; start < count; start += block_size) {
+        size_t block_count = std::min(count - start, block_size);
+        uint8_t header = uint8_t(reader.read(8));
+        unsigned bits = header & 0x7f;
+        if(bits > 64)
+            throw JKSNDecodeError("JKSN stream contains an invalid bit-packed array");
+        if(header & 0x80) {
+            uint64_t value = uint64_t(zigzagDecode(reader.readVarInt()));
+            uint64_t min_delta = uint64_t(zigzagDecode(reader.readVarInt()));
+            reader.read(bits, block_count - 1, items);
+            result[start].data_type = JKSN_INT;
+            result[start].data_int = intmax_t(int64_t(value));
+            for(size_t i = 1; i < block_count; ++i) {
+                value += min_delta + items[i-1];
+                result[start + i].data_type = JKSN_INT;
+                result[start + i].data_int = intmax_t(int64_t(value));
+            }
+        } else {
+            uint64_t min = uint64_t(zigzagDecode(reader.readVarInt()));
+            reader.read(bits, block_count, items);
+            for(size_t i = 0; i < block_count; ++i) {
+                result[start + i].data_type = JKSN_INT;
+                result[start + i].data_int = intmax_t(int64_t(min + items[i]));
+            }
+        }
+        reader.align();
+    }
+}
+
+void JKSNDecoderPrivate::unpackTyped(const char *data, size_t size, size_t count, std::vector<JKSNNode> &result) {
+    static const size_t widths[6] = {1, 2, 4, 8, 4, 8};
+    if(size == 0 || uint8_t(data[0]) > 5)
+        throw JKSNDecodeError("JKSN stream contains an invalid typed array");
+    uint8_t type = uint8_t(data[0]);
+    if((size - 1) / widths[type] != count || (size - 1) % widths[type] != 0)
+        throw JKSNDecodeError("JKSN packed array is shorter than its items");
+    const char *input = data + 1;
+    result.resize(count);
+    switch(type) {
+    case 0:
+        for(size_t i = 0; i < count; ++i) {
+            result[i].data_type = JKSN_INT;
+            result[i].data_int = int8_t(input[i]);
+        }
+        break;
+    case 1:
+        for(size_t i = 0; i < count; ++i) {
+            result[i].data_type = JKSN_INT;
+            result[i].data_int = int16_t(loadBigEndian<uint16_t>(input + i*2));
+        }
+        break;
+    case 2:
+        for(size_t i = 0; i < count; ++i) {
+            result[i].data_type = JKSN_INT;
+            result[i].data_int = int32_t(loadBigEndian<uint32_t>(input + i*4));
+        }
+        break;
+    case 3:
+        for(size_t i = 0; i < count; ++i) {
+            result[i].data_type = JKSN_INT;
+            result[i].data_int = intmax_t(int64_t(loadBigEndian<uint64_t>(input + i*8)));
+        }
+        break;
+    case 4:
+        for(size_t i = 0; i < count; ++i) {
+            uint32_t bits = loadBigEndian<uint32_t>(input + i*4);
+            result[i].data_type = JKSN_FLOAT;
+            std::memcpy(&result[i].data_float, &bits, 4);
+        }
+        break;
+    default:
+        for(size_t i = 0; i < count; ++i) {
+            uint64_t bits = loadBigEndian<uint64_t>(input + i*8);
+            result[i].data_type = JKSN_DOUBLE;
+            std::memcpy(&result[i].data_double, &bits, 8);
+        }
+    }
+}
+
+void JKSNDecoderPrivate::unpackXorDoubles(const char *data, size_t size, size_t count, std::vector<double> &result) {
+    /* Every value after the first takes a bit at least */
+    if(count != 0 && (size < 8 || count-1 > size*8 - 64))
+        throw JKSNDecodeError("JKSN packed array is shorter than its items");
+    result.resize(count);
+    JKSNBitReader reader(data, size);
+    uint64_t bits = 0;
+    unsigned leading = 0, meaningful = 0;
+    for(size_t i = 0; i < count; ++i) {
+        if(i == 0)
+            bits = reader.read(64);
+        else if(reader.read(1)) {
+            if(reader.read(1)) {
+                leading = unsigned(reader.read(5));
+                meaningful = unsigned(reader.read(6)) + 1;
+                if(leading + meaningful > 64)
+                    throw JKSNDecodeError("JKSN stream contains an invalid XOR compressed double");
+            } else if(meaningful == 0)
+                throw JKSNDecodeError("JKSN stream contains an invalid XOR compressed double");
+            bits ^= reader.read(meaningful) << (64 - leading - meaningful);
+        }
+        std::memcpy(&result[i], &bits, 8);
+    }
+}
+
+bool JKSNDecoderPrivate::isShapedObject(uint8_t control) const {
+    return (control == 0xe6 || control == 0xe7) && (this->cache.extensions & JKSN_EXTENSION_SHAPES);
+}
+
+template<typename Input, typename ParseKey>
+std::shared_ptr<const JKSNShapeCache::Shape> JKSNDecoderPrivate::parseShape(Input &fp, uint8_t control, ParseKey parseKey) {
+    if(control == 0xe7)
+        return this->cache.shapes.lookup(this->decodeInt(fp, 0));
+    std::shared_ptr<JKSNShapeCache::Shape> shape = std::make_shared<JKSNShapeCache::Shape>();
+    for(size_t keys = this->decodeInt(fp, 0); keys--; )
+        shape->push_back(std::make_shared<std::string>(parseKey()));
+    this->cache.shapes.insert(shape);
+    return shape;
+}
+
+std::shared_ptr<const JKSNShapeCache::Shape> JKSNDecoderPrivate::parseShape(JKSNBufferInput &fp, JKSNDocumentState &state, uint8_t control) {
+    return this->parseShape(fp, control, [&] {
+        JKSNNode key = this->parseNode(fp, state);
+        if(key.data_type != JKSN_STRING)
+            throw JKSNDecodeError("JKSN stream contains a shape with a key that is not a string");
+        return std::string(key.data_string, key.size);
+    });
+}
+
+JKSNNode JKSNDecoderPrivate::shapeKeyNode(JKSNDocumentPrivate &document, const std::shared_ptr<std::string> &key) {
+    JKSNNode result;
+    result.data_type = JKSN_STRING;
+    if(document.copy_strings)
+        result.data_string = document.arena.copy(key->data(), key->size());
+    else {
+        document.retained.push_back(key);
+        result.data_string = key->data();
+    }
+    result.size = key->size();
+    return result;
+}
+
+JKSNStringView JKSNDecoderPrivate::lookupHash(JKSNDocumentState &state, uint8_t hashvalue, bool is_blob) {
+    if(is_blob ? state.blobdirty[hashvalue] : state.textdirty[hashvalue]) {
+        JKSNStringView &result = is_blob ? state.blobhash[hashvalue] : state.texthash[hashvalue];
+        if(!is_blob && state.textutf16[hashvalue]) {
+            size_t utf8size = UTF16LECountUTF8(result.data(), result.size()/2);
+            char *utf8buf = state.document.arena.allocate<char>(utf8size);
+            UTF16LEWriteUTF8(result.data(), result.size()/2, utf8buf);
+            result = JKSNStringView(utf8buf, utf8size);
+            state.textutf16[hashvalue] = false;
+        }
+        if(result.data())
+            return result;
+    } else {
+        const std::shared_ptr<std::string> &result = is_blob ? this->cache.blobhash[hashvalue] : this->cache.texthash[hashvalue];
+        if(result) {
+            if(state.document.copy_strings)
+                return JKSNStringView(state.document.arena.copy(result->data(), result->size()), result->size());
+            state.document.retained.push_back(result);
+            return JKSNStringView(*result);
+        }
+    }
+    throw JKSNDecodeError("JKSN stream requires a non-existing hash");
+}
+
+template<typename Input>
+size_t JKSNDecoderPrivate::decodeLength(Input &fp, uint8_t control) {
+    switch(control & 0xf) {
+    case 0xd:
+        return decodeInt(fp, 2);
+    case 0xe:
+        return decodeInt(fp, 1);
+    case 0xf:
+        return decodeInt(fp, 0);
+    default:
+        return control & 0xf;
+    }
+}
+
+template<typename Input>
+uintmax_t JKSNDecoderPrivate::decodeInt(Input &fp, size_t size) {
+    switch(size) {
+    case 1:
+        return uintmax_t(fp.get());
+    case 2:
+        {
+            const char *buffer = fp.read(2);
+            return uintmax_t(uint8_t(buffer[0])) << 8 |
+                   uintmax_t(uint8_t(buffer[1]));
+        }
+    case 4:
+        {
+            const char *buffer = fp.read(4);
+            return uintmax_t(uint8_t(buffer[0])) << 24 |
+                   uintmax_t(uint8_t(buffer[1])) << 16 |
+                   uintmax_t(uint8_t(buffer[2])) << 8 |
+                   uintmax_t(uint8_t(buffer[3]));
+        }
+    case 0:
+        {
+            uint8_t thisbyte;
+            uintmax_t result = 0;
+            do {
+                if(result & ~(~ uintmax_t(0) >> 7))
                     throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
+                thisbyte = fp.get();
+                result = (result << 7) | (thisbyte & 0x7f);
+            } while(thisbyte & 0x80);
+            return result;
+        }
+    default:
+        assert(size == 1 || size == 2 || size == 4 || size == 0);
+        abort();
+    }
+}
+
+template<typename Input>
+JKSNValue JKSNDecoderPrivate::parseFloat(Input &fp) {
+    static_assert(sizeof (float) == 4, "sizeof (float) should be 4");
+    const char *buffer = fp.read(4);
+    const union {
+        uint32_t data_int;
+        float data_float;
+    } conv = {
+        uint32_t(uint8_t(buffer[0])) << 24 |
+        uint32_t(uint8_t(buffer[1])) << 16 |
+        uint32_t(uint8_t(buffer[2])) << 8 |
+        uint32_t(uint8_t(buffer[3]))
+    };
+    return JKSNValue(conv.data_float);
+}
+
+template<typename Input>
+JKSNValue JKSNDecoderPrivate::parseDouble(Input &fp) {
+    static_assert(sizeof (double) == 8, "sizeof (double) should be 8");
+    const char *buffer = fp.read(8);
+    const union {
+        uint64_t data_int;
+        double data_double;
+    } conv = {
+        uint64_t(uint8_t(buffer[0])) << 56 |
+        uint64_t(uint8_t(buffer[1])) << 48 |
+        uint64_t(uint8_t(buffer[2])) << 40 |
+        uint64_t(uint8_t(buffer[3])) << 32 |
+        uint64_t(uint8_t(buffer[4])) << 24 |
+        uint64_t(uint8_t(buffer[5])) << 16 |
+        uint64_t(uint8_t(buffer[6])) << 8 |
+        uint64_t(uint8_t(buffer[7]))
+    };
+    return JKSNValue(conv.data_double);
+}
+
+template<typename Input>
+JKSNValue JKSNDecoderPrivate::parseLongDouble(Input &fp) {
+    if(sizeof (long double) == 12) {
+        const char *buffer = fp.read(10);
+        union {
+            uint8_t data_int[12];
+            long double data_long_double;
+        } conv;
+        if(isLittleEndian()) {
+            conv.data_int[0] = uint8_t(buffer[9]);
+            conv.data_int[1] = uint8_t(buffer[8]);
+            conv.data_int[2] = uint8_t(buffer[7]);
+            conv.data_int[3] = uint8_t(buffer[6]);
+            conv.data_int[4] = uint8_t(buffer[5]);
+            conv.data_int[5] = uint8_t(buffer[4]);
+            conv.data_int[6] = uint8_t(buffer[3]);
+            conv.data_int[7] = uint8_t(buffer[2]);
+            conv.data_int[8] = uint8_t(buffer[1]);
+            conv.data_int[9] = uint8_t(buffer[0]);
+            conv.data_int[10] = 0;
+            conv.data_int[11] = 0;
+        } else {
+            conv.data_int[0] = 0;
+            conv.data_int[1] = 0;
+            conv.data_int[2] = uint8_t(buffer[0]);
+            conv.data_int[3] = uint8_t(buffer[1]);
+            conv.data_int[4] = uint8_t(buffer[2]);
+            conv.data_int[5] = uint8_t(buffer[3]);
+            conv.data_int[6] = uint8_t(buffer[4]);
+            conv.data_int[7] = uint8_t(buffer[5]);
+            conv.data_int[8] = uint8_t(buffer[6]);
+            conv.data_int[9] = uint8_t(buffer[7]);
+            conv.data_int[10] = uint8_t(buffer[8]);
+            conv.data_int[11] = uint8_t(buffer[9]);
+        }
+        return JKSNValue(conv.data_long_double);
+    } else if(sizeof (long double) == 16) {
+        const char *buffer = fp.read(10);
+        union {
+            uint8_t data_int[16];
+            long double data_long_double;
+        } conv;
+        if(isLittleEndian()) {
+            conv.data_int[0] = uint8_t(buffer[9]);
+            conv.data_int[1] = uint8_t(buffer[8]);
+            conv.data_int[2] = uint8_t(buffer[7]);
+            conv.data_int[3] = uint8_t(buffer[6]);
+            conv.data_int[4] = uint8_t(buffer[5]);
+            conv.data_int[5] = uint8_t(buffer[4]);
+            conv.data_int[6] = uint8_t(buffer[3]);
+            conv.data_int[7] = uint8_t(buffer[2]);
+            conv.data_int[8] = uint8_t(buffer[1]);
+            conv.data_int[9] = uint8_t(buffer[0]);
+            conv.data_int[10] = 0;
+            conv.data_int[11] = 0;
+            conv.data_int[12] = 0;
+            conv.data_int[13] = 0;
+            conv.data_int[14] = 0;
+            conv.data_int[15] = 0;
+        } else {
+            conv.data_int[0] = 0;
+            conv.data_int[1] = 0;
+            conv.data_int[2] = 0;
+            conv.data_int[3] = 0;
+            conv.data_int[4] = 0;
+            conv.data_int[5] = 0;
+            conv.data_int[6] = uint8_t(buffer[0]);
+            conv.data_int[7] = uint8_t(buffer[1]);
+            conv.data_int[8] = uint8_t(buffer[2]);
+            conv.data_int[9] = uint8_t(buffer[3]);
+            conv.data_int[10] = uint8_t(buffer[4]);
+            conv.data_int[11] = uint8_t(buffer[5]);
+            conv.data_int[12] = uint8_t(buffer[6]);
+            conv.data_int[13] = uint8_t(buffer[7]);
+            conv.data_int[14] = uint8_t(buffer[8]);
+            conv.data_int[15] = uint8_t(buffer[9]);
+        }
+        return JKSNValue(conv.data_long_double);
+    } else
+        throw JKSNEncodeError("this build of JKSN decoder does not support long double numbers");
+}
+
+template<typename Input>
+JKSNValue JKSNDecoderPrivate::parseSwappedArray(Input &fp, size_t column_length) {
+    std::vector<JKSNValue> result;
+    while(column_length--) {
+        JKSNValue column_name = this->parseValue(fp);
+        JKSNValue column_values;
+        {
+            JKSNKeyContext context(this->cache, column_name);
+            column_values = this->parseValue(fp);
+        }
+        if(!column_values.isArray())
+            throw JKSNDecodeError("JKSN row-col swapped array requires an array but not found");
+        std::vector<JKSNValue> &column_values_vector = column_values.toVector();
+        for(size_t i = 0; i < column_values_vector.size(); ++i) {
+            if(i == result.size())
+                result.push_back(JKSNValue::fromObject(JKSNObject()));
+            if(!column_values_vector[i].isUnspecified())
+                result[i].toObject()[column_name] = std::move(column_values_vector[i]);
+        }
+    }
+    return JKSNValue(std::move(result));
+}
+
+
+static inline bool isLittleEndian() {
+    static const union {
+        uint16_t word;
+        uint8_t byte;
+    } endiantest = {1};
+    return endiantest.byte == 1;
+}
+
+/* Both are only called with a number other than 0 */
+static inline unsigned countLeadingZeros(uint64_t number) {
+#if defined(__GNUC__)
+    return unsigned(__builtin_clzll(number));
+#else
+    unsigned result = 0;
+    for(; !(number & (uint64_t(1) << 63)); number <<= 1)
+        ++result;
+    return result;
+#endif
+}
+
+static inline unsigned countTrailingZeros(uint64_t number) {
+#if defined(__GNUC__)
+    return unsigned(__builtin_ctzll(number));
+#else
+    unsigned result = 0;
+    for(; !(number & 1); number >>= 1)
+        ++result;
+    return result;
+#endif
+}
+
+static inline unsigned bitWidth(uint64_t number) {
+    return number == 0 ? 0 : 64 - countLeadingZeros(number);
+}
+
+/* Small negative numbers become small odd ones */
+static inline uint64_t zigzagEncode(int64_t number) {
+    return (uint64_t(number) << 1) ^ (number < 0 ? ~ uint64_t(0) : 0);
+}
+
+static inline int64_t zigzagDecode(uint64_t number) {
+    return int64_t((number >> 1) ^ (~ (number & 1) + 1));
+}
+
+static size_t UTF8SkipASCII(const char *data, size_t size) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    for(; i + 32 <= size; i += 32)
+        if(_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i))) != 0)
+            break;
+#endif
+#if defined(__SSE2__)
+    for(; i + 16 <= size; i += 16)
+        if(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i))) != 0)
+            break;
+#endif
+    for(; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        if((word & 0x8080808080808080ULL) != 0)
+            break;
+    }
+    for(; i < size; ++i)
+        if(uint8_t(data[i]) >= 0x80)
+            break;
+    return i;
+}
+
+static size_t UTF8DecodeSequence(const char *data, size_t size, uint32_t &ucs4) {
+    uint8_t lead = uint8_t(data[0]);
+    size_t length;
+    if(lead < 0xc0)
+        return 0;
+    else if(lead < 0xe0) {
+        length = 2;
+        ucs4 = lead & 0x1f;
+    } else if(lead < 0xf0) {
+        length = 3;
+        ucs4 = lead & 0xf;
+    } else if(lead < 0xf8) {
+        length = 4;
+        ucs4 = lead & 0x7;
+    } else
+        return 0;
+    if(size < length)
+        return 0;
+    for(size_t i = 1; i < length; ++i)
+        if((uint8_t(data[i]) & 0xc0) != 0x80)
+            return 0;
+        else
+            ucs4 = ucs4 << 6 | (uint8_t(data[i]) & 0x3f);
+    switch(length) {
+    case 2:
+        return ucs4 >= 0x80 ? 2 : 0;
+    case 3:
+        return ucs4 >= 0x800 && (ucs4 & 0xf800) != 0xd800 ? 3 : 0;
+    default:
+        return ucs4 >= 0x10000 && ucs4 < 0x110000 ? 4 : 0;
+    }
+}
+
+static size_t UTF8CountUTF16(const JKSNStringView &utf8str, size_t limit, bool strict, bool &valid) {
+    /* Stops early once limit code units are counted, or at the first invalid
+       byte when strict. Otherwise each invalid byte counts as U+FFFD. */
+    const char *data = utf8str.data();
+    size_t size = utf8str.size();
+    size_t i = 0;
+    size_t result = 0;
+    valid = true;
+    while(i < size && result < limit) {
+        size_t ascii = UTF8SkipASCII(data + i, std::min(size - i, limit - result));
+        i += ascii;
+        result += ascii;
+        while(i < size && result < limit && uint8_t(data[i]) >= 0x80) {
+            uint32_t ucs4;
+            size_t length = UTF8DecodeSequence(data + i, size - i, ucs4);
+            if(length != 0) {
+                i += length;
+                result += length == 4 ? 2 : 1;
+            } else if(strict) {
+                valid = false;
+                return result;
+            } else {
+                valid = false;
+                ++i;
+                ++result;
+            }
+        }
+    }
+    return result;
+}
+
+static bool UTF16IsShorter(const JKSNStringView &utf8str, size_t &utf16_length) {
+    /* Strings with half as many code units as bytes cannot be shorter in UTF-16,
+       so counting stops there, which covers ASCII after half of the string */
+    bool valid;
+    utf16_length = UTF8CountUTF16(utf8str, (utf8str.size() + 1)/2, true, valid);
+    return valid && utf16_length*2 < utf8str.size();
+}
+
+static void UTF8WriteUTF16LE(const JKSNStringView &utf8str, char *output) {
+    /* The output must have room for all code units counted by UTF8CountUTF16 */
+    const char *data = utf8str.data();
+    size_t size = utf8str.size();
+    size_t i = 0;
+    while(i < size) {
+#if defined(__SSE2__)
+        for(; i + 16 <= size; i += 16, output += 32) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            if(_mm_movemask_epi8(block) != 0)
                 break;
-            default:
-                this->cache.lastint = control & 0xf;
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(output), _mm_unpacklo_epi8(block, _mm_setzero_si128()));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(output + 16), _mm_unpackhi_epi8(block, _mm_setzero_si128()));
+        }
+        if(i == size)
+            break;
+#endif
+        uint32_t ucs4;
+        size_t length;
+        if(uint8_t(data[i]) < 0x80) {
+            ucs4 = uint8_t(data[i]);
+            length = 1;
+        } else if((length = UTF8DecodeSequence(data + i, size - i, ucs4)) == 0) {
+            ucs4 = 0xfffd;
+            length = 1;
+        }
+        if(ucs4 < 0x10000) {
+            *output++ = char(ucs4);
+            *output++ = char(ucs4 >> 8);
+        } else {
+            ucs4 -= 0x10000;
+            *output++ = char(ucs4 >> 10);
+            *output++ = char((ucs4 >> 18) | 0xd8);
+            *output++ = char(ucs4);
+            *output++ = char(((ucs4 >> 8) & 0x3) | 0xdc);
+        }
+        i += length;
+    }
+}
+
+static std::string UTF8ToUTF16LE(const JKSNStringView &utf8str, bool strict) {
+    bool valid;
+    size_t utf16_length = UTF8CountUTF16(utf8str, size_t(-1), strict, valid);
+    if(!valid && strict)
+        throw JKSNTypeError();
+    std::string utf16str(utf16_length*2, '\0');
+    UTF8WriteUTF16LE(utf8str, &utf16str[0]);
+    return utf16str;
+}
+
+static inline uint16_t UTF16LEUnit(const char *data, size_t index) {
+    return uint16_t(uint8_t(data[index*2]) | uint16_t(uint8_t(data[index*2+1])) << 8);
+}
+
+static size_t UTF16LECountUTF8(const char *data, size_t length) {
+    size_t result = 0;
+    size_t i = 0;
+    while(i < length) {
+#if defined(__SSE2__)
+        /* Blocks without surrogates take 1, 2 or 3 bytes per code unit */
+        for(; i + 8 <= length; i += 8) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i*2));
+            std::bitset<16> below_80(unsigned(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(block, _mm_set1_epi16(0x7f)), _mm_setzero_si128()))));
+            if(below_80.all()) {
+                result += 8;
+                continue;
             }
-            return JKSNValue(this->cache.lastint);
-        /* Floating point numbers */
-        case 0x20:
-            switch(control) {
-            case 0x20:
-                return JKSNValue(NAN);
-            case 0x2b:
-                return this->parseLongDouble(fp);
-            case 0x2c:
-                return this->parseDouble(fp);
-            case 0x2d:
-                return this->parseFloat(fp);
-            case 0x2e:
-                return JKSNValue(-INFINITY);
-            case 0x2f:
-                return JKSNValue(INFINITY);
+            if(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(block, _mm_set1_epi16(short(0xf800))), _mm_set1_epi16(short(0xd800)))) != 0)
+                break;
+            std::bitset<16> below_800(unsigned(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(block, _mm_set1_epi16(0x7ff)), _mm_setzero_si128()))));
+            result += 24 - (below_80.count() + below_800.count())/2;
+        }
+        if(i == length)
+            break;
+#endif
+        uint16_t unit = UTF16LEUnit(data, i);
+        if(unit < 0x80)
+            result += 1;
+        else if(unit < 0x800)
+            result += 2;
+        else if((unit & 0xfc00) == 0xd800 && i+1 < length && (UTF16LEUnit(data, i+1) & 0xfc00) == 0xdc00) {
+            result += 4;
+            ++i;
+        } else
+            result += 3;
+        ++i;
+    }
+    return result;
+}
+
+static char *UTF16LEWriteUTF8(const char *data, size_t length, char *output) {
+    /* The output must have room for UTF16LECountUTF8 bytes */
+    size_t i = 0;
+    while(i < length) {
+        size_t scalar_end = length;
+#if defined(__SSE2__)
+        /* Blocks of 8 code units that all encode to the same length are
+           converted at once, others fall back to the scalar code */
+        for(; i + 8 <= length; i += 8) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i*2));
+            int below_80 = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(block, _mm_set1_epi16(0x7f)), _mm_setzero_si128()));
+            if(below_80 == 0xffff) {
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(output), _mm_packus_epi16(block, block));
+                output += 8;
+                continue;
+            }
+            int below_800 = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(block, _mm_set1_epi16(0x7ff)), _mm_setzero_si128()));
+            __m128i trail = _mm_or_si128(_mm_and_si128(block, _mm_set1_epi16(0x3f)), _mm_set1_epi16(0x80));
+            if(below_800 == 0xffff && below_80 == 0) {
+                __m128i lead = _mm_or_si128(_mm_srli_epi16(block, 6), _mm_set1_epi16(0xc0));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(output), _mm_or_si128(lead, _mm_slli_epi16(trail, 8)));
+                output += 16;
+                continue;
+            }
+            if(below_800 == 0 && _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(block, _mm_set1_epi16(short(0xf800))), _mm_set1_epi16(short(0xd800)))) == 0) {
+                __m128i lead = _mm_or_si128(_mm_srli_epi16(block, 12), _mm_set1_epi16(0xe0));
+                __m128i middle = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(block, 6), _mm_set1_epi16(0x3f)), _mm_set1_epi16(0x80));
+                __m128i head = _mm_or_si128(lead, _mm_slli_epi16(middle, 8));
+                char sequences[32];
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(sequences), _mm_unpacklo_epi16(head, trail));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(sequences + 16), _mm_unpackhi_epi16(head, trail));
+                for(size_t j = 0; j < 8; ++j, output += 3)
+                    std::memcpy(output, sequences + j*4, 3);
+                continue;
             }
+            scalar_end = i + 8;
             break;
-        /* UTF-16 strings */
-        case 0x30:
-            {
-                size_t strsize;
-                switch(control) {
-                case 0x3c:
-                    {
-                        char hashvalue;
-                        if(!fp.get(hashvalue))
-                            throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                        if(this->cache.texthash[uint8_t(hashvalue)])
-                            return JKSNValue(*this->cache.texthash[uint8_t(hashvalue)]);
-                        else
-                            throw JKSNDecodeError("JKSN stream requires a non-existing hash");
-                    }
-                case 0x3d:
-                    strsize = this->decodeInt(fp, 2);
-                    break;
-                case 0x3e:
-                    strsize = this->decodeInt(fp, 1);
-                    break;
-                case 0x3f:
-                    strsize = this->decodeInt(fp, 0);
-                    break;
-                default:
-                    strsize = control & 0xf;
-                }
-                std::vector<char16_t> strbuf(strsize);
-                if(!fp.read(reinterpret_cast<char *>(strbuf.data()), std::streamsize(strsize*2)))
-                    throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                if(!isLittleEndian())
-                    for(char16_t &i : strbuf)
-                        i = char16_t(uint16_t(i) >> 8 | uint16_t(i) << 8);
-                std::string result = UTF16ToUTF8(std::u16string(strbuf.cbegin(), strbuf.cend()));
-                this->cache.texthash[DJBHash(result)].reset(new std::string(result));
-                return JKSNValue(std::move(result));
+        }
+#endif
+        while(i < scalar_end) {
+            uint16_t unit = UTF16LEUnit(data, i);
+            if(unit < 0x80)
+                *output++ = char(unit);
+            else if(unit < 0x800) {
+                *output++ = char(unit >> 6 | 0xc0);
+                *output++ = char((unit & 0x3f) | 0x80);
+            } else if((unit & 0xf800) != 0xd800) {
+                *output++ = char(unit >> 12 | 0xe0);
+                *output++ = char(((unit >> 6) & 0x3f) | 0x80);
+                *output++ = char((unit & 0x3f) | 0x80);
+            } else if((unit & 0xfc00) == 0xd800 && i+1 < length && (UTF16LEUnit(data, i+1) & 0xfc00) == 0xdc00) {
+                uint32_t ucs4 = (uint32_t(unit & 0x3ff) << 10 | (UTF16LEUnit(data, i+1) & 0x3ff)) + 0x10000;
+                *output++ = char(ucs4 >> 18 | 0xf0);
+                *output++ = char(((ucs4 >> 12) & 0x3f) | 0x80);
+                *output++ = char(((ucs4 >> 6) & 0x3f) | 0x80);
+                *output++ = char((ucs4 & 0x3f) | 0x80);
+                ++i;
+            } else {
+                std::memcpy(output, "\xef\xbf\xbd", 3);
+                output += 3;
             }
-        /* UTF-8 strings */
-        case 0x40:
-            {
-                size_t strsize;
-                switch(control) {
-                case 0x4d:
-                    strsize = this->decodeInt(fp, 2);
-                    break;
-                case 0x4e:
-                    strsize = this->decodeInt(fp, 1);
-                    break;
-                case 0x3f:
-                    strsize = this->decodeInt(fp, 0);
+            ++i;
+        }
+    }
+    return output;
+}
+
+static std::string UTF16LEToUTF8(const char *data, size_t length) {
+    std::string utf8str(UTF16LECountUTF8(data, length), '\0');
+    UTF16LEWriteUTF8(data, length, &utf8str[0]);
+    return utf8str;
+}
+
+static uint8_t DJBHash(const std::string &buf, uint8_t iv) {
+    return DJBHash(buf.data(), buf.size(), iv);
+}
+
+static uint8_t DJBHash(const char *buf, size_t size, uint8_t iv) {
+    unsigned int result = iv;
+    for(size_t i = 0; i < size; ++i)
+        result += (result << 5) + uint8_t(buf[i]);
+    return result;
+}
+
+static void storeHash(std::shared_ptr<std::string> &slot, const char *data, size_t size) {
+    /* Reuse the buffer of an entry nobody else refers to */
+    if(slot && slot.use_count() == 1)
+        slot->assign(data, size);
+    else
+        slot = std::make_shared<std::string>(data, size);
+}
+
+/* Slicing-by-8 tables for the CRC32 of zlib, table[0] is the classic one */
+static const std::array<std::array<uint32_t, 256>, 8> &CRC32Table() {
+    static const std::array<std::array<uint32_t, 256>, 8> table = [] {
+        std::array<std::array<uint32_t, 256>, 8> result;
+        for(uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for(int j = 0; j < 8; ++j)
+                crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+            result[0][i] = crc;
+        }
+        for(uint32_t i = 0; i < 256; ++i)
+            for(size_t j = 1; j < 8; ++j)
+                result[j][i] = (result[j-1][i] >> 8) ^ result[0][result[j-1][i] & 0xff];
+        return result;
+    }();
+    return table;
+}
+
+static const uint32_t SHA256Constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+JKSNChecksum::JKSNChecksum(uint8_t control) :
+    type(control & 0x7) {
+    static const uint32_t sha_initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    std::memcpy(this->sha_state, sha_initial, sizeof this->sha_state);
+}
+
+void JKSNChecksum::update(const char *data, size_t size) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    switch(this->type) {
+    case 0:
+        this->djb = DJBHash(data, size, this->djb);
+        break;
+    case 1:
+        {
+            const std::array<std::array<uint32_t, 256>, 8> &table = CRC32Table();
+            uint32_t crc = this->crc;
+            for(; size >= 8; size -= 8, bytes += 8) {
+                uint32_t low = crc ^ (uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 | uint32_t(bytes[2]) << 16 | uint32_t(bytes[3]) << 24);
+                crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^ table[5][(low >> 16) & 0xff] ^ table[4][low >> 24] ^
+                      table[3][bytes[4]] ^ table[2][bytes[5]] ^ table[1][bytes[6]] ^ table[0][bytes[7]];
+            }
+            for(; size != 0; --size, ++bytes)
+                crc = (crc >> 8) ^ table[0][(crc ^ *bytes) & 0xff];
+            this->crc = crc;
+        }
+        break;
+    case 4:
+        {
+            size_t used = size_t(this->sha_length % 64);
+            this->sha_length += size;
+            if(used != 0) {
+                size_t count = std::min(size, 64 - used);
+                std::memcpy(this->sha_block + used, bytes, count);
+                bytes += count;
+                size -= count;
+                if(used + count != 64)
                     break;
-                default:
-                    strsize = control & 0xf;
-                }
-                std::vector<char> strbuf(strsize);
-                if(!fp.read(strbuf.data(), std::streamsize(strsize)))
-                    throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                std::string result = std::string(strbuf.cbegin(), strbuf.cend());
-                this->cache.texthash[DJBHash(result)].reset(new std::string(result));
-                return JKSNValue(std::move(result));
+                this->shaTransform(this->sha_block);
+            }
+            for(; size >= 64; size -= 64, bytes += 64)
+                this->shaTransform(bytes);
+            std::memcpy(this->sha_block, bytes, size);
+        }
+        break;
+    }
+}
+
+std::string JKSNChecksum::digest() {
+    std::string result;
+    switch(this->type) {
+    case 0:
+        result.push_back(char(this->djb));
+        break;
+    case 1:
+        for(int shift = 24; shift >= 0; shift -= 8)
+            result.push_back(char(uint8_t(~this->crc >> shift)));
+        break;
+    case 4:
+        {
+            uint64_t bit_length = this->sha_length * 8;
+            static const char padding[64] = {'\x80'};
+            this->update(padding, 1 + (119 - size_t(this->sha_length % 64)) % 64);
+            char length[8];
+            for(int i = 0; i < 8; ++i)
+                length[i] = char(uint8_t(bit_length >> (56 - i*8)));
+            this->update(length, 8);
+            for(uint32_t word : this->sha_state)
+                for(int shift = 24; shift >= 0; shift -= 8)
+                    result.push_back(char(uint8_t(word >> shift)));
+        }
+        break;
+    }
+    return result;
+}
+
+void JKSNChecksum::verify(const char *expected) {
+    if(this->type == 0 || this->type == 1 || this->type == 4) {
+        std::string actual = this->digest();
+        if(std::memcmp(actual.data(), expected, actual.size()) != 0)
+            throw JKSNChecksumError();
+    }
+}
+
+void JKSNChecksum::shaTransform(const uint8_t *block) {
+    uint32_t w[64];
+    for(size_t i = 0; i < 16; ++i)
+        w[i] = uint32_t(block[i*4]) << 24 | uint32_t(block[i*4+1]) << 16 | uint32_t(block[i*4+2]) << 8 | uint32_t(block[i*4+3]);
+    auto rotr = [](uint32_t x, int n) {
+        return (x >> n) | (x << (32 - n));
+    };
+    for(size_t i = 16; i < 64; ++i) {
+        uint32_t s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+        uint32_t s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+    uint32_t a = this->sha_state[0], b = this->sha_state[1], c = this->sha_state[2], d = this->sha_state[3];
+    uint32_t e = this->sha_state[4], f = this->sha_state[5], g = this->sha_state[6], h = this->sha_state[7];
+    for(size_t i = 0; i < 64; ++i) {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256Constants[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    this->sha_state[0] += a;
+    this->sha_state[1] += b;
+    this->sha_state[2] += c;
+    this->sha_state[3] += d;
+    this->sha_state[4] += e;
+    this->sha_state[5] += f;
+    this->sha_state[6] += g;
+    this->sha_state[7] += h;
+}
+
+const std::map<JKSNValue, JKSNValue> JKSNValue::toMap() const {
+    return this->toObject().toMap();
+}
+
+bool JKSNValue::toBool() const {
+    switch(this->getType()) {
+    case JKSN_BOOL:
+        return this->data_bool;
+    case JKSN_UNDEFINED:
+    case JKSN_NULL:
+        return false;
+    case JKSN_INT:
+        return this->data_int != 0;
+    case JKSN_FLOAT:
+        return this->data_float != 0.0f;
+    case JKSN_DOUBLE:
+        return this->data_double != 0.0;
+    case JKSN_LONG_DOUBLE:
+        return this->data_long_double != 0.0L;
+    case JKSN_STRING:
+    case JKSN_BLOB:
+        return !this->toStringView().empty();
+    case JKSN_ARRAY:
+        return !this->data_array->empty();
+    case JKSN_OBJECT:
+        return !this->data_object->empty();
+    default:
+        throw JKSNTypeError();
+    }
+};
+
+intmax_t JKSNValue::toInt() const {
+    switch(this->getType()) {
+    case JKSN_INT:
+        return this->data_int;
+    case JKSN_BOOL:
+        return this->data_bool;
+    case JKSN_FLOAT:
+        return this->data_float;
+    case JKSN_DOUBLE:
+        return this->data_double;
+    case JKSN_LONG_DOUBLE:
+        return this->data_long_double;
+    case JKSN_NULL:
+        return 0;
+    case JKSN_STRING:
+        try {
+            return std::stoll(this->toStringView().toString());
+        } catch(std::invalid_argument) {
+            throw JKSNTypeError();
+        } catch(std::out_of_range) {
+            throw JKSNTypeError();
+        }
+    default:
+        throw JKSNTypeError();
+    }
+}
+
+template<typename T>
+T JKSNValue::toNumber() const {
+    switch(this->getType()) {
+    case JKSN_FLOAT:
+        return this->data_float;
+    case JKSN_DOUBLE:
+        return this->data_double;
+    case JKSN_LONG_DOUBLE:
+        return this->data_long_double;
+    case JKSN_INT:
+        return this->data_int;
+    case JKSN_BOOL:
+        return this->data_bool;
+    case JKSN_NULL:
+        return 0;
+    case JKSN_STRING:
+        try {
+            return std::stoll(this->toStringView().toString());
+        } catch(std::invalid_argument) {
+            return NAN;
+        } catch(std::out_of_range) {
+            return NAN;
+        }
+    default:
+        return NAN;
+    }
+}
+
+std::string JKSNValue::toString() const {
+    switch(this->getType()) {
+    case JKSN_UNDEFINED:
+        return "undefined";
+    case JKSN_NULL:
+        return "null";
+    case JKSN_BOOL:
+        return this->data_bool ? "true" : "false";
+    case JKSN_INT:
+        return std::to_string(this->data_int);
+    case JKSN_FLOAT:
+        if(std::isnan(this->data_float))
+            return "NaN";
+        else if(std::isinf(this->data_float))
+            return this->data_float >= 0 ? "Infinity" : "-Infinity";
+        else
+            return std::to_string(this->data_float);
+    case JKSN_DOUBLE:
+        if(std::isnan(this->data_double))
+            return "NaN";
+        else if(std::isinf(this->data_double))
+            return this->data_double >= 0 ? "Infinity" : "-Infinity";
+        else
+            return std::to_string(this->data_double);
+    case JKSN_LONG_DOUBLE:
+        if(std::isnan(this->data_long_double))
+            return "NaN";
+        else if(std::isinf(this->data_long_double))
+            return this->data_long_double >= 0 ? "Infinity" : "-Infinity";
+        else
+            return std::to_string(this->data_long_double);
+    case JKSN_STRING:
+    case JKSN_BLOB:
+        return this->toStringView().toString();
+    case JKSN_ARRAY:
+        {
+            std::string res;
+            bool first = true;
+            for(const JKSNValue &i : *this->data_array) {
+                if(!first)
+                    res.append(1, ',');
+                first = false;
+                res.append(i.toString());
+            }
+            return res;
+        }
+    case JKSN_OBJECT:
+        return "[object Object]";
+    default:
+        throw JKSNTypeError();
+    }
+}
+
+bool JKSNValue::operator==(const JKSNValue &that) const {
+    jksn_data_type this_type = this->getType();
+    jksn_data_type that_type = that.getType();
+    if(this_type == that_type || (this->isNumber() && that.isNumber()))
+        switch(this_type) {
+        case JKSN_BOOL:
+            return this->toBool() == that.toBool();
+        case JKSN_INT:
+            switch(that_type) {
+            case JKSN_INT:
+                return this->toInt() == that.toInt();
+            case JKSN_FLOAT:
+                return this->toFloat() == that.toFloat();
+            case JKSN_DOUBLE:
+                return this->toDouble() == that.toDouble();
+            case JKSN_LONG_DOUBLE:
+                return this->toLongDouble() == that.toLongDouble();
+            default:
+                assert(that.isNumber());
+                throw std::logic_error("unknown error occured during value comparision");
             }
-        /* Blob strings */
-        case 0x50:
-            {
-                size_t strsize;
-                switch(control) {
-                case 0x5c:
-                    {
-                        char hashvalue;
-                        if(!fp.get(hashvalue))
-                            throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                        if(this->cache.blobhash[uint8_t(hashvalue)])
-                            return JKSNValue(*this->cache.blobhash[uint8_t(hashvalue)]);
-                        else
-                            throw JKSNDecodeError("JKSN stream requires a non-existing hash");
-                    }
-                case 0x5d:
-                    strsize = this->decodeInt(fp, 2);
-                    break;
-                case 0x5e:
-                    strsize = this->decodeInt(fp, 1);
-                    break;
-                case 0x5f:
-                    strsize = this->decodeInt(fp, 0);
-                    break;
-                default:
-                    strsize = control & 0xf;
-                }
-                std::vector<char> strbuf(strsize);
-                if(!fp.read(strbuf.data(), std::streamsize(strsize)))
-                    throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                std::string result = std::string(strbuf.cbegin(), strbuf.cend());
-                this->cache.blobhash[DJBHash(result)].reset(new std::string(result));
-                return JKSNValue(std::move(result), true);
+        case JKSN_FLOAT:
+            switch(that_type) {
+            case JKSN_INT:
+            case JKSN_FLOAT:
+                return this->toFloat() == that.toFloat();
+            case JKSN_DOUBLE:
+                return this->toDouble() == that.toDouble();
+            case JKSN_LONG_DOUBLE:
+                return this->toLongDouble() == that.toLongDouble();
+            default:
+                assert(that.isNumber());
+                throw std::logic_error("unknown error occured during value comparision");
             }
-        /* Hashtable refreshers */
-        case 0x70:
-            {
-                size_t objlen;
-                switch(control) {
-                case 0x70:
-                    this->cache.texthash.fill(nullptr);
-                    this->cache.texthash.fill(nullptr);
-                    continue;
-                case 0x7d:
-                    objlen = this->decodeInt(fp, 2);
-                    break;
-                case 0x7e:
-                    objlen = this->decodeInt(fp, 1);
-                    break;
-                case 0x7f:
-                    objlen = this->decodeInt(fp, 0);
-                    break;
-                default:
-                    objlen = control & 0xf;
-                }
-                while(objlen--)
-                    this->parseValue(fp);
-                continue;
+        case JKSN_DOUBLE:
+            switch(that_type) {
+            case JKSN_INT:
+            case JKSN_FLOAT:
+            case JKSN_DOUBLE:
+                return this->toDouble() == that.toDouble();
+            case JKSN_LONG_DOUBLE:
+                return this->toLongDouble() == that.toLongDouble();
+            default:
+                assert(that.isNumber());
+                throw std::logic_error("unknown error occured during value comparision");
             }
-        /* Arrays */
-        case 0x80:
-            {
-                size_t objlen;
-                switch(control) {
-                case 0x8d:
-                    objlen = this->decodeInt(fp, 2);
-                    break;
-                case 0x8e:
-                    objlen = this->decodeInt(fp, 1);
-                    break;
-                case 0x8f:
-                    objlen = this->decodeInt(fp, 0);
-                    break;
-                default:
-                    objlen = control & 0xf;
-                }
-                std::vector<JKSNValue> result;
-                result.reserve(objlen);
-                while(objlen--)
-                    result.push_back(this->parseValue(fp));
-                return JKSNValue(std::move(result));
+        case JKSN_LONG_DOUBLE:
+            switch(that_type) {
+            case JKSN_INT:
+            case JKSN_FLOAT:
+            case JKSN_DOUBLE:
+            case JKSN_LONG_DOUBLE:
+                return this->toLongDouble() == that.toLongDouble();
+            default:
+                assert(that.isNumber());
+                throw std::logic_error("unknown error occured during value comparision");
             }
-        /* Objects */
-        case 0x90:
+        case JKSN_STRING:
+        case JKSN_BLOB:
+            return this->toStringView() == that.toStringView();
+        case JKSN_ARRAY:
             {
-                size_t objlen;
-                switch(control) {
-                case 0x9d:
-                    objlen = this->decodeInt(fp, 2);
-                    break;
-                case 0x9e:
-                    objlen = this->decodeInt(fp, 1);
-                    break;
-                case 0x9f:
-                    objlen = this->decodeInt(fp, 0);
-                    break;
-                default:
-                    objlen = control & 0xf;
-                }
-                std::map<JKSNValue, JKSNValue> result;
-                while(objlen--) {
-                    JKSNValue key = this->parseValue(fp);
-                    result[std::move(key)] = this->parseValue(fp);
+                const std::vector<JKSNValue> &this_vector = this->toVector();
+                const std::vector<JKSNValue> &that_vector = that.toVector();
+                if(this_vector.size() != that_vector.size())
+                    return false;
+                else {
+                    for(auto this_iter = this_vector.cbegin(), that_iter = that_vector.cbegin();
+                        this_iter != this_vector.end(); ++this_iter, ++that_iter)
+                    if(*this_iter != *that_iter)
+                        return false;
+                    return true;
                 }
-                return JKSNValue(std::move(result));
             }
-        /* Row-col swapped arrays */
-        case 0xa0:
-            {
-                size_t collen;
-                switch(control) {
-                case 0xa0:
-                    return JKSNValue::fromUnspecified();
-                case 0xad:
-                    collen = this->decodeInt(fp, 2);
-                    break;
-                case 0xae:
-                    collen = this->decodeInt(fp, 1);
-                    break;
-                case 0xaf:
-                    collen = this->decodeInt(fp, 0);
-                    break;
-                default:
-                    collen = control & 0xf;
-                }
-                return this->parseSwappedArray(fp, collen);
+        case JKSN_OBJECT:
+            return this->toObject() == that.toObject();
+        default:
+            return true;
+    } else
+        return this_type == that_type;
+}
+
+bool JKSNValue::operator<(const JKSNValue &that) const {
+    jksn_data_type this_type = this->getType();
+    jksn_data_type that_type = that.getType();
+    if(this_type == that_type || (this->isNumber() && that.isNumber()))
+        switch(this_type) {
+        case JKSN_BOOL:
+            return this->toBool() < that.toBool();
+        case JKSN_INT:
+            switch(that_type) {
+            case JKSN_INT:
+                return this->toInt() < that.toInt();
+            case JKSN_FLOAT:
+                return this->toFloat() < that.toFloat();
+            case JKSN_DOUBLE:
+                return this->toDouble() < that.toDouble();
+            case JKSN_LONG_DOUBLE:
+                return this->toLongDouble() < that.toLongDouble();
+            default:
+                assert(that.isNumber());
+                throw std::logic_error("unknown error occured during value comparision");
             }
-        case 0xc0:
-            switch(control) {
-            /* Lengthless arrays */
-            case 0xc8:
-                {
-                    std::vector<JKSNValue> result;
-                    for(;;) {
-                        JKSNValue item = this->parseValue(fp);
-                        if(!item.isUnspecified())
-                            result.push_back(std::move(item));
-                        else
-                            return JKSNValue(std::move(result));
-                    }
-                    break;
-                }
-            /* Padding byte */
-            case 0xca:
-                continue;
+        case JKSN_FLOAT:
+            switch(that_type) {
+            case JKSN_INT:
+            case JKSN_FLOAT:
+                return this->toFloat() < that.toFloat();
+            case JKSN_DOUBLE:
+                return this->toDouble() < that.toDouble();
+            case JKSN_LONG_DOUBLE:
+                return this->toLongDouble() < that.toLongDouble();
+            default:
+                assert(that.isNumber());
+                throw std::logic_error("unknown error occured during value comparision");
             }
-            break;
-        /* Delta encoded integers */
-        case 0xd0:
-            {
-                intmax_t delta;
-                switch(control) {
-                case 0xd0: case 0xd1: case 0xd2: case 0xd3: case 0xd4: case 0xd5:
-                    delta = control & 0xf;
-                    break;
-                case 0xd6: case 0xd7: case 0xd8: case 0xd9: case 0xda:
-                    delta = intmax_t(control & 0xf)-11;
-                    break;
-                case 0xdb:
-                    delta = intmax_t(int32_t(this->decodeInt(fp, 4)));
-                    break;
-                case 0xdc:
-                    delta = intmax_t(int16_t(this->decodeInt(fp, 2)));
-                    break;
-                case 0xdd:
-                    delta = intmax_t(int8_t(this->decodeInt(fp, 1)));
-                    break;
-                case 0xde:
-                    delta = -intmax_t(this->decodeInt(fp, 0));
-                    if(delta >= 0)
-                        throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
-                    break;
-                case 0xdf:
-                    delta = intmax_t(this->decodeInt(fp, 0));
-                    if(delta < 0)
-                        throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
-                    break;
-                }
-                if(!this->cache.haslastint)
-                    throw JKSNDecodeError("JKSN stream contains an invalid delta encoded integer");
-                this->cache.haslastint = true;
-                this->cache.lastint += delta;
-                return JKSNValue(this->cache.lastint);
+        case JKSN_DOUBLE:
+            switch(that_type) {
+            case JKSN_INT:
+            case JKSN_FLOAT:
+            case JKSN_DOUBLE:
+                return this->toDouble() < that.toDouble();
+            case JKSN_LONG_DOUBLE:
+                return this->toLongDouble() < that.toLongDouble();
+            default:
+                assert(that.isNumber());
+                throw std::logic_error("unknown error occured during value comparision");
             }
-        case 0xf0:
-            /* Ignore checksums */
-            if(control <= 0xf5) {
-                std::vector<char> buf;
-                switch(control) {
-                case 0xf0:
-                    buf.reserve(1);
-                    if(!fp.read(buf.data(), 1))
-                        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                    continue;
-                case 0xf1:
-                    buf.reserve(4);
-                    if(!fp.read(buf.data(), 4))
-                        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                    continue;
-                case 0xf2:
-                    buf.reserve(16);
-                    if(!fp.read(buf.data(), 16))
-                        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                    continue;
-                case 0xf3:
-                    buf.reserve(20);
-                    if(!fp.read(buf.data(), 20))
-                        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                    continue;
-                case 0xf4:
-                    buf.reserve(32);
-                    if(!fp.read(buf.data(), 32))
-                        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                    continue;
-                case 0xf5:
-                    buf.reserve(64);
-                    if(!fp.read(buf.data(), 64))
-                        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                    continue;
-                }
-            } else if (control >= 0xf8 && control <= 0xfd) {
-                std::vector<char> buf;
-                JKSNValue result;
-                switch(control) {
-                case 0xf8:
-                    result = parseValue(fp);
-                    buf.reserve(1);
-                    if(!fp.read(buf.data(), 1))
-                        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                    continue;
-                case 0xf9:
-                    result = parseValue(fp);
-                    buf.reserve(4);
-                    if(!fp.read(buf.data(), 4))
-                        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                    continue;
-                case 0xfa:
-                    result = parseValue(fp);
-                    buf.reserve(16);
-                    if(!fp.read(buf.data(), 16))
-                        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                    continue;
-                case 0xfb:
-                    result = parseValue(fp);
-                    buf.reserve(20);
-                    if(!fp.read(buf.data(), 20))
-                        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                    continue;
-                case 0xfc:
-                    result = parseValue(fp);
-                    buf.reserve(32);
-                    if(!fp.read(buf.data(), 32))
-                        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                    continue;
-                case 0xfd:
-                    result = parseValue(fp);
-                    buf.reserve(64);
-                    if(!fp.read(buf.data(), 64))
-                        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                    continue;
+        case JKSN_LONG_DOUBLE:
+            switch(that_type) {
+            case JKSN_INT:
+            case JKSN_FLOAT:
+            case JKSN_DOUBLE:
+            case JKSN_LONG_DOUBLE:
+                return this->toLongDouble() < that.toLongDouble();
+            default:
+                assert(that.isNumber());
+                throw std::logic_error("unknown error occured during value comparision");
+            }
+        case JKSN_STRING:
+        case JKSN_BLOB:
+            return this->toStringView() < that.toStringView();
+        case JKSN_ARRAY:
+            {
+                const std::vector<JKSNValue> &this_vector = this->toVector();
+                const std::vector<JKSNValue> &that_vector = that.toVector();
+                auto this_iter = this_vector.cbegin();
+                auto that_iter = that_vector.cbegin();
+                for(; this_iter != this_vector.cend(); ++this_iter, ++that_iter) {
+                    if(that_iter == that_vector.cend())
+                        return false;
+                    else if(*this_iter < *that_iter)
+                        return true;
+                    else if(*this_iter != *that_iter) /* > */
+                        return false;
                 }
-                return result;
-            /* Ignore pragmas */
-            } else if(control == 0xff) {
-                parseValue(fp);
-                continue;
+                return that_iter != that_vector.cend();
             }
+        case JKSN_OBJECT:
+            /* Members are ordered by key, as they would be in a std::map */
+            return this->toMap() < that.toMap();
+        default:
+            return false;
         }
-        throw JKSNDecodeError("cannot encode unrecognizable type of value");
+    else
+        return this_type < that_type;
+}
+
+JKSNValue &JKSNValue::operator=(const JKSNValue &that) {
+    if(this != &that) {
+        union {
+            std::string *new_string = nullptr;
+            std::vector<JKSNValue> *new_array;
+            JKSNObject *new_object;
+        } new_data;
+        switch(that.getType()) {
+        case JKSN_BOOL:
+            this->data_bool = that.toBool();
+            break;
+        case JKSN_INT:
+            this->data_int = that.toInt();
+            break;
+        case JKSN_FLOAT:
+            this->data_float = that.toFloat();
+            break;
+        case JKSN_DOUBLE:
+            this->data_double = that.toDouble();
+            break;
+        case JKSN_LONG_DOUBLE:
+            this->data_long_double = that.toLongDouble();
+            break;
+        case JKSN_STRING:
+        case JKSN_BLOB:
+            if(that.data_short_size == long_string)
+                new_data.new_string = new std::string(*that.data_string);
+            break;
+        case JKSN_ARRAY:
+            new_data.new_array = new std::vector<JKSNValue>(that.toVector());
+            break;
+        case JKSN_OBJECT:
+            new_data.new_object = new JKSNObject(that.toObject());
+            break;
+        default:
+            break;
+        }
+        this->~JKSNValue();
+        switch((this->data_type = that.getType())) {
+        case JKSN_STRING:
+        case JKSN_BLOB:
+            if(that.data_short_size == long_string)
+                this->data_string = new_data.new_string;
+            else
+                std::char_traits<char>::copy(this->data_short, that.data_short, that.data_short_size);
+            this->data_short_size = that.data_short_size;
+            break;
+        case JKSN_ARRAY:
+            this->data_array = new_data.new_array;
+            break;
+        case JKSN_OBJECT:
+            this->data_object = new_data.new_object;
+            break;
+        default:
+            break;
+        }
+    }
+    return *this;
+}
+
+JKSNValue &JKSNValue::operator=(JKSNValue &&that) {
+    if(this != &that) {
+        this->~JKSNValue();
+        switch(that.getType()) {
+        case JKSN_BOOL:
+            this->data_bool = that.toBool();
+            break;
+        case JKSN_INT:
+            this->data_int = that.toInt();
+            break;
+        case JKSN_FLOAT:
+            this->data_float = that.toFloat();
+            break;
+        case JKSN_DOUBLE:
+            this->data_double = that.toDouble();
+            break;
+        case JKSN_LONG_DOUBLE:
+            this->data_long_double = that.toLongDouble();
+            break;
+        case JKSN_STRING:
+        case JKSN_BLOB:
+            if(that.data_short_size == long_string)
+                this->data_string = that.data_string;
+            else
+                std::char_traits<char>::copy(this->data_short, that.data_short, that.data_short_size);
+            this->data_short_size = that.data_short_size;
+            break;
+        case JKSN_ARRAY:
+            this->data_array = that.data_array;
+            break;
+        case JKSN_OBJECT:
+            this->data_object = that.data_object;
+            break;
+        default:
+            break;
+        }
+        this->data_type = that.data_type;
+        that.data_type = JKSN_UNDEFINED;
+    }
+    return *this;
+}
+
+JKSNObject::JKSNObject() {
+}
+
+JKSNObject::JKSNObject(const std::map<JKSNValue, JKSNValue> &data) {
+    this->reserve(data.size());
+    for(const std::pair<const JKSNValue, JKSNValue> &item : data)
+        this->append(value_type(item.first, item.second));
+}
+
+JKSNObject::JKSNObject(std::initializer_list<std::pair<const JKSNValue, JKSNValue> > data) {
+    this->reserve(data.size());
+    for(const std::pair<const JKSNValue, JKSNValue> &item : data)
+        this->insert(value_type(item.first, item.second));
+}
+
+JKSNObject::JKSNObject(const JKSNObject &that) :
+    items(that.items),
+    index(that.index) {
+}
+
+JKSNObject::JKSNObject(JKSNObject &&that) :
+    items(std::move(that.items)),
+    index(std::move(that.index)) {
+    that.items.clear();
+    that.index.clear();
+}
+
+JKSNObject &JKSNObject::operator=(const JKSNObject &that) {
+    if(this != &that) {
+        this->items = that.items;
+        this->index = that.index;
+    }
+    return *this;
+}
+
+JKSNObject &JKSNObject::operator=(JKSNObject &&that) {
+    if(this != &that) {
+        this->items = std::move(that.items);
+        this->index = std::move(that.index);
+        that.items.clear();
+        that.index.clear();
+    }
+    return *this;
+}
+
+JKSNObject::~JKSNObject() {
+}
+
+void JKSNObject::reserve(size_t size) {
+    this->items.reserve(size);
+}
+
+void JKSNObject::clear() {
+    this->items.clear();
+    this->index.clear();
+}
+
+JKSNObject::iterator JKSNObject::find(const JKSNValue &key) {
+    return this->items.begin() + std::ptrdiff_t(this->lookup(key));
+}
+
+JKSNObject::const_iterator JKSNObject::find(const JKSNValue &key) const {
+    return this->items.cbegin() + std::ptrdiff_t(this->lookup(key));
+}
+
+size_t JKSNObject::count(const JKSNValue &key) const {
+    return this->lookup(key) != this->items.size() ? 1 : 0;
+}
+
+JKSNValue &JKSNObject::at(const JKSNValue &key) {
+    iterator it = this->find(key);
+    if(it != this->end())
+        return it->second;
+    else
+        throw std::out_of_range("JKSN object key not found");
+}
+
+const JKSNValue &JKSNObject::at(const JKSNValue &key) const {
+    const_iterator it = this->find(key);
+    if(it != this->end())
+        return it->second;
+    else
+        throw std::out_of_range("JKSN object key not found");
+}
+
+JKSNValue &JKSNObject::operator[](const JKSNValue &key) {
+    iterator it = this->find(key);
+    if(it != this->end())
+        return it->second;
+    else
+        return this->append(value_type(key, JKSNValue()))->second;
+}
+
+JKSNValue &JKSNObject::operator[](JKSNValue &&key) {
+    iterator it = this->find(key);
+    if(it != this->end())
+        return it->second;
+    else
+        return this->append(value_type(std::move(key), JKSNValue()))->second;
+}
+
+std::pair<JKSNObject::iterator, bool> JKSNObject::insert(const value_type &item) {
+    iterator it = this->find(item.first);
+    if(it != this->end())
+        return std::make_pair(it, false);
+    else
+        return std::make_pair(this->append(value_type(item)), true);
+}
+
+std::pair<JKSNObject::iterator, bool> JKSNObject::insert(value_type &&item) {
+    iterator it = this->find(item.first);
+    if(it != this->end())
+        return std::make_pair(it, false);
+    else
+        return std::make_pair(this->append(std::move(item)), true);
+}
+
+JKSNObject::iterator JKSNObject::erase(const_iterator pos) {
+    size_t position = size_t(pos - this->items.cbegin());
+    this->items.erase(this->items.begin() + std::ptrdiff_t(position));
+    if(!this->index.empty())
+        this->rebuildIndex();
+    return this->items.begin() + std::ptrdiff_t(position);
+}
+
+size_t JKSNObject::erase(const JKSNValue &key) {
+    const_iterator it = this->find(key);
+    if(it != this->cend()) {
+        this->erase(it);
+        return 1;
+    } else
+        return 0;
+}
+
+std::map<JKSNValue, JKSNValue> JKSNObject::toMap() const {
+    return std::map<JKSNValue, JKSNValue>(this->items.cbegin(), this->items.cend());
+}
+
+bool JKSNObject::operator==(const JKSNObject &that) const {
+    if(this->size() != that.size())
+        return false;
+    for(const value_type &item : this->items) {
+        const_iterator it = that.find(item.first);
+        if(it == that.end() || it->second != item.second)
+            return false;
+    }
+    return true;
+}
+
+size_t JKSNObject::hashKey(const JKSNValue &key) {
+    if(key.isStringOrBlob()) {
+        /* FNV-1a, which avoids copying the key into a std::string */
+        JKSNStringView str = key.toStringView();
+        uint64_t result = 0xcbf29ce484222325;
+        for(char c : str)
+            result = (result ^ uint8_t(c)) * 0x100000001b3;
+        return size_t(result ^ (result >> 32));
+    } else
+        return std::hash<JKSNValue>()(key);
+}
+
+size_t JKSNObject::lookup(const JKSNValue &key) const {
+    if(this->index.empty()) {
+        for(size_t i = 0; i < this->items.size(); ++i)
+            if(this->items[i].first == key)
+                return i;
+    } else {
+        size_t mask = this->index.size() - 1;
+        for(size_t slot = hashKey(key) & mask; this->index[slot] != 0; slot = (slot + 1) & mask)
+            if(this->items[this->index[slot] - 1].first == key)
+                return this->index[slot] - 1;
     }
+    return this->items.size();
+}
+
+JKSNObject::iterator JKSNObject::append(value_type &&item) {
+    /* Objects with a few members are searched linearly, where hashing does not pay off */
+    static const size_t max_linear_search = 16;
+    this->items.push_back(std::move(item));
+    if(this->index.empty() ? this->items.size() > max_linear_search : this->items.size()*2 > this->index.size())
+        this->rebuildIndex();
+    else if(!this->index.empty()) {
+        size_t mask = this->index.size() - 1;
+        size_t slot = hashKey(this->items.back().first) & mask;
+        while(this->index[slot] != 0)
+            slot = (slot + 1) & mask;
+        this->index[slot] = this->items.size();
+    }
+    return this->items.end() - 1;
+}
+
+void JKSNObject::rebuildIndex() {
+    size_t index_size = 32;
+    while(index_size < this->items.size()*4)
+        index_size *= 2;
+    this->index.assign(index_size, 0);
+    size_t mask = index_size - 1;
+    for(size_t i = 0; i < this->items.size(); ++i) {
+        size_t slot = hashKey(this->items[i].first) & mask;
+        while(this->index[slot] != 0)
+            slot = (slot + 1) & mask;
+        this->index[slot] = i + 1;
+    }
+}
+
+
+JKSNDocument::JKSNDocument() :
+    p(new JKSNDocumentPrivate) {
+}
+
+JKSNDocument::JKSNDocument(bool copy_strings) :
+    p(new JKSNDocumentPrivate) {
+    this->p->copy_strings = copy_strings;
+}
+
+JKSNDocument::JKSNDocument(JKSNDocument &&that) :
+    p(std::move(that.p)) {
+}
+
+JKSNDocument &JKSNDocument::operator=(JKSNDocument &&that) {
+    if(this != &that)
+        this->p = std::move(that.p);
+    return *this;
+}
+
+JKSNDocument::~JKSNDocument() {
+}
+
+JKSNView JKSNDocument::root() const {
+    return JKSNView(this->p ? this->p->root : nullptr);
+}
+
+size_t JKSNDocument::bytesParsed() const {
+    return this->p ? this->p->bytes_parsed : 0;
+}
+
+size_t JKSNDocument::capacity() const {
+    return this->p ? this->p->arena.capacity() : 0;
+}
+
+void JKSNDocument::clear() {
+    if(this->p)
+        this->p->clear();
+    else
+        this->p.reset(new JKSNDocumentPrivate);
+}
+
+JKSNIndex::JKSNIndex() :
+    p(new JKSNIndexPrivate) {
+}
+
+JKSNIndex::JKSNIndex(JKSNIndex &&that) :
+    p(std::move(that.p)) {
+}
+
+JKSNIndex &JKSNIndex::operator=(JKSNIndex &&that) {
+    if(this != &that)
+        this->p = std::move(that.p);
+    return *this;
 }
 
-uintmax_t JKSNDecoderPrivate::decodeInt(std::istream &fp, size_t size) {
-    switch(size) {
-    case 1:
-        {
-            char buffer;
-            if(!fp.get(buffer))
-                throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-            return uintmax_t(uint8_t(buffer));
-        }
-    case 2:
-        {
-            char buffer[2];
-            if(!fp.read(buffer, 2))
-                throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-            return uintmax_t(uint8_t(buffer[0])) << 8 |
-                   uintmax_t(uint8_t(buffer[1]));
-        }
-    case 4:
-        {
-            char buffer[4];
-            if(!fp.read(buffer, 4))
-                throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-            return uintmax_t(uint8_t(buffer[0])) << 24 |
-                   uintmax_t(uint8_t(buffer[1])) << 16 |
-                   uintmax_t(uint8_t(buffer[2])) << 8 |
-                   uintmax_t(uint8_t(buffer[3]));
-        }
-    case 0:
-        {
-            char thisbyte;
-            uintmax_t result = 0;
-            do {
-                if(result & ~(~ uintmax_t(0) >> 7))
-                    throw JKSNDecodeError("this build of JKSN decoder does not support variable length integers");
-                if(!fp.get(thisbyte))
-                    throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-                result = (result << 7) | (uint8_t(thisbyte) & 0x7f);
-            } while(uint8_t(thisbyte) & 0x80);
-            return result;
-        }
-    default:
-        assert(size == 1 || size == 2 || size == 4 || size == 0);
-        abort();
-    }
+JKSNIndex::~JKSNIndex() {
 }
 
-JKSNValue JKSNDecoderPrivate::parseFloat(std::istream &fp) {
-    static_assert(sizeof (float) == 4, "sizeof (float) should be 4");
-    char buffer[4];
-    if(!fp.read(buffer, 4))
-        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-    const union {
-        uint32_t data_int;
-        float data_float;
-    } conv = {
-        uint32_t(uint8_t(buffer[0])) << 24 |
-        uint32_t(uint8_t(buffer[1])) << 16 |
-        uint32_t(uint8_t(buffer[2])) << 8 |
-        uint32_t(uint8_t(buffer[3]))
-    };
-    return JKSNValue(conv.data_float);
+size_t JKSNIndex::size() const {
+    return this->p ? this->p->tape.size() : 0;
 }
 
-JKSNValue JKSNDecoderPrivate::parseDouble(std::istream &fp) {
-    static_assert(sizeof (double) == 8, "sizeof (double) should be 8");
-    char buffer[8];
-    if(!fp.read(buffer, 8))
-        throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-    const union {
-        uint64_t data_int;
-        double data_double;
-    } conv = {
-        uint64_t(uint8_t(buffer[0])) << 56 |
-        uint64_t(uint8_t(buffer[1])) << 48 |
-        uint64_t(uint8_t(buffer[2])) << 40 |
-        uint64_t(uint8_t(buffer[3])) << 32 |
-        uint64_t(uint8_t(buffer[4])) << 24 |
-        uint64_t(uint8_t(buffer[5])) << 16 |
-        uint64_t(uint8_t(buffer[6])) << 8 |
-        uint64_t(uint8_t(buffer[7]))
-    };
-    return JKSNValue(conv.data_double);
+jksn_data_type JKSNIndex::getType(size_t entry) const {
+    return this->p->getEntry(entry).node.data_type;
 }
 
-JKSNValue JKSNDecoderPrivate::parseLongDouble(std::istream &fp) {
-    if(sizeof (long double) == 12) {
-        char buffer[10];
-        if(!fp.read(buffer, 10))
-            throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-        union {
-            uint8_t data_int[12];
-            long double data_long_double;
-        } conv;
-        if(isLittleEndian()) {
-            conv.data_int[0] = uint8_t(buffer[9]);
-            conv.data_int[1] = uint8_t(buffer[8]);
-            conv.data_int[2] = uint8_t(buffer[7]);
-            conv.data_int[3] = uint8_t(buffer[6]);
-            conv.data_int[4] = uint8_t(buffer[5]);
-            conv.data_int[5] = uint8_t(buffer[4]);
-            conv.data_int[6] = uint8_t(buffer[3]);
-            conv.data_int[7] = uint8_t(buffer[2]);
-            conv.data_int[8] = uint8_t(buffer[1]);
-            conv.data_int[9] = uint8_t(buffer[0]);
-            conv.data_int[10] = 0;
-            conv.data_int[11] = 0;
-        } else {
-            conv.data_int[0] = 0;
-            conv.data_int[1] = 0;
-            conv.data_int[2] = uint8_t(buffer[0]);
-            conv.data_int[3] = uint8_t(buffer[1]);
-            conv.data_int[4] = uint8_t(buffer[2]);
-            conv.data_int[5] = uint8_t(buffer[3]);
-            conv.data_int[6] = uint8_t(buffer[4]);
-            conv.data_int[7] = uint8_t(buffer[5]);
-            conv.data_int[8] = uint8_t(buffer[6]);
-            conv.data_int[9] = uint8_t(buffer[7]);
-            conv.data_int[10] = uint8_t(buffer[8]);
-            conv.data_int[11] = uint8_t(buffer[9]);
-        }
-        return JKSNValue(conv.data_long_double);
-    } else if(sizeof (long double) == 16) {
-        char buffer[10];
-        if(!fp.read(buffer, 10))
-            throw JKSNDecodeError("JKSN stream may be truncated or corrupted");
-        union {
-            uint8_t data_int[16];
-            long double data_long_double;
-        } conv;
-        if(isLittleEndian()) {
-            conv.data_int[0] = uint8_t(buffer[9]);
-            conv.data_int[1] = uint8_t(buffer[8]);
-            conv.data_int[2] = uint8_t(buffer[7]);
-            conv.data_int[3] = uint8_t(buffer[6]);
-            conv.data_int[4] = uint8_t(buffer[5]);
-            conv.data_int[5] = uint8_t(buffer[4]);
-            conv.data_int[6] = uint8_t(buffer[3]);
-            conv.data_int[7] = uint8_t(buffer[2]);
-            conv.data_int[8] = uint8_t(buffer[1]);
-            conv.data_int[9] = uint8_t(buffer[0]);
-            conv.data_int[10] = 0;
-            conv.data_int[11] = 0;
-            conv.data_int[12] = 0;
-            conv.data_int[13] = 0;
-            conv.data_int[14] = 0;
-            conv.data_int[15] = 0;
-        } else {
-            conv.data_int[0] = 0;
-            conv.data_int[1] = 0;
-            conv.data_int[2] = 0;
-            conv.data_int[3] = 0;
-            conv.data_int[4] = 0;
-            conv.data_int[5] = 0;
-            conv.data_int[6] = uint8_t(buffer[0]);
-            conv.data_int[7] = uint8_t(buffer[1]);
-            conv.data_int[8] = uint8_t(buffer[2]);
-            conv.data_int[9] = uint8_t(buffer[3]);
-            conv.data_int[10] = uint8_t(buffer[4]);
-            conv.data_int[11] = uint8_t(buffer[5]);
-            conv.data_int[12] = uint8_t(buffer[6]);
-            conv.data_int[13] = uint8_t(buffer[7]);
-            conv.data_int[14] = uint8_t(buffer[8]);
-            conv.data_int[15] = uint8_t(buffer[9]);
-        }
-        return JKSNValue(conv.data_long_double);
-    } else
-        throw JKSNEncodeError("this build of JKSN decoder does not support long double numbers");
+size_t JKSNIndex::offset(size_t entry) const {
+    return this->p->header_size + this->p->getEntry(entry).offset;
 }
 
-JKSNValue JKSNDecoderPrivate::parseSwappedArray(std::istream &fp, size_t column_length) {
-    std::vector<JKSNValue> result;
-    while(column_length--) {
-        JKSNValue column_name = this->parseValue(fp);
-        JKSNValue column_values = this->parseValue(fp);
-        if(!column_values.isArray())
-            throw JKSNDecodeError("JKSN row-col swapped array requires an array but not found");
-        std::vector<JKSNValue> &column_values_vector = column_values.toVector();
-        for(size_t i = 0; i < column_values_vector.size(); ++i) {
-            if(i == result.size())
-                result.push_back(JKSNValue::fromMap(std::map<JKSNValue, JKSNValue>()));
-            if(!column_values_vector[i].isUnspecified())
-                result[i].toMap()[column_name] = std::move(column_values_vector[i]);
-        }
-    }
-    return JKSNValue(std::move(result));
+uint8_t JKSNIndex::control(size_t entry) const {
+    return this->p->getEntry(entry).control;
 }
 
+size_t JKSNIndex::end(size_t entry) const {
+    return this->p->getEntry(entry).end;
+}
 
-static inline bool isLittleEndian() {
-    static const union {
-        uint16_t word;
-        uint8_t byte;
-    } endiantest = {1};
-    return endiantest.byte == 1;
+size_t JKSNIndex::length(size_t entry) const {
+    const JKSNTapeEntry &tape_entry = this->p->getEntry(entry);
+    switch(tape_entry.node.data_type) {
+    case JKSN_STRING:
+        return tape_entry.utf16 ? UTF16LECountUTF8(tape_entry.node.data_string, tape_entry.node.size/2) : tape_entry.node.size;
+    case JKSN_BLOB:
+    case JKSN_ARRAY:
+    case JKSN_OBJECT:
+        return tape_entry.node.size;
+    default:
+        throw JKSNTypeError();
+    }
 }
 
-static bool UTF8CheckContinuation(const std::string &utf8str, size_t start, size_t check_length) {
-    if(utf8str.size() > start + check_length) {
-        while(check_length--)
-            if((uint8_t(utf8str[++start]) & 0xc0) != 0x80)
-                return false;
-        return true;
-    } else
-        return false;
+size_t JKSNIndex::at(size_t entry, size_t index) const {
+    const JKSNTapeEntry &tape_entry = this->p->getEntry(entry);
+    if(tape_entry.node.data_type != JKSN_ARRAY && tape_entry.node.data_type != JKSN_OBJECT)
+        throw JKSNTypeError();
+    else if(index >= tape_entry.node.size)
+        throw std::out_of_range("JKSN array index out of range");
+    size_t result = entry+1;
+    if(tape_entry.node.data_type == JKSN_OBJECT)
+        for(index = index*2 + 1; index--; )
+            result = this->p->tape[result].end;
+    else
+        while(index--)
+            result = this->p->tape[result].end;
+    return result;
 }
 
-static std::string UTF8ToUTF16LE(const std::string &utf8str, bool strict) {
-    std::string utf16str;
-    size_t i = 0;
-    utf16str.reserve(utf8str.size());
-    while(i < utf8str.size()) {
-        if(uint8_t(utf8str[i]) < 0x80) {
-            utf16str.append({utf8str[i], '\0'});
-            ++i;
-            continue;
-        } else if(uint8_t(utf8str[i]) < 0xc0) {
-        } else if(uint8_t(utf8str[i]) < 0xe0) {
-            if(UTF8CheckContinuation(utf8str, i, 1)) {
-                uint32_t ucs4 = uint32_t(utf8str[i] & 0x1f) << 6 | uint32_t(utf8str[i+1] & 0x3f);
-                if(ucs4 >= 0x80) {
-                    utf16str.append({
-                        char(ucs4),
-                        char(ucs4 >> 8)
-                    });
-                    i += 2;
-                    continue;
-                }
-            }
-        } else if(uint8_t(utf8str[i]) < 0xf0) {
-            if(UTF8CheckContinuation(utf8str, i, 2)) {
-                uint32_t ucs4 = uint32_t(utf8str[i] & 0xf) << 12 | uint32_t(utf8str[i+1] & 0x3f) << 6 | (utf8str[i+2] & 0x3f);
-                if(ucs4 >= 0x800 && (ucs4 & 0xf800) != 0xd800) {
-                    utf16str.append({
-                        char(ucs4),
-                        char(ucs4 >> 8)
-                    });
-                    i += 3;
-                    continue;
-                }
-            }
-        } else if(uint8_t(utf8str[i]) < 0xf8) {
-            if(UTF8CheckContinuation(utf8str, i, 3)) {
-                uint32_t ucs4 = uint32_t(utf8str[i] & 0x7) << 18 | uint32_t(utf8str[i+1] & 0x3f) << 12 | uint32_t(utf8str[i+2] & 0x3f) << 6 | uint32_t(utf8str[i+3] & 0x3f);
-                if(ucs4 >= 0x10000 && ucs4 < 0x110000) {
-                    ucs4 -= 0x10000;
-                    utf16str.append({
-                        char(ucs4 >> 10),
-                        char((ucs4 >> 18) | 0xd8),
-                        char(ucs4),
-                        char(((ucs4 >> 8) & 0x3) | 0xdc)
-                    });
-                    i += 4;
-                    continue;
-                }
-            }
-        }
-        if(strict)
-            throw JKSNTypeError();
-        else {
-            utf16str.append("\xfd\xff", 2);
-            ++i;
+size_t JKSNIndex::at(size_t entry, const JKSNStringView &key) const {
+    const JKSNTapeEntry &tape_entry = this->p->getEntry(entry);
+    if(tape_entry.node.data_type != JKSN_OBJECT)
+        throw JKSNTypeError();
+    /* Duplicated keys behave like JKSNView, where the last one wins */
+    size_t result = size_t(-1);
+    for(size_t i = entry+1; i != tape_entry.end; ) {
+        const JKSNTapeEntry &item_key = this->p->tape[i];
+        i = item_key.end;
+        if(item_key.node.data_type == JKSN_STRING) {
+            if(item_key.utf16 ? key == UTF16LEToUTF8(item_key.node.data_string, item_key.node.size/2) : JKSNStringView(item_key.node.data_string, item_key.node.size) == key)
+                result = i;
         }
+        i = this->p->tape[i].end;
     }
-    utf16str.shrink_to_fit();
-    return utf16str;
+    if(result == size_t(-1))
+        throw std::out_of_range("JKSN object key not found");
+    return result;
 }
 
-static std::string UTF16ToUTF8(const std::u16string &utf16str) {
-    std::string utf8str;
-    size_t i = 0;
-    utf8str.reserve(utf16str.size()*2);
-    while(i < utf16str.size()) {
-        if(uint16_t(utf16str[i]) < 0x80) {
-            utf8str.push_back(char(utf16str[i]));
-            ++i;
-        } else if(uint16_t(utf16str[i]) < 0x800) {
-            utf8str.append({
-                char(uint16_t(utf16str[i]) >> 6 | 0xc0),
-                char((uint16_t(utf16str[i]) & 0x3f) | 0x80)
-            });
-            ++i;
-        } else if((uint16_t(utf16str[i]) & 0xf800) != 0xd800) {
-                utf8str.append({
-                    char(uint16_t(utf16str[i]) >> 12 | 0xe0),
-                    char(((uint16_t(utf16str[i]) >> 6) & 0x3f) | 0x80),
-                    char((uint16_t(utf16str[i]) & 0x3f) | 0x80)
-                });
-                ++i;
-        } else if(i+1 < utf16str.size() && uint32_t(utf16str[i] & 0xfc00) == 0xd800 && uint32_t(utf16str[i+1] & 0xfc00) == 0xdc00) {
-            uint32_t ucs4 = uint32_t((utf16str[i] & 0x3ff) << 10 | (utf16str[i+1] & 0x3ff)) + 0x10000;
-            utf8str.append({
-                char(ucs4 >> 18 | 0xf0),
-                char(((ucs4 >> 12) & 0x3f) | 0x80),
-                char(((ucs4 >> 6) & 0x3f) | 0x80),
-                char((ucs4 & 0x3f) | 0x80),
-            });
-            i += 2;
-        } else {
-            utf8str.append("\xef\xbf\xbd", 3);
-            ++i;
-        }
+size_t JKSNIndex::find(const JKSNStringView &path) const {
+    size_t result = 0;
+    this->p->getEntry(result);
+    for(const std::string &segment : JKSNDecoderPrivate::splitPath(path)) {
+        const JKSNTapeEntry &tape_entry = this->p->tape[result];
+        if(tape_entry.node.data_type == JKSN_ARRAY) {
+            size_t index = JKSNDecoderPrivate::parsePathIndex(segment);
+            if(index >= tape_entry.node.size)
+                throw std::out_of_range("JKSN path not found");
+            result = this->at(result, index);
+        } else if(tape_entry.node.data_type == JKSN_OBJECT)
+            result = this->at(result, JKSNStringView(segment));
+        else
+            throw std::out_of_range("JKSN path not found");
     }
-    utf8str.shrink_to_fit();
-    return utf8str;
+    return result;
 }
 
-static uint8_t DJBHash(const std::string &buf, uint8_t iv) {
-    unsigned int result = iv;
-    for(char i : buf)
-        result += (result << 5) + uint8_t(i);
+JKSNView JKSNIndex::materialize(size_t entry, JKSNDocument &document) const {
+    this->p->getEntry(entry);
+    document.clear();
+    JKSNNode *root = document.p->allocateNodes(1);
+    new(root) JKSNNode(this->p->materializeNode(entry, *document.p));
+    document.p->root = root;
+    return document.root();
+}
+
+JKSNValue JKSNIndex::toValue(size_t entry) const {
+    JKSNDocument document;
+    return this->materialize(entry, document).toValue();
+}
+
+size_t JKSNIndex::bytesParsed() const {
+    return this->p ? this->p->bytes_parsed : 0;
+}
+
+void JKSNIndex::clear() {
+    if(this->p)
+        this->p->clear();
+    else
+        this->p.reset(new JKSNIndexPrivate);
+}
+
+const JKSNTapeEntry &JKSNIndexPrivate::getEntry(size_t entry) const {
+    if(entry >= this->tape.size())
+        throw std::out_of_range("JKSN index entry out of range");
+    return this->tape[entry];
+}
+
+JKSNNode JKSNIndexPrivate::materializeNode(size_t entry, JKSNDocumentPrivate &document) const {
+    const JKSNTapeEntry &tape_entry = this->tape[entry];
+    JKSNNode result = tape_entry.node;
+    switch(result.data_type) {
+    case JKSN_STRING:
+    case JKSN_BLOB:
+        if(tape_entry.utf16) {
+            size_t utf8size = UTF16LECountUTF8(result.data_string, result.size/2);
+            char *utf8buf = document.arena.allocate<char>(utf8size);
+            UTF16LEWriteUTF8(result.data_string, result.size/2, utf8buf);
+            result.data_string = utf8buf;
+            result.size = utf8size;
+        } else if(document.copy_strings)
+            result.data_string = document.arena.copy(result.data_string, result.size);
+        break;
+    case JKSN_ARRAY:
+    case JKSN_OBJECT:
+        {
+            size_t count = result.data_type == JKSN_OBJECT ? result.size*2 : result.size;
+            JKSNNode *children = document.allocateNodes(count);
+            for(size_t i = 0, child = entry+1; i < count; ++i, child = this->tape[child].end)
+                new(&children[i]) JKSNNode(this->materializeNode(child, document));
+            result.data_children = children;
+        }
+        break;
+    default:
+        break;
+    }
     return result;
 }
 
-bool JKSNValue::toBool() const {
-    switch(this->getType()) {
+const JKSNNode &JKSNView::getNode() const {
+    static const JKSNNode undefined_node;
+    return this->node ? *this->node : undefined_node;
+}
+
+jksn_data_type JKSNView::getType() const {
+    return this->getNode().data_type;
+}
+
+bool JKSNView::toBool() const {
+    const JKSNNode &node = this->getNode();
+    switch(node.data_type) {
     case JKSN_BOOL:
-        return this->data_bool;
+        return node.data_bool;
     case JKSN_UNDEFINED:
     case JKSN_NULL:
         return false;
     case JKSN_INT:
-        return this->data_int != 0;
+        return node.data_int != 0;
     case JKSN_FLOAT:
-        return this->data_float != 0.0f;
+        return node.data_float != 0.0f;
     case JKSN_DOUBLE:
-        return this->data_double != 0.0;
+        return node.data_double != 0.0;
     case JKSN_LONG_DOUBLE:
-        return this->data_long_double != 0.0L;
+        return node.data_long_double != 0.0L;
     case JKSN_STRING:
     case JKSN_BLOB:
-        return !this->data_string->empty();
     case JKSN_ARRAY:
-        return !this->data_array->empty();
     case JKSN_OBJECT:
-        return !this->data_object->empty();
+        return node.size != 0;
     default:
         throw JKSNTypeError();
     }
-};
+}
 
-intmax_t JKSNValue::toInt() const {
-    switch(this->getType()) {
+intmax_t JKSNView::toInt() const {
+    const JKSNNode &node = this->getNode();
+    switch(node.data_type) {
     case JKSN_INT:
-        return this->data_int;
+        return node.data_int;
     case JKSN_BOOL:
-        return this->data_bool;
+        return node.data_bool;
     case JKSN_FLOAT:
-        return this->data_float;
+        return intmax_t(node.data_float);
     case JKSN_DOUBLE:
-        return this->data_double;
+        return intmax_t(node.data_double);
     case JKSN_LONG_DOUBLE:
-        return this->data_long_double;
+        return intmax_t(node.data_long_double);
     case JKSN_NULL:
         return 0;
     case JKSN_STRING:
-        try {
-            return std::stoll(*this->data_string);
-        } catch(std::invalid_argument) {
-            throw JKSNTypeError();
-        } catch(std::out_of_range) {
-            throw JKSNTypeError();
-        }
+        return this->toValue().toInt();
     default:
         throw JKSNTypeError();
     }
 }
 
-template<typename T>
-T JKSNValue::toNumber() const {
-    switch(this->getType()) {
+float JKSNView::toFloat() const {
+    return float(this->toLongDouble());
+}
+
+double JKSNView::toDouble() const {
+    const JKSNNode &node = this->getNode();
+    switch(node.data_type) {
+    case JKSN_DOUBLE:
+        return node.data_double;
+    case JKSN_FLOAT:
+        return node.data_float;
+    case JKSN_INT:
+        return double(node.data_int);
+    default:
+        return double(this->toLongDouble());
+    }
+}
+
+long double JKSNView::toLongDouble() const {
+    const JKSNNode &node = this->getNode();
+    switch(node.data_type) {
     case JKSN_FLOAT:
-        return this->data_float;
+        return node.data_float;
     case JKSN_DOUBLE:
-        return this->data_double;
+        return node.data_double;
     case JKSN_LONG_DOUBLE:
-        return this->data_long_double;
+        return node.data_long_double;
     case JKSN_INT:
-        return this->data_int;
+        return node.data_int;
     case JKSN_BOOL:
-        return this->data_bool;
+        return node.data_bool;
     case JKSN_NULL:
         return 0;
-    case JKSN_STRING:
-        try {
-            return std::stoll(*this->data_string);
-        } catch(std::invalid_argument) {
-            return NAN;
-        } catch(std::out_of_range) {
-            return NAN;
-        }
     default:
-        return NAN;
+        return this->toValue().toLongDouble();
     }
 }
 
-std::string JKSNValue::toString() const {
-    switch(this->getType()) {
+JKSNStringView JKSNView::toStringView() const {
+    const JKSNNode &node = this->getNode();
+    if(node.data_type == JKSN_STRING || node.data_type == JKSN_BLOB)
+        return JKSNStringView(node.data_string, node.size);
+    else
+        throw JKSNTypeError();
+}
+
+std::string JKSNView::toString() const {
+    if(this->isStringOrBlob())
+        return this->toStringView().toString();
+    else
+        return this->toValue().toString();
+}
+
+JKSNValue JKSNView::toValue() const {
+    const JKSNNode &node = this->getNode();
+    switch(node.data_type) {
     case JKSN_UNDEFINED:
-        return "undefined";
+        return JKSNValue();
     case JKSN_NULL:
-        return "null";
+        return JKSNValue(nullptr);
     case JKSN_BOOL:
-        return this->data_bool ? "true" : "false";
+        return JKSNValue(node.data_bool);
     case JKSN_INT:
-        return std::to_string(this->data_int);
+        return JKSNValue(node.data_int);
     case JKSN_FLOAT:
-        if(std::isnan(this->data_float))
-            return "NaN";
-        else if(std::isinf(this->data_float))
-            return this->data_float >= 0 ? "Infinity" : "-Infinity";
-        else
-            return std::to_string(this->data_float);
+        return JKSNValue(node.data_float);
     case JKSN_DOUBLE:
-        if(std::isnan(this->data_double))
-            return "NaN";
-        else if(std::isinf(this->data_double))
-            return this->data_double >= 0 ? "Infinity" : "-Infinity";
-        else
-            return std::to_string(this->data_double);
+        return JKSNValue(node.data_double);
     case JKSN_LONG_DOUBLE:
-        if(std::isnan(this->data_long_double))
-            return "NaN";
-        else if(std::isinf(this->data_long_double))
-            return this->data_long_double >= 0 ? "Infinity" : "-Infinity";
-        else
-            return std::to_string(this->data_long_double);
+        return JKSNValue(node.data_long_double);
     case JKSN_STRING:
+        return JKSNValue(JKSNStringView(node.data_string, node.size));
     case JKSN_BLOB:
-        return *this->data_string;
+        return JKSNValue(JKSNStringView(node.data_string, node.size), true);
     case JKSN_ARRAY:
         {
-            std::string res;
-            bool first = true;
-            for(const JKSNValue &i : *this->data_array) {
-                if(!first)
-                    res.append(1, ',');
-                first = false;
-                res.append(i.toString());
-            }
-            return res;
+            std::vector<JKSNValue> result;
+            result.reserve(node.size);
+            for(size_t i = 0; i < node.size; ++i)
+                result.push_back(JKSNView(&node.data_children[i]).toValue());
+            return JKSNValue(std::move(result));
         }
     case JKSN_OBJECT:
-        return "[object Object]";
+        {
+            JKSNObject result;
+            result.reserve(node.size);
+            for(size_t i = 0; i < node.size; ++i)
+                result[this->key(i).toValue()] = this->value(i).toValue();
+            return JKSNValue(std::move(result));
+        }
+    case JKSN_UNSPECIFIED:
+        return JKSNValue::fromUnspecified();
     default:
         throw JKSNTypeError();
     }
 }
 
-bool JKSNValue::operator==(const JKSNValue &that) const {
-    jksn_data_type this_type = this->getType();
-    jksn_data_type that_type = that.getType();
-    if(this_type == that_type || (this->isNumber() && that.isNumber()))
-        switch(this_type) {
-        case JKSN_BOOL:
-            return this->toBool() == that.toBool();
-        case JKSN_INT:
-            switch(that_type) {
-            case JKSN_INT:
-                return this->toInt() == that.toInt();
-            case JKSN_FLOAT:
-                return this->toFloat() == that.toFloat();
-            case JKSN_DOUBLE:
-                return this->toDouble() == that.toDouble();
-            case JKSN_LONG_DOUBLE:
-                return this->toLongDouble() == that.toLongDouble();
-            default:
-                assert(that.isNumber());
-                throw std::logic_error("unknown error occured during value comparision");
-            }
-        case JKSN_FLOAT:
-            switch(that_type) {
-            case JKSN_INT:
-            case JKSN_FLOAT:
-                return this->toFloat() == that.toFloat();
-            case JKSN_DOUBLE:
-                return this->toDouble() == that.toDouble();
-            case JKSN_LONG_DOUBLE:
-                return this->toLongDouble() == that.toLongDouble();
-            default:
-                assert(that.isNumber());
-                throw std::logic_error("unknown error occured during value comparision");
-            }
-        case JKSN_DOUBLE:
-            switch(that_type) {
-            case JKSN_INT:
-            case JKSN_FLOAT:
-            case JKSN_DOUBLE:
-                return this->toDouble() == that.toDouble();
-            case JKSN_LONG_DOUBLE:
-                return this->toLongDouble() == that.toLongDouble();
-            default:
-                assert(that.isNumber());
-                throw std::logic_error("unknown error occured during value comparision");
-            }
-        case JKSN_LONG_DOUBLE:
-            switch(that_type) {
-            case JKSN_INT:
-            case JKSN_FLOAT:
-            case JKSN_DOUBLE:
-            case JKSN_LONG_DOUBLE:
-                return this->toLongDouble() == that.toLongDouble();
-            default:
-                assert(that.isNumber());
-                throw std::logic_error("unknown error occured during value comparision");
-            }
-        case JKSN_STRING:
-        case JKSN_BLOB:
-            return this->toString() == that.toString();
-        case JKSN_ARRAY:
-            {
-                const std::vector<JKSNValue> &this_vector = this->toVector();
-                const std::vector<JKSNValue> &that_vector = that.toVector();
-                if(this_vector.size() != that_vector.size())
-                    return false;
-                else {
-                    for(auto this_iter = this_vector.cbegin(), that_iter = that_vector.cbegin();
-                        this_iter != this_vector.end(); ++this_iter, ++that_iter)
-                    if(*this_iter != *that_iter)
-                        return false;
-                    return true;
-                }
-            }
-        case JKSN_OBJECT:
-            {
-                const std::map<JKSNValue, JKSNValue> &this_map = this->toMap();
-                const std::map<JKSNValue, JKSNValue> &that_map = that.toMap();
-                if(this_map.size() != that_map.size())
-                    return false;
-                else {
-                    for(auto this_iter = this_map.cbegin(), that_iter = that_map.cbegin();
-                        this_iter != this_map.end(); ++this_iter, ++that_iter)
-                    if((*this_iter).first != (*that_iter).first || (*this_iter).second != (*that_iter).second)
-                        return false;
-                    return true;
-                }
-            }
-        default:
-            return true;
-    } else
-        return this_type == that_type;
+std::vector<double> JKSNView::toDoubleVector() const {
+    const JKSNNode &node = this->getNode();
+    if(node.data_type != JKSN_ARRAY)
+        throw JKSNTypeError();
+    std::vector<double> result(node.size);
+    for(size_t i = 0; i < node.size; ++i)
+        result[i] = JKSNView(&node.data_children[i]).toDouble();
+    return result;
+}
+
+std::vector<bool> JKSNView::toBoolVector() const {
+    const JKSNNode &node = this->getNode();
+    if(node.data_type != JKSN_ARRAY)
+        throw JKSNTypeError();
+    std::vector<bool> result(node.size);
+    for(size_t i = 0; i < node.size; ++i)
+        if(node.data_children[i].data_type != JKSN_UNSPECIFIED)
+            result[i] = JKSNView(&node.data_children[i]).toBool();
+    return result;
+}
+
+size_t JKSNView::size() const {
+    const JKSNNode &node = this->getNode();
+    switch(node.data_type) {
+    case JKSN_STRING:
+    case JKSN_BLOB:
+    case JKSN_ARRAY:
+    case JKSN_OBJECT:
+        return node.size;
+    default:
+        throw JKSNTypeError();
+    }
+}
+
+JKSNView JKSNView::operator[](size_t index) const {
+    return JKSNView(&this->getNode().data_children[index]);
+}
+
+JKSNView JKSNView::at(size_t index) const {
+    const JKSNNode &node = this->getNode();
+    if(node.data_type != JKSN_ARRAY)
+        throw JKSNTypeError();
+    else if(index >= node.size)
+        throw std::out_of_range("JKSN array index out of range");
+    return JKSNView(&node.data_children[index]);
+}
+
+JKSNView JKSNView::at(const JKSNStringView &key) const {
+    const JKSNNode *result = this->find(key);
+    if(result)
+        return JKSNView(result);
+    else
+        throw std::out_of_range("JKSN object key not found");
+}
+
+size_t JKSNView::count(const JKSNStringView &key) const {
+    return this->find(key) ? 1 : 0;
+}
+
+JKSNView JKSNView::key(size_t index) const {
+    const JKSNNode &node = this->getNode();
+    if(node.data_type != JKSN_OBJECT)
+        throw JKSNTypeError();
+    else if(index >= node.size)
+        throw std::out_of_range("JKSN object index out of range");
+    return JKSNView(&node.data_children[index*2]);
+}
+
+JKSNView JKSNView::value(size_t index) const {
+    const JKSNNode &node = this->getNode();
+    if(node.data_type != JKSN_OBJECT)
+        throw JKSNTypeError();
+    else if(index >= node.size)
+        throw std::out_of_range("JKSN object index out of range");
+    return JKSNView(&node.data_children[index*2 + 1]);
+}
+
+const JKSNNode *JKSNView::find(const JKSNStringView &key) const {
+    const JKSNNode &node = this->getNode();
+    if(node.data_type != JKSN_OBJECT)
+        throw JKSNTypeError();
+    /* Search backwards, so that duplicated keys behave like JKSNValue, where the last one wins */
+    for(size_t i = node.size; i--; ) {
+        const JKSNNode &item_key = node.data_children[i*2];
+        if(item_key.data_type == JKSN_STRING && JKSNStringView(item_key.data_string, item_key.size) == key)
+            return &node.data_children[i*2 + 1];
+    }
+    return nullptr;
+}
+
+JKSNReader::JKSNReader(const char *buffer, size_t size, bool header, bool transpose) :
+    p(new JKSNReaderPrivate(nullptr, buffer, size, header, transpose)) {
+}
+
+JKSNReader::JKSNReader(JKSNDecoder &decoder, const char *buffer, size_t size, bool header, bool transpose) :
+    p(new JKSNReaderPrivate(decoder.p.get(), buffer, size, header, transpose)) {
+}
+
+JKSNReader::JKSNReader(JKSNReader &&that) :
+    p(std::move(that.p)) {
+}
+
+JKSNReader &JKSNReader::operator=(JKSNReader &&that) {
+    if(this != &that)
+        this->p = std::move(that.p);
+    return *this;
+}
+
+JKSNReader::~JKSNReader() {
+}
+
+jksn_token_type JKSNReader::next() {
+    return this->p->next();
+}
+
+jksn_token_type JKSNReader::getToken() const {
+    return this->p->token;
+}
+
+JKSNView JKSNReader::value() const {
+    if(this->p->token != JKSN_TOKEN_VALUE)
+        throw JKSNTypeError();
+    return JKSNView(&this->p->current);
+}
+
+size_t JKSNReader::size() const {
+    if(this->p->token != JKSN_TOKEN_ARRAY_BEGIN && this->p->token != JKSN_TOKEN_OBJECT_BEGIN && this->p->token != JKSN_TOKEN_SWAPPED_BEGIN)
+        throw JKSNTypeError();
+    return this->p->current_size;
+}
+
+bool JKSNReader::isKey() const {
+    return this->p->is_key;
+}
+
+size_t JKSNReader::depth() const {
+    return this->p->frames.size();
+}
+
+void JKSNReader::skip() {
+    if(this->p->token != JKSN_TOKEN_ARRAY_BEGIN && this->p->token != JKSN_TOKEN_OBJECT_BEGIN && this->p->token != JKSN_TOKEN_SWAPPED_BEGIN)
+        return;
+    this->p->skip();
+}
+
+size_t JKSNReader::bytesParsed() const {
+    return this->p->header_size + this->p->fp.tell();
+}
+
+JKSNIncrementalDecoder::JKSNIncrementalDecoder(bool header) :
+    p(new JKSNIncrementalDecoderPrivate(nullptr, header)) {
+}
+
+JKSNIncrementalDecoder::JKSNIncrementalDecoder(JKSNDecoder &decoder, bool header) :
+    p(new JKSNIncrementalDecoderPrivate(decoder.p.get(), header)) {
+}
+
+JKSNIncrementalDecoder::JKSNIncrementalDecoder(JKSNIncrementalDecoder &&that) :
+    p(std::move(that.p)) {
+}
+
+JKSNIncrementalDecoder &JKSNIncrementalDecoder::operator=(JKSNIncrementalDecoder &&that) {
+    if(this != &that)
+        this->p = std::move(that.p);
+    return *this;
+}
+
+JKSNIncrementalDecoder::~JKSNIncrementalDecoder() {
+}
+
+jksn_feed_status JKSNIncrementalDecoder::feed(const char *buffer, size_t size) {
+    return this->p->feed(buffer, size);
+}
+
+JKSNValue &JKSNIncrementalDecoder::value() {
+    return this->p->value;
+}
+
+const std::string &JKSNIncrementalDecoder::error() const {
+    return this->p->error;
+}
+
+size_t JKSNIncrementalDecoder::buffered() const {
+    return this->p->buffer.size();
+}
+
+JKSNSessionReader::JKSNSessionReader(const char *buffer, size_t size, bool header) :
+    p(new JKSNSessionReaderPrivate(nullptr, buffer, size, header)) {
+}
+
+JKSNSessionReader::JKSNSessionReader(JKSNDecoder &decoder, const char *buffer, size_t size, bool header) :
+    p(new JKSNSessionReaderPrivate(decoder.p.get(), buffer, size, header)) {
+}
+
+JKSNSessionReader::JKSNSessionReader(JKSNSessionReader &&that) :
+    p(std::move(that.p)) {
+}
+
+JKSNSessionReader &JKSNSessionReader::operator=(JKSNSessionReader &&that) {
+    if(this != &that)
+        this->p = std::move(that.p);
+    return *this;
+}
+
+JKSNSessionReader::~JKSNSessionReader() {
+}
+
+bool JKSNSessionReader::next() {
+    size_t begin = this->p->value_end;
+    if(begin == this->p->size)
+        return false;
+    size_t header_size = 0;
+    /* Only part of a header is left for reset(), like any other value cut short */
+    if(this->p->header && this->p->size - begin < 3 && std::memcmp(this->p->buffer + begin, "jk!", this->p->size - begin) == 0)
+        return false;
+    if(this->p->header && this->p->size - begin >= 3 && std::memcmp(this->p->buffer + begin, "jk!", 3) == 0)
+        header_size = 3;
+    JKSNBufferInput input(this->p->buffer + begin + header_size, this->p->size - begin - header_size);
+    this->p->document.clear();
+    this->p->decoder->cache.mark();
+    try {
+        this->p->decoder->parseDocument(input, this->p->document);
+    } catch(const JKSNTruncatedError &) {
+        /* The hashtable is only committed once the value is whole */
+        this->p->document.clear();
+        this->p->decoder->cache.rollback();
+        return false;
+    }
+    this->p->decoder->cache.release();
+    this->p->value_begin = begin;
+    this->p->value_end = begin + header_size + input.tell();
+    return true;
+}
+
+JKSNView JKSNSessionReader::value() const {
+    return JKSNView(this->p->document.root);
 }
 
-bool JKSNValue::operator<(const JKSNValue &that) const {
-    jksn_data_type this_type = this->getType();
-    jksn_data_type that_type = that.getType();
-    if(this_type == that_type || (this->isNumber() && that.isNumber()))
-        switch(this_type) {
-        case JKSN_BOOL:
-            return this->toBool() < that.toBool();
-        case JKSN_INT:
-            switch(that_type) {
-            case JKSN_INT:
-                return this->toInt() < that.toInt();
-            case JKSN_FLOAT:
-                return this->toFloat() < that.toFloat();
-            case JKSN_DOUBLE:
-                return this->toDouble() < that.toDouble();
-            case JKSN_LONG_DOUBLE:
-                return this->toLongDouble() < that.toLongDouble();
-            default:
-                assert(that.isNumber());
-                throw std::logic_error("unknown error occured during value comparision");
-            }
-        case JKSN_FLOAT:
-            switch(that_type) {
-            case JKSN_INT:
-            case JKSN_FLOAT:
-                return this->toFloat() < that.toFloat();
-            case JKSN_DOUBLE:
-                return this->toDouble() < that.toDouble();
-            case JKSN_LONG_DOUBLE:
-                return this->toLongDouble() < that.toLongDouble();
-            default:
-                assert(that.isNumber());
-                throw std::logic_error("unknown error occured during value comparision");
-            }
-        case JKSN_DOUBLE:
-            switch(that_type) {
-            case JKSN_INT:
-            case JKSN_FLOAT:
-            case JKSN_DOUBLE:
-                return this->toDouble() < that.toDouble();
-            case JKSN_LONG_DOUBLE:
-                return this->toLongDouble() < that.toLongDouble();
-            default:
-                assert(that.isNumber());
-                throw std::logic_error("unknown error occured during value comparision");
-            }
-        case JKSN_LONG_DOUBLE:
-            switch(that_type) {
-            case JKSN_INT:
-            case JKSN_FLOAT:
-            case JKSN_DOUBLE:
-            case JKSN_LONG_DOUBLE:
-                return this->toLongDouble() < that.toLongDouble();
-            default:
-                assert(that.isNumber());
-                throw std::logic_error("unknown error occured during value comparision");
+size_t JKSNSessionReader::begin() const {
+    return this->p->value_begin;
+}
+
+size_t JKSNSessionReader::end() const {
+    return this->p->value_end;
+}
+
+size_t JKSNSessionReader::bytesParsed() const {
+    return this->p->value_end;
+}
+
+void JKSNSessionReader::reset(const char *buffer, size_t size) {
+    this->p->document.clear();
+    this->p->buffer = buffer;
+    this->p->size = size;
+    this->p->value_begin = 0;
+    this->p->value_end = 0;
+}
+
+JKSNSessionReaderPrivate::JKSNSessionReaderPrivate(JKSNDecoderPrivate *decoder, const char *buffer, size_t size, bool header) :
+    own_decoder(decoder ? nullptr : new JKSNDecoderPrivate),
+    decoder(decoder ? decoder : own_decoder.get()),
+    buffer(buffer),
+    size(size),
+    header(header) {
+}
+
+static size_t headerSize(const char *buffer, size_t size, bool header) {
+    return header && size >= 3 && std::memcmp(buffer, "jk!", 3) == 0 ? 3 : 0;
+}
+
+JKSNReaderPrivate::JKSNReaderPrivate(JKSNDecoderPrivate *decoder, const char *buffer, size_t size, bool header, bool transpose) :
+    own_decoder(decoder ? nullptr : new JKSNDecoderPrivate),
+    decoder(decoder ? decoder : own_decoder.get()),
+    state(document),
+    header_size(headerSize(buffer, size, header)),
+    fp(buffer + header_size, size - header_size),
+    transpose(transpose) {
+}
+
+jksn_token_type JKSNReaderPrivate::next() {
+    if(this->complete) {
+        if(!this->finished) {
+            this->decoder->commitHashtable(this->state);
+            this->finished = true;
+        }
+        this->is_key = false;
+        return this->token = JKSN_TOKEN_NONE;
+    }
+    this->is_key = false;
+    if(!this->frames.empty()) {
+        Frame &frame = this->frames.back();
+        if(frame.type != LENGTHLESS_ARRAY && frame.remaining == 0)
+            return this->endContainer();
+        if(frame.type == ARRAY_NODES || frame.type == OBJECT_NODES) {
+            this->beginItem();
+            return this->emitNode(*frame.nodes++);
+        }
+    }
+    for(;;) {
+        uint8_t control = this->fp.get();
+        bool is_column = !this->frames.empty() && this->frames.back().type == SWAPPED_ARRAY && this->frames.back().remaining % 2 != 0;
+        if(is_column && (control & 0xf0) != 0x80 && ((control & 0xf0) != 0xa0 || control == 0xa0) && control != 0xc8 && control != 0xca && (control & 0xf0) != 0x70 && (control & 0xf0) != 0xf0 && !this->decoder->isPackedArray(control))
+            throw JKSNDecodeError("JKSN row-col swapped array requires an array but not found");
+        switch(control & 0xf0) {
+        /* Hashtable refreshers */
+        case 0x70:
+            if(control == 0x70)
+                this->state.refresh();
+            else
+                for(size_t objlen = this->decoder->decodeLength(this->fp, control); objlen--; )
+                    this->decoder->parseNode(this->fp, this->state);
+            continue;
+        /* Arrays */
+        case 0x80:
+            {
+                size_t objlen = this->decoder->decodeLength(this->fp, control);
+                this->beginItem();
+                return this->beginContainer(ARRAY, JKSN_TOKEN_ARRAY_BEGIN, objlen, objlen);
             }
-        case JKSN_STRING:
-        case JKSN_BLOB:
-            return this->toString() < that.toString();
-        case JKSN_ARRAY:
+        /* Objects */
+        case 0x90:
             {
-                const std::vector<JKSNValue> &this_vector = this->toVector();
-                const std::vector<JKSNValue> &that_vector = that.toVector();
-                auto this_iter = this_vector.cbegin();
-                auto that_iter = that_vector.cbegin();
-                for(; this_iter != this_vector.cend(); ++this_iter, ++that_iter) {
-                    if(that_iter == that_vector.cend())
-                        return false;
-                    else if(*this_iter < *that_iter)
-                        return true;
-                    else if(*this_iter != *that_iter) /* > */
-                        return false;
+                size_t objlen = this->decoder->decodeLength(this->fp, control);
+                if(objlen > this->fp.remaining()/2)
+                    throw JKSNTruncatedError();
+                this->beginItem();
+                return this->beginContainer(OBJECT, JKSN_TOKEN_OBJECT_BEGIN, objlen, objlen*2);
+            }
+        /* Row-col swapped arrays */
+        case 0xa0:
+            if(control == 0xa0) {
+                if(!this->frames.empty() && this->frames.back().type == LENGTHLESS_ARRAY) {
+                    if(!this->checksums.empty() && this->checksums.back().depth == this->frames.size())
+                        throw JKSNDecodeError("JKSN stream contains a checksum without a value");
+                    return this->endContainer();
                 }
-                return that_iter != that_vector.cend();
+                break;
+            } else {
+                size_t collen = this->decoder->decodeLength(this->fp, control);
+                if(collen > this->fp.remaining()/2)
+                    throw JKSNTruncatedError();
+                this->beginItem();
+                if(!this->transpose)
+                    return this->beginContainer(SWAPPED_ARRAY, JKSN_TOKEN_SWAPPED_BEGIN, collen, collen*2);
+                JKSNNode node = this->decoder->parseSwappedNodes(this->fp, this->state, collen);
+                this->endItem();
+                return this->emitNode(node);
             }
-        case JKSN_OBJECT:
-            {
-                const std::map<JKSNValue, JKSNValue> &this_map = this->toMap();
-                const std::map<JKSNValue, JKSNValue> &that_map = this->toMap();
-                auto this_iter = this_map.cbegin();
-                auto that_iter = that_map.cbegin();
-                for(; this_iter != this_map.cend(); ++this_iter, ++that_iter) {
-                    if(that_iter == that_map.cend())
-                        return false;
-                    else if((*this_iter).first < (*that_iter).first)
-                        return true;
-                    else if((*this_iter).first != (*that_iter).first) /* > */
-                        return false;
-                    else if((*this_iter).second < (*that_iter).second)
-                        return true;
-                    else if((*this_iter).second != (*that_iter).second)
-                        return false;
+        case 0xc0:
+            /* Lengthless arrays */
+            if(control == 0xc8) {
+                this->beginItem();
+                return this->beginContainer(LENGTHLESS_ARRAY, JKSN_TOKEN_ARRAY_BEGIN, JKSNReader::unknown_size, 0);
+            /* Padding byte */
+            } else if(control == 0xca)
+                continue;
+            break;
+        /* Packed arrays and shaped objects, whose items are all read at once */
+        case 0xe0:
+            if(this->decoder->isPackedArray(control) || this->decoder->isShapedObject(control)) {
+                this->fp.unget();
+                this->beginItem();
+                JKSNNode node = this->decoder->parseNode(this->fp, this->state);
+                this->endItem();
+                return this->emitNode(node);
+            }
+            break;
+        case 0xf0:
+            /* Checksums are verified when their value ends */
+            if(JKSNChecksum::isChecksum(control)) {
+                std::string expected;
+                if(control <= 0xf5) {
+                    size_t size = JKSNChecksum::digestSize(control);
+                    expected.assign(this->fp.read(size), size);
                 }
-                return that_iter != that_map.cend();
+                this->checksums.push_back(PendingChecksum({JKSNChecksum(control), control, std::move(expected), this->frames.size(), this->fp.tell()}));
+                continue;
+            /* Pragmas, only the extensions are understood */
+            } else if(control == 0xff) {
+                this->decoder->applyPragma(this->decoder->parseNode(this->fp, this->state));
+                continue;
             }
-        default:
-            return false;
+            break;
         }
-    else
-        return this_type < that_type;
+        /* Everything else is a scalar */
+        this->fp.unget();
+        this->beginItem();
+        this->current = this->decoder->parseNode(this->fp, this->state);
+        if(this->is_key && this->current.data_type == JKSN_STRING && (this->decoder->cache.extensions & JKSN_EXTENSION_KEY_DELTAS)) {
+            this->frames.back().keyed = true;
+            this->frames.back().key.assign(this->current.data_string, this->current.size);
+        }
+        this->endItem();
+        this->endValue(this->frames.size());
+        if(this->frames.empty())
+            this->complete = true;
+        return this->token = JKSN_TOKEN_VALUE;
+    }
 }
 
-JKSNValue &JKSNValue::operator=(const JKSNValue &that) {
-    if(this != &that) {
-        union {
-            std::string *new_string = nullptr;
-            std::vector<JKSNValue> *new_array;
-            std::map<JKSNValue, JKSNValue> *new_object;
-        } new_data;
-        switch(that.getType()) {
-        case JKSN_BOOL:
-            this->data_bool = that.toBool();
-            break;
-        case JKSN_INT:
-            this->data_int = that.toInt();
-            break;
-        case JKSN_FLOAT:
-            this->data_float = that.toFloat();
-            break;
-        case JKSN_DOUBLE:
-            this->data_double = that.toDouble();
-            break;
-        case JKSN_LONG_DOUBLE:
-            this->data_long_double = that.toLongDouble();
-            break;
-        case JKSN_STRING:
-        case JKSN_BLOB:
-            new_data.new_string = new std::string(that.toString());
-            break;
-        case JKSN_ARRAY:
-            new_data.new_array = new std::vector<JKSNValue>(that.toVector());
-            break;
-        case JKSN_OBJECT:
-            new_data.new_object = new std::map<JKSNValue, JKSNValue>(that.toMap());
-            break;
-        default:
-            break;
+void JKSNReaderPrivate::skip() {
+    Frame &frame = this->frames.back();
+    switch(frame.type) {
+    case LENGTHLESS_ARRAY:
+        while(!this->decoder->skimNode(this->fp, this->state)) {
         }
-        this->~JKSNValue();
-        switch((this->data_type = that.getType())) {
-        case JKSN_STRING:
-        case JKSN_BLOB:
-            this->data_string = new_data.new_string;
-            break;
-        case JKSN_ARRAY:
-            this->data_array = new_data.new_array;
-            break;
-        case JKSN_OBJECT:
-            this->data_object = new_data.new_object;
-            break;
-        default:
-            break;
+        break;
+    case ARRAY_NODES:
+    case OBJECT_NODES:
+        frame.remaining = 0;
+        break;
+    case ARRAY:
+        for(; frame.remaining != 0; --frame.remaining)
+            this->decoder->skimNode(this->fp, this->state);
+        break;
+    default:
+        if(frame.remaining % 2 != 0) {
+            /* The value of a key already read */
+            this->beginItem();
+            this->decoder->skimNode(this->fp, this->state);
+            this->endItem();
         }
+        this->decoder->skimMembers(this->fp, this->state, frame.remaining/2);
+        frame.remaining = 0;
     }
-    return *this;
+    this->endContainer();
 }
 
-JKSNValue &JKSNValue::operator=(JKSNValue &&that) {
-    if(this != &that) {
-        this->~JKSNValue();
-        switch(that.getType()) {
-        case JKSN_BOOL:
-            this->data_bool = that.toBool();
-            break;
-        case JKSN_INT:
-            this->data_int = that.toInt();
-            break;
-        case JKSN_FLOAT:
-            this->data_float = that.toFloat();
-            break;
-        case JKSN_DOUBLE:
-            this->data_double = that.toDouble();
-            break;
-        case JKSN_LONG_DOUBLE:
-            this->data_long_double = that.toLongDouble();
-            break;
-        case JKSN_STRING:
-        case JKSN_BLOB:
-            this->data_string = that.data_string;
+void JKSNReaderPrivate::beginItem() {
+    if(!this->frames.empty()) {
+        Frame &frame = this->frames.back();
+        this->is_key = (frame.type == OBJECT || frame.type == OBJECT_NODES || frame.type == SWAPPED_ARRAY) && frame.remaining % 2 == 0;
+        if(frame.type != LENGTHLESS_ARRAY)
+            --frame.remaining;
+        if(this->is_key)
+            frame.keyed = false;
+        else if(frame.keyed) {
+            frame.outer = this->decoder->cache.enterKey(frame.key);
+            frame.entered = true;
+        }
+    }
+}
+
+void JKSNReaderPrivate::endItem() {
+    if(!this->frames.empty() && this->frames.back().entered) {
+        Frame &frame = this->frames.back();
+        this->decoder->cache.leaveKey(frame.key, frame.outer);
+        frame.entered = false;
+    }
+}
+
+jksn_token_type JKSNReaderPrivate::beginContainer(FrameType type, jksn_token_type token, size_t size, size_t remaining, const JKSNNode *nodes) {
+    this->frames.push_back(Frame({type, remaining, nodes, false, false, std::string(), JKSNKeyInts::LastInt({false, 0})}));
+    this->current_size = size;
+    return this->token = token;
+}
+
+jksn_token_type JKSNReaderPrivate::endContainer() {
+    this->endValue(this->frames.size() - 1);
+    this->frames.pop_back();
+    this->endItem();
+    if(this->frames.empty())
+        this->complete = true;
+    return this->token = JKSN_TOKEN_END;
+}
+
+jksn_token_type JKSNReaderPrivate::emitNode(const JKSNNode &node) {
+    if(node.data_type == JKSN_ARRAY)
+        return this->beginContainer(ARRAY_NODES, JKSN_TOKEN_ARRAY_BEGIN, node.size, node.size, node.data_children);
+    else if(node.data_type == JKSN_OBJECT)
+        return this->beginContainer(OBJECT_NODES, JKSN_TOKEN_OBJECT_BEGIN, node.size, node.size*2, node.data_children);
+    this->current = node;
+    if(this->frames.empty())
+        this->complete = true;
+    return this->token = JKSN_TOKEN_VALUE;
+}
+
+void JKSNReaderPrivate::updateChecksums() {
+    for(PendingChecksum &pending : this->checksums) {
+        size_t size = this->fp.tell() - pending.hashed;
+        pending.checksum.update(this->fp.current() - size, size);
+        pending.hashed = this->fp.tell();
+    }
+}
+
+void JKSNReaderPrivate::endValue(size_t depth) {
+    /* Every delayed digest is there before any checksum is consumed */
+    size_t trailer = 0;
+    for(auto it = this->checksums.rbegin(); it != this->checksums.rend() && it->depth == depth; ++it)
+        if(it->control >= 0xf8)
+            trailer += JKSNChecksum::digestSize(it->control);
+    if(trailer > this->fp.remaining())
+        throw JKSNTruncatedError();
+    while(!this->checksums.empty() && this->checksums.back().depth == depth) {
+        PendingChecksum &pending = this->checksums.back();
+        size_t size = this->fp.tell() - pending.hashed;
+        pending.checksum.update(this->fp.current() - size, size);
+        if(pending.control >= 0xf8) {
+            size = JKSNChecksum::digestSize(pending.control);
+            pending.expected.assign(this->fp.read(size), size);
+        }
+        pending.checksum.verify(pending.expected.data());
+        this->checksums.pop_back();
+    }
+}
+
+
+JKSNIncrementalDecoderPrivate::JKSNIncrementalDecoderPrivate(JKSNDecoderPrivate *decoder, bool header) :
+    own_decoder(decoder ? nullptr : new JKSNDecoderPrivate),
+    decoder(decoder ? decoder : own_decoder.get()),
+    header(header),
+    reader(this->decoder, nullptr, 0, false, false) {
+}
+
+jksn_feed_status JKSNIncrementalDecoderPrivate::feed(const char *buffer, size_t size) {
+    if(this->status == JKSN_FEED_ERROR)
+        return this->status;
+    /* Without leftovers, the new bytes are read where they are */
+    bool in_place = this->buffer.empty();
+    if(!in_place) {
+        this->buffer.append(buffer, size);
+        buffer = this->buffer.data();
+        size = this->buffer.size();
+    }
+    this->reader.fp = JKSNBufferInput(buffer, size);
+    try {
+        this->status = this->readValue();
+    } catch(const JKSNError &e) {
+        this->error = e.what();
+        this->buffer.clear();
+        return this->status = JKSN_FEED_ERROR;
+    }
+    /* The hashtable may point into the input, so it goes to the decoder first */
+    this->decoder->commitHashtable(this->reader.state);
+    this->reader.state.textdirty.reset();
+    this->reader.state.blobdirty.reset();
+    this->reader.state.textutf16.reset();
+    this->reader.document.clear();
+    /* Pending checksums take in the bytes before they are dropped */
+    this->reader.updateChecksums();
+    for(JKSNReaderPrivate::PendingChecksum &pending : this->reader.checksums)
+        pending.hashed = 0;
+    size_t consumed = this->reader.fp.tell();
+    if(in_place)
+        this->buffer.assign(buffer + consumed, size - consumed);
+    else
+        this->buffer.erase(0, consumed);
+    return this->status;
+}
+
+jksn_feed_status JKSNIncrementalDecoderPrivate::readValue() {
+    JKSNBufferInput &fp = this->reader.fp;
+    for(;;) {
+        if(this->message_begin) {
+            /* 'j' is not a control byte, so it can only begin a header */
+            if(fp.remaining() == 0 || (this->header && fp.current()[0] == 'j' && fp.remaining() < 3))
+                return JKSN_FEED_NEED_MORE;
+            if(this->header && fp.remaining() >= 3 && std::memcmp(fp.current(), "jk!", 3) == 0)
+                fp.read(3);
+            this->message_begin = false;
+        }
+        if(!this->readToken())
+            return JKSN_FEED_NEED_MORE;
+        switch(this->reader.token) {
+        case JKSN_TOKEN_VALUE:
+            this->pushValue(JKSNView(&this->reader.current).toValue());
             break;
-        case JKSN_ARRAY:
-            this->data_array = that.data_array;
+        case JKSN_TOKEN_ARRAY_BEGIN:
+        case JKSN_TOKEN_OBJECT_BEGIN:
+        case JKSN_TOKEN_SWAPPED_BEGIN:
+            this->frames.push_back(Frame({this->reader.token, std::vector<JKSNValue>()}));
             break;
-        case JKSN_OBJECT:
-            this->data_object = that.data_object;
+        case JKSN_TOKEN_END:
+            {
+                JKSNValue value = this->endFrame(this->frames.back());
+                this->frames.pop_back();
+                this->pushValue(std::move(value));
+            }
             break;
         default:
             break;
         }
-        this->data_type = that.data_type;
-        that.data_type = JKSN_UNDEFINED;
+        if(this->reader.complete) {
+            this->reader.complete = false;
+            this->message_begin = true;
+            return JKSN_FEED_VALUE;
+        }
+    }
+}
+
+bool JKSNIncrementalDecoderPrivate::readToken() {
+    JKSNBufferInput saved_fp = this->reader.fp;
+    JKSNReaderPrivate::Frame saved_frame = JKSNReaderPrivate::Frame();
+    if(!this->reader.frames.empty())
+        saved_frame = this->reader.frames.back();
+    size_t checksums = this->reader.checksums.size();
+    this->decoder->cache.mark();
+    /* Prefixes may change the hashtable before the token turns out to be cut short,
+       and so may the keys and values of a shaped object, which is read as one token */
+    std::unique_ptr<JKSNDocumentState> saved_state;
+    if(saved_fp.remaining() != 0) {
+        uint8_t control = uint8_t(saved_fp.current()[0]);
+        if((control & 0xf0) == 0x70 || (control & 0xf0) == 0xf0 || control == 0xca || this->decoder->isShapedObject(control))
+            saved_state.reset(new JKSNDocumentState(this->reader.state));
+    }
+    try {
+        this->reader.next();
+        this->decoder->cache.release();
+        return true;
+    } catch(const JKSNTruncatedError &) {
+        /* Containers are only begun or ended after all their bytes are read */
+        this->reader.fp = saved_fp;
+        if(!this->reader.frames.empty())
+            this->reader.frames.back() = saved_frame;
+        this->reader.checksums.erase(this->reader.checksums.begin() + std::ptrdiff_t(checksums), this->reader.checksums.end());
+        this->decoder->cache.rollback();
+        if(saved_state)
+            this->reader.state.restore(*saved_state);
+        return false;
     }
-    return *this;
 }
 
+void JKSNIncrementalDecoderPrivate::pushValue(JKSNValue &&value) {
+    if(this->frames.empty())
+        this->value = std::move(value);
+    else
+        this->frames.back().items.push_back(std::move(value));
+}
+
+JKSNValue JKSNIncrementalDecoderPrivate::endFrame(Frame &frame) {
+    switch(frame.token) {
+    case JKSN_TOKEN_ARRAY_BEGIN:
+        return JKSNValue(std::move(frame.items));
+    case JKSN_TOKEN_OBJECT_BEGIN:
+        {
+            JKSNObject result;
+            result.reserve(frame.items.size()/2);
+            for(size_t i = 0; i + 1 < frame.items.size(); i += 2)
+                result[std::move(frame.items[i])] = std::move(frame.items[i+1]);
+            return JKSNValue(std::move(result));
+        }
+    default:
+        {
+            std::vector<JKSNValue> result;
+            for(size_t i = 0; i + 1 < frame.items.size(); i += 2) {
+                std::vector<JKSNValue> &column_values = frame.items[i+1].toVector();
+                for(size_t j = 0; j < column_values.size(); ++j) {
+                    if(j == result.size())
+                        result.push_back(JKSNValue::fromObject(JKSNObject()));
+                    if(!column_values[j].isUnspecified())
+                        result[j].toObject()[frame.items[i]] = std::move(column_values[j]);
+                }
+            }
+            return JKSNValue(std::move(result));
+        }
+    }
+}
 }
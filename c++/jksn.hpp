@@ -21,6 +21,7 @@
 #ifndef _JKSN_HPP_INCLUDED
 #define _JKSN_HPP_INCLUDED
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
@@ -74,9 +75,191 @@ typedef enum {
     JKSN_UNSPECIFIED
 } jksn_data_type;
 
+typedef enum {
+    JKSN_TOKEN_NONE,
+    JKSN_TOKEN_VALUE,
+    JKSN_TOKEN_ARRAY_BEGIN,
+    JKSN_TOKEN_OBJECT_BEGIN,
+    JKSN_TOKEN_SWAPPED_BEGIN,
+    JKSN_TOKEN_END
+} jksn_token_type;
+
+typedef enum {
+    JKSN_FEED_NEED_MORE,
+    JKSN_FEED_VALUE,
+    JKSN_FEED_ERROR
+} jksn_feed_status;
+
+typedef enum {
+    JKSN_OPTIMIZE_DEFAULT,
+    /* Counts the strings of each value first and places the most used ones in the hashtable up front */
+    JKSN_OPTIMIZE_DICTIONARY
+} jksn_optimization_level;
+
+typedef struct {
+    /* Strings placed in the hashtable ahead of the value */
+    size_t strings;
+    /* Against the same value encoded in one pass, the smaller of both is kept */
+    size_t bytes_saved;
+    /* Time spent on the extra pass and on choosing the strings */
+    double seconds;
+} jksn_dictionary_stats;
+
+/* Extensions use the implementation-defined control bytes 0xe0 to 0xef.
+   Both sides have to agree on them beforehand, then the encoder announces
+   them in a pragma, which turns them on in the decoder. */
+typedef enum {
+    JKSN_EXTENSION_NONE = 0,
+    /* 0xe0 and 0xe1, 8 and 16-bit references to the last 65536 strings */
+    JKSN_EXTENSION_DICTIONARY = 1 << 0,
+    /* 0xe2, arrays of doubles XOR compressed against the one before */
+    JKSN_EXTENSION_FLOAT_ARRAY = 1 << 1,
+    /* 0xe3, arrays of integers or floats as one block of big-endian items */
+    JKSN_EXTENSION_TYPED_ARRAY = 1 << 2,
+    /* 0xe4, arrays of integers in blocks of 128, bit-packed against the
+       smallest of each block or as deltas */
+    JKSN_EXTENSION_BIT_PACKED = 1 << 3,
+    /* 0xe5, arrays of booleans eight to a byte, with a bitmap of which are
+       there if some are Unspecified */
+    JKSN_EXTENSION_BOOL_ARRAY = 1 << 4,
+    /* 0xe6 and 0xe7, objects sending their keys once, then only the
+       number of the key set and the values */
+    JKSN_EXTENSION_SHAPES = 1 << 5,
+    /* No control byte of its own, integers anywhere in the value of a
+       string key are deltas against the last integer of that key */
+    JKSN_EXTENSION_KEY_DELTAS = 1 << 6,
+    JKSN_EXTENSION_ALL = JKSN_EXTENSION_DICTIONARY | JKSN_EXTENSION_FLOAT_ARRAY | JKSN_EXTENSION_TYPED_ARRAY |
+        JKSN_EXTENSION_BIT_PACKED | JKSN_EXTENSION_BOOL_ARRAY | JKSN_EXTENSION_SHAPES | JKSN_EXTENSION_KEY_DELTAS
+} jksn_extension;
+
+typedef enum {
+    JKSN_CHECKSUM_NONE,
+    JKSN_CHECKSUM_DJB_HASH,
+    JKSN_CHECKSUM_CRC32,
+    JKSN_CHECKSUM_SHA256
+} jksn_checksum_type;
+
 class Unspecified {
 };
 
+class JKSNStringView {
+public:
+    JKSNStringView() {
+    }
+    JKSNStringView(const char *data, size_t size) :
+        view_data(data),
+        view_size(size) {
+    }
+    JKSNStringView(const char *data) :
+        view_data(data),
+        view_size(std::char_traits<char>::length(data)) {
+    }
+    JKSNStringView(const std::string &data) :
+        view_data(data.data()),
+        view_size(data.size()) {
+    }
+    const char *data() const {
+        return this->view_data;
+    }
+    size_t size() const {
+        return this->view_size;
+    }
+    bool empty() const {
+        return this->view_size == 0;
+    }
+    const char *begin() const {
+        return this->view_data;
+    }
+    const char *end() const {
+        return this->view_data + this->view_size;
+    }
+    char operator[](size_t index) const {
+        return this->view_data[index];
+    }
+    std::string toString() const {
+        return std::string(this->view_data, this->view_size);
+    }
+    explicit operator std::string() const {
+        return this->toString();
+    }
+    bool operator==(const JKSNStringView &that) const {
+        return this->view_size == that.view_size &&
+            std::char_traits<char>::compare(this->view_data, that.view_data, this->view_size) == 0;
+    }
+    bool operator!=(const JKSNStringView &that) const {
+        return !(*this == that);
+    }
+    bool operator<(const JKSNStringView &that) const {
+        int result = std::char_traits<char>::compare(this->view_data, that.view_data, std::min(this->view_size, that.view_size));
+        return result != 0 ? result < 0 : this->view_size < that.view_size;
+    }
+private:
+    const char *view_data = nullptr;
+    size_t view_size = 0;
+};
+
+class JKSNValue;
+
+class JKSNObject {
+    /* Note: Members are kept in insertion order, which is also the order they
+             are encoded in. Small objects are searched linearly, larger ones
+             get a hash index. Keys must not be modified through iterators. */
+public:
+    typedef std::pair<JKSNValue, JKSNValue> value_type;
+    typedef std::vector<value_type>::iterator iterator;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+    JKSNObject();
+    JKSNObject(const std::map<JKSNValue, JKSNValue> &data);
+    JKSNObject(std::initializer_list<std::pair<const JKSNValue, JKSNValue> > data);
+    JKSNObject(const JKSNObject &that);
+    JKSNObject(JKSNObject &&that);
+    JKSNObject &operator=(const JKSNObject &that);
+    JKSNObject &operator=(JKSNObject &&that);
+    ~JKSNObject();
+
+    size_t size() const;
+    bool empty() const;
+    void reserve(size_t size);
+    void clear();
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+
+    iterator find(const JKSNValue &key);
+    const_iterator find(const JKSNValue &key) const;
+    size_t count(const JKSNValue &key) const;
+    JKSNValue &at(const JKSNValue &key);
+    const JKSNValue &at(const JKSNValue &key) const;
+    JKSNValue &operator[](const JKSNValue &key);
+    JKSNValue &operator[](JKSNValue &&key);
+    std::pair<iterator, bool> insert(const value_type &item);
+    std::pair<iterator, bool> insert(value_type &&item);
+    /* Erasing keeps the order of the remaining members, so it takes linear time */
+    iterator erase(const_iterator pos);
+    size_t erase(const JKSNValue &key);
+
+    std::map<JKSNValue, JKSNValue> toMap() const;
+    explicit operator std::map<JKSNValue, JKSNValue>() const {
+        return this->toMap();
+    }
+    /* Member order does not matter for comparison */
+    bool operator==(const JKSNObject &that) const;
+    bool operator!=(const JKSNObject &that) const {
+        return !(*this == that);
+    }
+private:
+    std::vector<value_type> items;
+    /* Open addressing table of item positions plus one, empty for small objects */
+    std::vector<size_t> index;
+    static size_t hashKey(const JKSNValue &key);
+    size_t lookup(const JKSNValue &key) const;
+    iterator append(value_type &&item);
+    void rebuildIndex();
+};
+
 class JKSNValue {
 public:
     JKSNValue() :
@@ -124,16 +307,20 @@ public:
         data_long_double(data) {
     }
     JKSNValue(const std::string &data, bool is_blob = false) :
-        data_type(is_blob ? JKSN_BLOB : JKSN_STRING),
-        data_string(new std::string(data)) {
+        data_type(is_blob ? JKSN_BLOB : JKSN_STRING) {
+        this->setString(data.data(), data.size());
     }
     JKSNValue(std::string &&data, bool is_blob = false) :
-        data_type(is_blob ? JKSN_BLOB : JKSN_STRING),
-        data_string(new std::string(std::move(data))) {
+        data_type(is_blob ? JKSN_BLOB : JKSN_STRING) {
+        this->setString(std::move(data));
     }
     JKSNValue(const char *data, bool is_blob = false) :
-        data_type(is_blob ? JKSN_BLOB : JKSN_STRING),
-        data_string(new std::string(data)) {
+        data_type(is_blob ? JKSN_BLOB : JKSN_STRING) {
+        this->setString(data, std::char_traits<char>::length(data));
+    }
+    JKSNValue(const JKSNStringView &data, bool is_blob = false) :
+        data_type(is_blob ? JKSN_BLOB : JKSN_STRING) {
+        this->setString(data.data(), data.size());
     }
     JKSNValue(const std::vector<JKSNValue> &data) :
         data_type(JKSN_ARRAY),
@@ -147,13 +334,17 @@ public:
         data_type(JKSN_ARRAY),
         data_array(new std::vector<JKSNValue>(data)) {
     }
-    JKSNValue(const std::map<JKSNValue, JKSNValue> &data) :
+    JKSNValue(const JKSNObject &data) :
+        data_type(JKSN_OBJECT),
+        data_object(new JKSNObject(data)) {
+    }
+    JKSNValue(JKSNObject &&data) :
         data_type(JKSN_OBJECT),
-        data_object(new std::map<JKSNValue, JKSNValue>(data)) {
+        data_object(new JKSNObject(std::move(data))) {
     }
-    JKSNValue(std::map<JKSNValue, JKSNValue> &&data) :
+    JKSNValue(const std::map<JKSNValue, JKSNValue> &data) :
         data_type(JKSN_OBJECT),
-        data_object(new std::map<JKSNValue, JKSNValue>(std::move(data))) {
+        data_object(new JKSNObject(data)) {
     }
     JKSNValue(const Unspecified &) :
         data_type(JKSN_UNSPECIFIED) {
@@ -227,15 +418,21 @@ public:
     static JKSNValue fromVector(std::initializer_list<JKSNValue> data) {
         return JKSNValue(data);
     }
-    static JKSNValue fromMap(const std::map<JKSNValue, JKSNValue> &data) {
+    static JKSNValue fromObject(const JKSNObject &data) {
         return JKSNValue(data);
     }
-    static JKSNValue fromMap(std::map<JKSNValue, JKSNValue> &&data) {
+    static JKSNValue fromObject(JKSNObject &&data) {
         return JKSNValue(std::move(data));
     }
-    static JKSNValue fromMap(std::initializer_list<std::pair<const JKSNValue, JKSNValue> > data) {
+    static JKSNValue fromObject(std::initializer_list<std::pair<const JKSNValue, JKSNValue> > data) {
+        return JKSNValue(JKSNObject(data));
+    }
+    static JKSNValue fromMap(const std::map<JKSNValue, JKSNValue> &data) {
         return JKSNValue(data);
     }
+    static JKSNValue fromMap(std::initializer_list<std::pair<const JKSNValue, JKSNValue> > data) {
+        return JKSNValue(JKSNObject(data));
+    }
     static JKSNValue fromUnspecified(const Unspecified &data) {
         return JKSNValue(data);
     }
@@ -246,7 +443,9 @@ public:
     ~JKSNValue() {
         switch(this->getType()) {
         case JKSN_STRING:
-            delete this->data_string;
+        case JKSN_BLOB:
+            if(this->data_short_size == long_string)
+                delete this->data_string;
             break;
         case JKSN_ARRAY:
             delete this->data_array;
@@ -344,6 +543,15 @@ public:
     std::string toBlob() const {
         return this->toString();
     };
+    /* Note: The view is invalidated when this value is modified, moved or destroyed */
+    JKSNStringView toStringView() const {
+        if(!this->isStringOrBlob())
+            throw JKSNTypeError();
+        else if(this->data_short_size == long_string)
+            return JKSNStringView(*this->data_string);
+        else
+            return JKSNStringView(this->data_short, this->data_short_size);
+    }
     const std::vector<JKSNValue> &toVector() const {
         if(this->isArray())
             return *this->data_array;
@@ -356,18 +564,22 @@ public:
         else
             throw JKSNTypeError();
     }
-    const std::map<JKSNValue, JKSNValue> &toMap() const {
+    const JKSNObject &toObject() const {
         if(this->isObject())
             return *this->data_object;
         else
             throw JKSNTypeError();
     }
-    std::map<JKSNValue, JKSNValue> &toMap() {
+    JKSNObject &toObject() {
         if(this->isObject())
             return *this->data_object;
         else
             throw JKSNTypeError();
     }
+    /* A copy in key order. It is const so that code which changed the map
+       in place fails to compile instead of changing the copy; change the
+       members through toObject() instead. */
+    const std::map<JKSNValue, JKSNValue> toMap() const;
     Unspecified toUnspecified() const {
         if(this->isUnspecified())
             return Unspecified();
@@ -408,11 +620,11 @@ public:
     explicit operator std::vector<JKSNValue>() const {
         return this->toVector();
     }
-    explicit operator const std::map<JKSNValue, JKSNValue> &() const {
-        return this->toMap();
+    explicit operator const JKSNObject &() const {
+        return this->toObject();
     }
-    explicit operator std::map<JKSNValue, JKSNValue> &() {
-        return this->toMap();
+    explicit operator JKSNObject &() {
+        return this->toObject();
     }
     explicit operator std::map<JKSNValue, JKSNValue>() const {
         return this->toMap();
@@ -429,7 +641,7 @@ public:
             else
                 throw JKSNTypeError();
         case JKSN_OBJECT:
-            return this->toMap().at(index);
+            return this->toObject().at(index);
         default:
             throw JKSNTypeError();
         }
@@ -442,7 +654,7 @@ public:
             else
                 throw JKSNTypeError();
         case JKSN_OBJECT:
-            return this->toMap().at(index);
+            return this->toObject().at(index);
         default:
             throw JKSNTypeError();
         }
@@ -452,7 +664,7 @@ public:
         case JKSN_ARRAY:
             return this->toVector().at(index);
         case JKSN_OBJECT:
-            return this->toMap().at(JKSNValue(index));
+            return this->toObject().at(JKSNValue(index));
         default:
             throw JKSNTypeError();
         }
@@ -462,32 +674,32 @@ public:
         case JKSN_ARRAY:
             return this->toVector().at(index);
         case JKSN_OBJECT:
-            return this->toMap().at(JKSNValue(index));
+            return this->toObject().at(JKSNValue(index));
         default:
             throw JKSNTypeError();
         }
     }
     JKSNValue &at(const std::string &index) {
         if(this->isObject())
-            return this->toMap().at(JKSNValue(index));
+            return this->toObject().at(JKSNValue(index));
         else
             throw JKSNTypeError();
     }
     const JKSNValue &at(const std::string &index) const {
         if(this->isObject())
-            return this->toMap().at(JKSNValue(index));
+            return this->toObject().at(JKSNValue(index));
         else
             throw JKSNTypeError();
     }
     JKSNValue &at(const char *index) {
         if(this->isObject())
-            return this->toMap().at(JKSNValue(index));
+            return this->toObject().at(JKSNValue(index));
         else
             throw JKSNTypeError();
     }
     const JKSNValue &at(const char *index) const {
         if(this->isObject())
-            return this->toMap().at(JKSNValue(index));
+            return this->toObject().at(JKSNValue(index));
         else
             throw JKSNTypeError();
     }
@@ -499,7 +711,7 @@ public:
             else
                 throw JKSNTypeError();
         case JKSN_OBJECT:
-            return this->toMap()[index];
+            return this->toObject()[index];
         default:
             throw JKSNTypeError();
         }
@@ -509,26 +721,26 @@ public:
         case JKSN_ARRAY:
             return this->toVector()[index];
         case JKSN_OBJECT:
-            return this->toMap()[JKSNValue(index)];
+            return this->toObject()[JKSNValue(index)];
         default:
             throw JKSNTypeError();
         }
     }
     JKSNValue &operator[](const std::string &index) {
         if(this->isObject())
-            return this->toMap().at(JKSNValue(index));
+            return this->toObject().at(JKSNValue(index));
         else
             throw JKSNTypeError();
     }
     JKSNValue &operator[](std::string &&index) {
         if(this->isObject())
-            return this->toMap().at(JKSNValue(std::move(index)));
+            return this->toObject().at(JKSNValue(std::move(index)));
         else
             throw JKSNTypeError();
     }
     JKSNValue &operator[](const char *index) {
         if(this->isObject())
-            return this->toMap().at(JKSNValue(index));
+            return this->toObject().at(JKSNValue(index));
         else
             throw JKSNTypeError();
     }
@@ -551,9 +763,17 @@ public:
     }
 
 private:
+    friend class JKSNEncoderPrivate;
+    friend class JKSNObject;
+    /* Strings and blobs up to this size are stored inline, without a heap allocation */
+    static const size_t short_string_capacity = 16;
+    static const uint8_t long_string = 0xff;
     jksn_data_type data_type = JKSN_UNDEFINED;
+    /* Size of an inline string or blob, or long_string if it is stored in data_string */
+    uint8_t data_short_size = long_string;
     union {
         const void *data_padding = nullptr;
+        char data_short[short_string_capacity];
         bool data_bool;
         intmax_t data_int;
         float data_float;
@@ -561,10 +781,213 @@ private:
         long double data_long_double;
         std::string *data_string;
         std::vector<JKSNValue> *data_array;
-        std::map<JKSNValue, JKSNValue> *data_object;
+        JKSNObject *data_object;
     };
 
     template<typename T> T toNumber() const;
+    void setString(const char *data, size_t size) {
+        if(size <= short_string_capacity) {
+            std::char_traits<char>::copy(this->data_short, data, size);
+            this->data_short_size = uint8_t(size);
+        } else {
+            this->data_string = new std::string(data, size);
+            this->data_short_size = long_string;
+        }
+    }
+    void setString(std::string &&data) {
+        if(data.size() <= short_string_capacity)
+            this->setString(data.data(), data.size());
+        else {
+            this->data_string = new std::string(std::move(data));
+            this->data_short_size = long_string;
+        }
+    }
+};
+
+inline size_t JKSNObject::size() const {
+    return this->items.size();
+}
+
+inline bool JKSNObject::empty() const {
+    return this->items.empty();
+}
+
+inline JKSNObject::iterator JKSNObject::begin() {
+    return this->items.begin();
+}
+
+inline JKSNObject::iterator JKSNObject::end() {
+    return this->items.end();
+}
+
+inline JKSNObject::const_iterator JKSNObject::begin() const {
+    return this->items.cbegin();
+}
+
+inline JKSNObject::const_iterator JKSNObject::end() const {
+    return this->items.cend();
+}
+
+inline JKSNObject::const_iterator JKSNObject::cbegin() const {
+    return this->items.cbegin();
+}
+
+inline JKSNObject::const_iterator JKSNObject::cend() const {
+    return this->items.cend();
+}
+
+class JKSNView {
+    /* Note: A view is invalidated when its document is cleared or parsed into again */
+public:
+    JKSNView() {
+    }
+    jksn_data_type getType() const;
+    bool isUndefined() const {
+        return this->getType() == JKSN_UNDEFINED;
+    }
+    bool isNull() const {
+        return this->getType() == JKSN_NULL;
+    }
+    bool isBool() const {
+        return this->getType() == JKSN_BOOL;
+    }
+    bool isInt() const {
+        return this->getType() == JKSN_INT;
+    }
+    bool isNumber() const {
+        jksn_data_type type = this->getType();
+        return type == JKSN_INT || type == JKSN_FLOAT || type == JKSN_DOUBLE || type == JKSN_LONG_DOUBLE;
+    }
+    bool isString() const {
+        return this->getType() == JKSN_STRING;
+    }
+    bool isBlob() const {
+        return this->getType() == JKSN_BLOB;
+    }
+    bool isStringOrBlob() const {
+        jksn_data_type type = this->getType();
+        return type == JKSN_STRING || type == JKSN_BLOB;
+    }
+    bool isArray() const {
+        return this->getType() == JKSN_ARRAY;
+    }
+    bool isObject() const {
+        return this->getType() == JKSN_OBJECT;
+    }
+    bool isUnspecified() const {
+        return this->getType() == JKSN_UNSPECIFIED;
+    }
+
+    bool toBool() const;
+    intmax_t toInt() const;
+    float toFloat() const;
+    double toDouble() const;
+    long double toLongDouble() const;
+    JKSNStringView toStringView() const;
+    std::string toString() const;
+    JKSNValue toValue() const;
+    /* The items of an array of numbers, as an array of doubles */
+    std::vector<double> toDoubleVector() const;
+    /* The items of an array of booleans as a bitset, Unspecified ones false */
+    std::vector<bool> toBoolVector() const;
+
+    /* Number of elements of an array, members of an object, or bytes of a string */
+    size_t size() const;
+    JKSNView operator[](size_t index) const;
+    JKSNView at(size_t index) const;
+    JKSNView at(const JKSNStringView &key) const;
+    size_t count(const JKSNStringView &key) const;
+    /* Object members, in the order they appear in the stream */
+    JKSNView key(size_t index) const;
+    JKSNView value(size_t index) const;
+
+private:
+    friend class JKSNDocument;
+    friend class JKSNReader;
+    friend class JKSNIncrementalDecoderPrivate;
+    friend class JKSNSessionReader;
+    friend class JKSNDecoderPrivate;
+    JKSNView(const class JKSNNode *node) :
+        node(node) {
+    }
+    const JKSNNode *node = nullptr;
+    const JKSNNode &getNode() const;
+    const JKSNNode *find(const JKSNStringView &key) const;
+};
+
+class JKSNDocument {
+    /* Note: The whole tree lives in an arena owned by the document, so it is
+             released at once by clear() or by parsing into the document again,
+             and the memory is kept for the next message.
+             By default strings, blobs and object keys point into the parsed
+             buffer, which must outlive the document. Only UTF-16 strings are
+             transcoded and owned by the document. With copy_strings set, they
+             are copied into the arena and the buffer can be dropped. */
+public:
+    JKSNDocument();
+    explicit JKSNDocument(bool copy_strings);
+    JKSNDocument(const JKSNDocument &that) = delete;
+    JKSNDocument(JKSNDocument &&that);
+    JKSNDocument &operator=(const JKSNDocument &that) = delete;
+    JKSNDocument &operator=(JKSNDocument &&that);
+    ~JKSNDocument();
+    JKSNView root() const;
+    size_t bytesParsed() const;
+    /* Bytes of memory held by the arena, including unused space */
+    size_t capacity() const;
+    void clear();
+private:
+    friend class JKSNDecoder;
+    friend class JKSNIndex;
+    friend JKSNView parse(const char *buffer, size_t size, JKSNDocument &document, bool header);
+    friend JKSNView find(const char *buffer, size_t size, const JKSNStringView &path, JKSNDocument &document, bool header);
+    std::unique_ptr<class JKSNDocumentPrivate> p;
+};
+
+class JKSNIndex {
+    /* Note: Indexing validates a whole message and records every value in a
+             flat tape, in the order they appear, with back-references and
+             delta integers already resolved. Entries are numbered from 0,
+             the root, and a container is followed by its items, or by its
+             members as key, value, key, value... A row-col swapped array is
+             recorded as the array of objects it stands for.
+             Any subtree can then be materialized without parsing again, in
+             time proportional to its size. Strings and blobs point into the
+             indexed buffer, which must outlive the index and any document
+             materialized without copy_strings, as must the index itself.
+             Materializing does not modify the index, so subtrees can be
+             materialized into separate documents from several threads. */
+public:
+    JKSNIndex();
+    JKSNIndex(const JKSNIndex &that) = delete;
+    JKSNIndex(JKSNIndex &&that);
+    JKSNIndex &operator=(const JKSNIndex &that) = delete;
+    JKSNIndex &operator=(JKSNIndex &&that);
+    ~JKSNIndex();
+    /* Number of entries in the tape */
+    size_t size() const;
+    jksn_data_type getType(size_t entry) const;
+    /* Offset of the control byte in the buffer, including the header */
+    size_t offset(size_t entry) const;
+    uint8_t control(size_t entry) const;
+    /* The entry just past this one and everything in it */
+    size_t end(size_t entry) const;
+    /* Number of elements of an array, members of an object, or bytes of a string */
+    size_t length(size_t entry) const;
+    /* The entry of an array item, or of an object member value */
+    size_t at(size_t entry, size_t index) const;
+    size_t at(size_t entry, const JKSNStringView &key) const;
+    /* The entry at a path like "/user/tags/3", see JKSNDecoder::find */
+    size_t find(const JKSNStringView &path) const;
+    /* Replaces the contents of the document with the subtree at the entry */
+    JKSNView materialize(size_t entry, JKSNDocument &document) const;
+    JKSNValue toValue(size_t entry) const;
+    size_t bytesParsed() const;
+    void clear();
+private:
+    friend class JKSNDecoder;
+    friend void index(const char *buffer, size_t size, JKSNIndex &result, bool header);
+    std::unique_ptr<class JKSNIndexPrivate> p;
 };
 
 class JKSNEncoder {
@@ -578,10 +1001,82 @@ public:
     ~JKSNEncoder();
     std::ostream &dump(const JKSNValue &obj, std::ostream &result, bool header = true);
     std::string dump(const JKSNValue &obj, bool header = true);
+    /* Appends to result, so the same buffer can be reused across dumps */
+    std::string &dump(const JKSNValue &obj, std::string &result, bool header = true);
+    /* Each dump is checksummed, a delayed checksum follows the value instead of preceding it */
+    void setChecksum(jksn_checksum_type type, bool delayed = false);
+    /* Sends the strings in a hashtable refresher before the next value, so
+       the decoder has them beforehand and even their first mention in a
+       message is a 2-byte reference. Strings the decoder already has are
+       left out, and of strings that share a hash the last one stays.
+       With clear set, the hashtable is emptied first. */
+    void refreshHashtable(const std::vector<std::string> &strings, bool clear = false);
+    /* Applies to dump(), a JKSNWriter always encodes in one pass */
+    void setOptimization(jksn_optimization_level level);
+    /* What the dictionary pass did in the last dump */
+    const jksn_dictionary_stats &dictionaryStats() const;
+    /* Extensions the decoder agreed to, see jksn_extension. Changing them
+       writes a pragma before the next value. Without any, nothing outside
+       the specification is written. */
+    void setExtensions(unsigned extensions);
 private:
+    friend class JKSNWriter;
     std::unique_ptr<class JKSNEncoderPrivate> p;
 };
 
+class JKSNWriter {
+    /* Note: Values are encoded as soon as they are pushed, without building a
+             JKSNValue tree. A writer made from an encoder shares its hashtable
+             and last integer, so back-references and delta integers work
+             across dumps and writers. Arrays are never row-col swapped here,
+             since that needs every row; pass a JKSNValue to value() for that.
+             beginArray() without a size writes a lengthless array.
+             With an ostream, output is flushed in chunks while writing,
+             except under an immediate checksum set on the encoder, which
+             is only known once the value is complete. */
+public:
+    JKSNWriter(std::string &result, bool header = true);
+    JKSNWriter(std::ostream &result, bool header = true);
+    JKSNWriter(JKSNEncoder &encoder, std::string &result, bool header = true);
+    JKSNWriter(JKSNEncoder &encoder, std::ostream &result, bool header = true);
+    JKSNWriter(const JKSNWriter &that) = delete;
+    JKSNWriter(JKSNWriter &&that);
+    JKSNWriter &operator=(const JKSNWriter &that) = delete;
+    JKSNWriter &operator=(JKSNWriter &&that);
+    ~JKSNWriter();
+    JKSNWriter &beginArray();
+    JKSNWriter &beginArray(size_t size);
+    JKSNWriter &beginObject(size_t size);
+    JKSNWriter &end();
+    JKSNWriter &key(const JKSNStringView &key);
+    JKSNWriter &value(std::nullptr_t data);
+    JKSNWriter &value(bool data);
+    JKSNWriter &value(intmax_t data);
+    JKSNWriter &value(uintmax_t data);
+    JKSNWriter &value(int data);
+    JKSNWriter &value(unsigned data);
+    JKSNWriter &value(float data);
+    JKSNWriter &value(double data);
+    JKSNWriter &value(long double data);
+    JKSNWriter &value(const char *data);
+    JKSNWriter &value(const std::string &data);
+    JKSNWriter &value(const JKSNStringView &data);
+    JKSNWriter &value(const Unspecified &data);
+    JKSNWriter &value(const JKSNValue &data);
+    JKSNWriter &blob(const JKSNStringView &data);
+    /* A whole array of numbers, packed if an extension allows */
+    JKSNWriter &array(const int32_t *data, size_t size);
+    JKSNWriter &array(const int64_t *data, size_t size);
+    JKSNWriter &array(const float *data, size_t size);
+    JKSNWriter &array(const double *data, size_t size);
+    JKSNWriter &array(const std::vector<bool> &data);
+    /* Whether a whole value has been written */
+    bool complete() const;
+    void flush();
+private:
+    std::unique_ptr<class JKSNWriterPrivate> p;
+};
+
 class JKSNDecoder {
     /* Note: With a certain JKSN decoder, the hashtable is preserved during each parse */
 public:
@@ -593,22 +1088,157 @@ public:
     ~JKSNDecoder();
     JKSNValue parse(std::istream &fp, bool header = true);
     JKSNValue parse(const std::string &str, bool header = true);
+    JKSNValue parse(const char *buffer, size_t size, bool header = true);
+    /* bytes_parsed receives the length of the parsed value, including the header */
+    JKSNValue parse(const char *buffer, size_t size, size_t &bytes_parsed, bool header = true);
+    JKSNView parse(const char *buffer, size_t size, JKSNDocument &document, bool header = true);
+    /* Decodes only the value at a path like "/user/tags/3", where ~1 stands for
+       "/" and ~0 for "~". Everything else is skimmed, which only keeps the
+       hashtable and the last integer up to date. The first matching key wins.
+       Throws std::out_of_range if nothing is found. */
+    JKSNView find(const char *buffer, size_t size, const JKSNStringView &path, JKSNDocument &document, bool header = true);
+    JKSNValue find(const char *buffer, size_t size, const JKSNStringView &path, bool header = true);
+    /* Fills the index with the whole message, see JKSNIndex */
+    void index(const char *buffer, size_t size, JKSNIndex &result, bool header = true);
+    /* Extensions a pragma in the stream may turn on, all of them by default.
+       Others are refused with JKSNDecodeError. */
+    void setExtensions(unsigned extensions);
 private:
+    friend class JKSNReader;
+    friend class JKSNIncrementalDecoder;
+    friend class JKSNSessionReader;
     std::unique_ptr<class JKSNDecoderPrivate> p;
 };
 
+class JKSNReader {
+    /* Note: Tokens are read one at a time from a buffer that must outlive the
+             reader, and nothing is built for containers. Back-references and
+             delta integers are resolved to values; a reader made from a decoder
+             shares its hashtable and last integer, and hands them back once
+             the whole value is read.
+             Each scalar is a JKSN_TOKEN_VALUE, see value().getType(). Object
+             members come as key, value, key, value... and are followed by
+             JKSN_TOKEN_END, like array items.
+             A row-col swapped array comes as JKSN_TOKEN_SWAPPED_BEGIN with
+             column name and column array pairs. With transpose set, it is
+             decoded at once and comes as an array of objects instead. */
+public:
+    JKSNReader(const char *buffer, size_t size, bool header = true, bool transpose = false);
+    JKSNReader(JKSNDecoder &decoder, const char *buffer, size_t size, bool header = true, bool transpose = false);
+    JKSNReader(const JKSNReader &that) = delete;
+    JKSNReader(JKSNReader &&that);
+    JKSNReader &operator=(const JKSNReader &that) = delete;
+    JKSNReader &operator=(JKSNReader &&that);
+    ~JKSNReader();
+    /* Returns JKSN_TOKEN_NONE once the whole value is read */
+    jksn_token_type next();
+    jksn_token_type getToken() const;
+    /* The current scalar, valid until the next token */
+    JKSNView value() const;
+    /* Items, members or columns of the container just begun, unknown_size for lengthless arrays */
+    size_t size() const;
+    static const size_t unknown_size = size_t(-1);
+    bool isKey() const;
+    /* Number of containers begun and not yet ended */
+    size_t depth() const;
+    /* At a begin token, reads up to the matching JKSN_TOKEN_END */
+    void skip();
+    /* Including the header */
+    size_t bytesParsed() const;
+private:
+    std::unique_ptr<class JKSNReaderPrivate> p;
+};
+
+class JKSNIncrementalDecoder {
+    /* Note: Bytes are fed as they arrive, for example from a non-blocking
+             socket, and a value is returned once it is complete. Containers
+             and strings may be split anywhere across calls. Only the bytes
+             not consumed yet are kept between calls, and nothing is kept
+             when a call ends on a value boundary.
+             A decoder made from a JKSNDecoder shares its hashtable and last
+             integer. Consecutive values may be fed back to back; the bytes
+             after a value are kept for the next call, which may pass none.
+             Once an error is returned, every later call returns it too. */
+public:
+    explicit JKSNIncrementalDecoder(bool header = true);
+    JKSNIncrementalDecoder(JKSNDecoder &decoder, bool header = true);
+    JKSNIncrementalDecoder(const JKSNIncrementalDecoder &that) = delete;
+    JKSNIncrementalDecoder(JKSNIncrementalDecoder &&that);
+    JKSNIncrementalDecoder &operator=(const JKSNIncrementalDecoder &that) = delete;
+    JKSNIncrementalDecoder &operator=(JKSNIncrementalDecoder &&that);
+    ~JKSNIncrementalDecoder();
+    jksn_feed_status feed(const char *buffer, size_t size);
+    /* The value completed by the last call, valid until the next one */
+    JKSNValue &value();
+    /* Why JKSN_FEED_ERROR was returned */
+    const std::string &error() const;
+    /* Bytes kept for the next call */
+    size_t buffered() const;
+private:
+    std::unique_ptr<class JKSNIncrementalDecoderPrivate> p;
+};
+
+class JKSNSessionReader {
+    /* Note: Values are read one after another from a buffer holding several
+             messages back to back, such as one read from a socket, each with
+             an optional header. The hashtable and last integer are kept from
+             one value to the next, and the memory of each value is reused
+             for the next one.
+             A value cut short at the end of the buffer is left unread, so it
+             can be read again once more bytes arrive; bytesParsed() tells
+             where it begins. */
+public:
+    JKSNSessionReader(const char *buffer, size_t size, bool header = true);
+    JKSNSessionReader(JKSNDecoder &decoder, const char *buffer, size_t size, bool header = true);
+    JKSNSessionReader(const JKSNSessionReader &that) = delete;
+    JKSNSessionReader(JKSNSessionReader &&that);
+    JKSNSessionReader &operator=(const JKSNSessionReader &that) = delete;
+    JKSNSessionReader &operator=(JKSNSessionReader &&that);
+    ~JKSNSessionReader();
+    /* Returns false once no whole value is left */
+    bool next();
+    /* The current value, valid until the next one or until the buffer changes */
+    JKSNView value() const;
+    /* Where the current value begins and ends, including its header */
+    size_t begin() const;
+    size_t end() const;
+    /* Bytes of whole values read so far */
+    size_t bytesParsed() const;
+    /* Continues with another buffer, keeping the hashtable */
+    void reset(const char *buffer, size_t size);
+private:
+    std::unique_ptr<class JKSNSessionReaderPrivate> p;
+};
+
 inline std::ostream &dump(const JKSNValue &obj, std::ostream &result, bool header = true) {
     return JKSNEncoder().dump(obj, result, header);
 }
 inline std::string dump(const JKSNValue &obj, bool header = true) {
     return JKSNEncoder().dump(obj, header);
 }
+inline std::string &dump(const JKSNValue &obj, std::string &result, bool header = true) {
+    return JKSNEncoder().dump(obj, result, header);
+}
 inline JKSNValue parse(std::istream &fp, bool header = true) {
     return JKSNDecoder().parse(fp, header);
 }
 inline JKSNValue parse(const std::string &str, bool header = true) {
     return JKSNDecoder().parse(str, header);
 }
+inline JKSNValue parse(const char *buffer, size_t size, bool header = true) {
+    return JKSNDecoder().parse(buffer, size, header);
+}
+inline JKSNValue parse(const char *buffer, size_t size, size_t &bytes_parsed, bool header = true) {
+    return JKSNDecoder().parse(buffer, size, bytes_parsed, header);
+}
+JKSNView parse(const char *buffer, size_t size, JKSNDocument &document, bool header = true);
+/* Without a decoder to keep in step, the input is only read up to the value found */
+JKSNView find(const char *buffer, size_t size, const JKSNStringView &path, JKSNDocument &document, bool header = true);
+JKSNValue find(const char *buffer, size_t size, const JKSNStringView &path, bool header = true);
+inline JKSNValue find(const std::string &str, const JKSNStringView &path, bool header = true) {
+    return find(str.data(), str.size(), path, header);
+}
+void index(const char *buffer, size_t size, JKSNIndex &result, bool header = true);
 
 }
 
@@ -628,15 +1258,10 @@ struct hash<JKSN::JKSNValue> {
         case JKSN::JKSN_BOOL:
             result = hash<bool>()(value.toBool());
             break;
+        /* Numbers of different types may compare equal, so they share one hash */
         case JKSN::JKSN_INT:
-            result = hash<intmax_t>()(value.toInt());
-            break;
         case JKSN::JKSN_FLOAT:
-            result = hash<float>()(value.toFloat());
-            break;
         case JKSN::JKSN_DOUBLE:
-            result = hash<double>()(value.toDouble());
-            break;
         case JKSN::JKSN_LONG_DOUBLE:
             result = hash<long double>()(value.toLongDouble());
             break;
@@ -649,7 +1274,7 @@ struct hash<JKSN::JKSNValue> {
                 result ^= (*this)(i);
             break;
         case JKSN::JKSN_OBJECT:
-            for(const pair<JKSN::JKSNValue, JKSN::JKSNValue> &i : value.toMap()) {
+            for(const JKSN::JKSNObject::value_type &i : value.toObject()) {
                 result ^= (*this)(i.first);
                 result ^= (*this)(i.second);
             }
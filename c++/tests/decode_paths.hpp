@@ -0,0 +1,118 @@
+#ifndef _JKSN_TESTS_DECODE_PATHS_HPP_INCLUDED
+#define _JKSN_TESTS_DECODE_PATHS_HPP_INCLUDED
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "jksn.hpp"
+
+/* Decodes back-to-back messages with every path that keeps the state between them,
+   returns how many of the paths differ */
+inline int check(const char *name, const std::vector<std::string> &messages, const std::vector<JKSN::JKSNValue> &expected) {
+    std::string stream;
+    for(const std::string &message : messages)
+        stream += message;
+    int differs = 0;
+    auto report = [&](const char *path, bool identical) {
+        std::cerr << name << ", " << path << ": " << (identical ? "identical" : "differs") << std::endl;
+        differs += !identical;
+    };
+    bool identical = true;
+
+    JKSN::JKSNDecoder decoder;
+    for(size_t i = 0; i < messages.size(); ++i)
+        identical = identical && decoder.parse(messages[i]) == expected[i];
+    report("parse", identical);
+
+    identical = true;
+    decoder = JKSN::JKSNDecoder();
+    std::istringstream input(stream);
+    for(size_t i = 0; i < messages.size(); ++i)
+        identical = identical && decoder.parse(input) == expected[i];
+    report("parse(istream)", identical);
+
+    identical = true;
+    decoder = JKSN::JKSNDecoder();
+    for(size_t i = 0; i < messages.size(); ++i) {
+        JKSN::JKSNDocument document;
+        identical = identical && decoder.parse(messages[i].data(), messages[i].size(), document).toValue() == expected[i];
+    }
+    report("document", identical);
+
+    identical = true;
+    decoder = JKSN::JKSNDecoder();
+    for(size_t i = 0; i < messages.size(); ++i)
+        identical = identical && decoder.find(messages[i].data(), messages[i].size(), "") == expected[i];
+    report("find", identical);
+
+    identical = true;
+    decoder = JKSN::JKSNDecoder();
+    for(size_t i = 0; i < messages.size(); ++i) {
+        JKSN::JKSNIndex index;
+        decoder.index(messages[i].data(), messages[i].size(), index);
+        identical = identical && index.toValue(0) == expected[i];
+    }
+    report("index", identical);
+
+    /* Skimming has to keep the dictionary in step too */
+    decoder = JKSN::JKSNDecoder();
+    for(size_t i = 0; i + 1 < messages.size(); ++i) {
+        JKSN::JKSNReader reader(decoder, messages[i].data(), messages[i].size());
+        if(reader.next() != JKSN::JKSN_TOKEN_VALUE)
+            reader.skip();
+        reader.next();
+    }
+    identical = decoder.parse(messages.back()) == expected.back();
+    report("skim", identical);
+
+    JKSN::JKSNIncrementalDecoder incremental;
+    size_t values = 0;
+    identical = true;
+    for(char c : stream)
+        for(JKSN::jksn_feed_status status = incremental.feed(&c, 1); status == JKSN::JKSN_FEED_VALUE; status = incremental.feed(nullptr, 0))
+            identical = identical && values < expected.size() && incremental.value() == expected[values++];
+    report("incremental", identical && values == expected.size());
+
+    /* The session reader gets the stream cut short first */
+    identical = true;
+    values = 0;
+    JKSN::JKSNSessionReader session(stream.data(), stream.size() - 1);
+    while(session.next())
+        identical = identical && session.value().toValue() == expected[values++];
+    session.reset(stream.data() + session.end(), stream.size() - session.end());
+    while(session.next())
+        identical = identical && session.value().toValue() == expected[values++];
+    report("session", identical && values == expected.size());
+    return differs;
+}
+
+/* Each message announces the extensions itself */
+inline std::string pack(const JKSN::JKSNValue &value, JKSN::jksn_extension extensions) {
+    JKSN::JKSNEncoder encoder;
+    encoder.setExtensions(extensions);
+    return encoder.dump(value);
+}
+
+/* Decodes one message with every path, returns how many of them differ */
+inline int countDiffers(const std::string &buffer, const JKSN::JKSNValue &expected) {
+    int differs = 0;
+    differs += JKSN::parse(buffer) != expected;
+    std::istringstream stream(buffer);
+    differs += JKSN::parse(stream) != expected;
+    JKSN::JKSNDocument document;
+    differs += JKSN::parse(buffer.data(), buffer.size(), document).toValue() != expected;
+    differs += JKSN::find(buffer, "") != expected;
+    JKSN::JKSNIndex index;
+    JKSN::index(buffer.data(), buffer.size(), index);
+    differs += index.toValue(0) != expected;
+    JKSN::JKSNIncrementalDecoder incremental;
+    size_t values = 0;
+    for(char c : buffer)
+        for(JKSN::jksn_feed_status status = incremental.feed(&c, 1); status == JKSN::JKSN_FEED_VALUE; status = incremental.feed(nullptr, 0))
+            differs += values++ != 0 || incremental.value() != expected;
+    differs += values != 1;
+    return differs;
+}
+
+#endif
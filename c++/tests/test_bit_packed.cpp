@@ -0,0 +1,90 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+#include "decode_paths.hpp"
+
+static double millisecondsToParse(const std::string &buffer) {
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < 20; ++i) {
+        JKSN::JKSNDocument document;
+        JKSN::parse(buffer.data(), buffer.size(), document);
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / 20;
+}
+
+int main() {
+    int failures = 0;
+    /* Near-monotonic IDs and timestamps */
+    std::vector<JKSN::JKSNValue> rows;
+    uint32_t seed = 1;
+    int64_t timestamp = 1700000000000;
+    for(int i = 0; i < 5000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        timestamp += 1000 + (seed >> 16) % 50;
+        rows.push_back(JKSN::JKSNValue::fromObject({
+            {"id", 100000 + i + ((seed >> 8) % 4 == 0 ? 1 : 0)},
+            {"ts", intmax_t(timestamp)},
+            {"level", (seed >> 20) % 5}
+        }));
+    }
+    JKSN::JKSNValue table(std::move(rows));
+    std::string plain = JKSN::dump(table);
+    std::string typed = pack(table, JKSN::JKSN_EXTENSION_TYPED_ARRAY);
+    std::string buffer = pack(table, JKSN::JKSN_EXTENSION_BIT_PACKED);
+    std::cerr << "Columns: " << plain.size() << " bytes, typed: " << typed.size() << " bytes, bit-packed: " << buffer.size() << " bytes" << std::endl;
+    int table_differ = countDiffers(buffer, table);
+    failures += table_differ;
+    std::cerr << "Bit-packed: " << table_differ << " paths differ" << std::endl;
+    std::cerr << "/4321/ts: " << (JKSN::find(buffer, "/4321/ts") == table.toVector()[4321].toObject().at("ts") ? "identical" : "differs") << std::endl;
+    JKSN::JKSNReader reader(buffer.data(), buffer.size());
+    size_t tokens = 0;
+    while(reader.next() != JKSN::JKSN_TOKEN_NONE)
+        ++tokens;
+    std::cerr << "Reader: " << tokens << " tokens" << std::endl;
+    std::cerr << "Parse: " << millisecondsToParse(plain) << " ms, bit-packed: " << millisecondsToParse(buffer) << " ms" << std::endl;
+
+    /* Values across the whole range do not overflow, INT64_MIN aside as JKSN has no room for it */
+    std::vector<int64_t> extremes = {INT64_MIN + 1, INT64_MAX, 0, -1, INT64_MIN + 1, INT64_MIN + 2, INT64_MAX, INT64_MAX - 1};
+    uint64_t state = 1;
+    while(extremes.size() < 300) {
+        state = state * 6364136223846793005u + 1442695040888963407u;
+        if(int64_t(state) != INT64_MIN)
+            extremes.push_back(int64_t(state));
+    }
+    JKSN::JKSNValue extremes_value(std::vector<JKSN::JKSNValue>(extremes.begin(), extremes.end()));
+    std::string extremes_buffer = pack(extremes_value, JKSN::JKSN_EXTENSION_BIT_PACKED);
+    int extremes_differ = countDiffers(extremes_buffer, extremes_value);
+    failures += extremes_differ;
+    std::cerr << "Extremes: " << JKSN::dump(extremes_value).size() << " bytes, bit-packed: " << extremes_buffer.size() << " bytes, " << extremes_differ << " paths differ" << std::endl;
+    /* And blocks may be of any width */
+    std::vector<int64_t> walk;
+    int64_t position = 0;
+    for(int i = 0; i < 1000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        position += int64_t((seed >> 16) % (i % 64 + 1)) - (i % 64) / 2;
+        walk.push_back(i % 300 == 0 ? position << (i % 50) : position);
+    }
+    JKSN::JKSNEncoder encoder;
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_BIT_PACKED);
+    std::string written;
+    JKSN::JKSNWriter(encoder, written).array(walk.data(), walk.size());
+    std::vector<JKSN::JKSNValue> expected(walk.begin(), walk.end());
+    int walk_differ = countDiffers(written, JKSN::JKSNValue(std::move(expected)));
+    failures += walk_differ;
+    std::cerr << "Random walk: " << walk_differ << " paths differ" << std::endl;
+
+    /* A block that claims more than 64 bits is refused */
+    try {
+        std::string corrupted = buffer;
+        size_t control = corrupted.find('\xe4');
+        corrupted[control + 1 + 2 + 2] = char(0x7f);
+        JKSN::parse(corrupted);
+        std::cerr << "Corrupted width: decoded" << std::endl;
+    } catch(const JKSN::JKSNDecodeError &) {
+    }
+
+    std::cout << buffer;
+    return failures != 0;
+}
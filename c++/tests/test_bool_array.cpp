@@ -0,0 +1,73 @@
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+#include "decode_paths.hpp"
+
+int main() {
+    int failures = 0;
+    /* Thousands of feature flags per row */
+    std::vector<JKSN::JKSNValue> rows;
+    uint32_t seed = 1;
+    for(int i = 0; i < 20; ++i) {
+        std::vector<JKSN::JKSNValue> flags;
+        for(int j = 0; j < 3000; ++j) {
+            seed = seed * 1103515245 + 12345;
+            flags.push_back((seed >> 16) % 3 == 0);
+        }
+        rows.push_back(JKSN::JKSNValue::fromObject({{"user", i}, {"flags", JKSN::JKSNValue(std::move(flags))}}));
+    }
+    JKSN::JKSNValue table(std::move(rows));
+    std::string buffer = pack(table, JKSN::JKSN_EXTENSION_BOOL_ARRAY);
+    int table_differ = countDiffers(buffer, table);
+    failures += table_differ;
+    std::cerr << "Flags: " << JKSN::dump(table).size() << " bytes, packed: " << buffer.size() << " bytes, " << table_differ << " paths differ" << std::endl;
+    std::cerr << "/7/flags/2999: " << (JKSN::find(buffer, "/7/flags/2999") == table.toVector()[7].toObject().at("flags").toVector()[2999] ? "identical" : "differs") << std::endl;
+
+    /* A view hands them back as a bitset, and a writer takes one */
+    std::vector<bool> bits;
+    for(const JKSN::JKSNValue &flag : table.toVector()[3].toObject().at("flags").toVector())
+        bits.push_back(flag.toBool());
+    JKSN::JKSNDocument document;
+    std::cerr << "Bitset: " << (JKSN::parse(buffer.data(), buffer.size(), document)[3].at("flags").toBoolVector() == bits ? "identical" : "differs") << std::endl;
+    JKSN::JKSNEncoder encoder;
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_BOOL_ARRAY);
+    std::string written;
+    JKSN::JKSNWriter(encoder, written).array(bits);
+    std::cerr << "Written: " << written.size() << " bytes, " << (JKSN::parse(written) == table.toVector()[3].toObject().at("flags") ? "identical" : "differs") << std::endl;
+
+    /* Columns of a swapped array keep their missing cells */
+    std::vector<JKSN::JKSNValue> sparse;
+    for(int i = 0; i < 300; ++i) {
+        JKSN::JKSNObject row({{"id", i}, {"active", i % 2 == 0}});
+        if(i % 7 != 0)
+            row["admin"] = i % 5 == 0;
+        sparse.push_back(JKSN::JKSNValue(std::move(row)));
+    }
+    JKSN::JKSNValue sparse_table(std::move(sparse));
+    std::string sparse_buffer = pack(sparse_table, JKSN::JKSN_EXTENSION_BOOL_ARRAY);
+    int sparse_differ = countDiffers(sparse_buffer, sparse_table);
+    failures += sparse_differ;
+    std::cerr << "Sparse: " << JKSN::dump(sparse_table).size() << " bytes, packed: " << sparse_buffer.size() << " bytes, " << sparse_differ << " paths differ" << std::endl;
+    JKSN::JKSNReader reader(sparse_buffer.data(), sparse_buffer.size());
+    size_t unspecified = 0;
+    for(JKSN::jksn_token_type token = reader.next(); token != JKSN::JKSN_TOKEN_NONE; token = reader.next())
+        if(token == JKSN::JKSN_TOKEN_VALUE && reader.value().getType() == JKSN::JKSN_UNSPECIFIED)
+            ++unspecified;
+    std::cerr << "Reader: " << unspecified << " missing cells" << std::endl;
+
+    /* Short arrays stay as they are */
+    JKSN::JKSNValue pair({true, false});
+    std::cerr << "Pair: " << (pack(pair, JKSN::JKSN_EXTENSION_BOOL_ARRAY).size() - pack(nullptr, JKSN::JKSN_EXTENSION_BOOL_ARRAY).size() == JKSN::dump(pair).size() - JKSN::dump(nullptr).size() ? "identical" : "differs") << std::endl;
+
+    /* A packed array that does not hold its items is refused */
+    try {
+        std::string corrupted = written;
+        corrupted[corrupted.find('\xe5') + 3] ^= 0x08;
+        JKSN::parse(corrupted);
+        std::cerr << "Corrupted size: decoded" << std::endl;
+    } catch(const JKSN::JKSNDecodeError &) {
+    }
+
+    std::cout << buffer;
+    return failures != 0;
+}
@@ -0,0 +1,140 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "jksn.hpp"
+
+/* Reads every token, which verifies the checksums on the way */
+static size_t readTokens(const std::string &buffer) {
+    JKSN::JKSNReader reader(buffer.data(), buffer.size());
+    size_t tokens = 0;
+    while(reader.next() != JKSN::JKSN_TOKEN_NONE)
+        ++tokens;
+    return tokens;
+}
+
+static bool feedBytes(const std::string &buffer, const JKSN::JKSNValue &expected) {
+    JKSN::JKSNIncrementalDecoder decoder;
+    for(size_t i = 0; i < buffer.size(); ++i) {
+        JKSN::jksn_feed_status status = decoder.feed(buffer.data() + i, 1);
+        if(status == JKSN::JKSN_FEED_ERROR)
+            throw JKSN::JKSNChecksumError(decoder.error().c_str());
+        if(status == JKSN::JKSN_FEED_VALUE)
+            return i + 1 == buffer.size() && decoder.value() == expected;
+    }
+    return false;
+}
+
+/* Runs every decoding path over the buffer, returns how many of them found it corrupted */
+static int countErrors(const std::string &buffer, const JKSN::JKSNValue &expected) {
+    int errors = 0;
+    try {
+        if(JKSN::parse(buffer) != expected)
+            std::cerr << "parse: differs" << std::endl;
+    } catch(const JKSN::JKSNChecksumError &) {
+        ++errors;
+    }
+    try {
+        std::istringstream stream(buffer);
+        if(JKSN::parse(stream) != expected)
+            std::cerr << "parse(istream): differs" << std::endl;
+    } catch(const JKSN::JKSNChecksumError &) {
+        ++errors;
+    }
+    try {
+        JKSN::JKSNDocument document;
+        if(JKSN::parse(buffer.data(), buffer.size(), document).toValue() != expected)
+            std::cerr << "parse(document): differs" << std::endl;
+    } catch(const JKSN::JKSNChecksumError &) {
+        ++errors;
+    }
+    try {
+        if(JKSN::find(buffer, "") != expected)
+            std::cerr << "find: differs" << std::endl;
+    } catch(const JKSN::JKSNChecksumError &) {
+        ++errors;
+    }
+    try {
+        JKSN::JKSNIndex index;
+        JKSN::index(buffer.data(), buffer.size(), index);
+        if(index.toValue(0) != expected)
+            std::cerr << "index: differs" << std::endl;
+    } catch(const JKSN::JKSNChecksumError &) {
+        ++errors;
+    }
+    try {
+        readTokens(buffer);
+    } catch(const JKSN::JKSNChecksumError &) {
+        ++errors;
+    }
+    try {
+        if(!feedBytes(buffer, expected))
+            std::cerr << "feed: differs" << std::endl;
+    } catch(const JKSN::JKSNChecksumError &) {
+        ++errors;
+    }
+    return errors;
+}
+
+int main() {
+    std::vector<JKSN::JKSNValue> users;
+    for(int i = 0; i < 20; ++i)
+        users.push_back(JKSN::JKSNValue::fromObject({
+            {"id", 1000 + i},
+            {"name", i % 2 ? "元素元素" : "user" + std::to_string(i % 3)},
+            {"tags", JKSN::JKSNValue({"a", "b", JKSN::JKSNValue::fromBlob("blob"), i})}
+        }));
+    JKSN::JKSNValue tree = JKSN::JKSNValue::fromObject({
+        {"users", JKSN::JKSNValue(std::move(users))},
+        {"tail", JKSN::JKSNValue({nullptr, true, 1.5, JKSN::JKSNValue({1, 2})})}
+    });
+
+    /* Known digests over the encoded "abc" */
+    JKSN::JKSNEncoder encoder;
+    encoder.setChecksum(JKSN::JKSN_CHECKSUM_CRC32);
+    std::cerr << "CRC32: " << (encoder.dump("abc", false) == std::string("\xf1\x62\x80\xb0\x1f\x43""abc", 9) ? "identical" : "differs") << std::endl;
+    JKSN::JKSNEncoder delayed_encoder;
+    delayed_encoder.setChecksum(JKSN::JKSN_CHECKSUM_SHA256, true);
+    std::cerr << "SHA-256: " << (delayed_encoder.dump("abc", false) == std::string("\xfc\x43""abc"
+        "\xa5\x53\xae\x69\x86\x5b\x1c\x3e\xfe\xed\x18\x1d\x40\xcd\xb7\x93"
+        "\xab\x95\x05\xa8\xc4\xf7\x6c\x83\x87\x48\x5b\xbc\xbe\xd2\xde\x74", 37) ? "identical" : "differs") << std::endl;
+
+    static const char *names[] = {"none", "DJB hash", "CRC32", "SHA-256"};
+    for(JKSN::jksn_checksum_type type : {JKSN::JKSN_CHECKSUM_DJB_HASH, JKSN::JKSN_CHECKSUM_CRC32, JKSN::JKSN_CHECKSUM_SHA256})
+        for(bool delayed : {false, true}) {
+            JKSN::JKSNEncoder encoder;
+            encoder.setChecksum(type, delayed);
+            std::string buffer = encoder.dump(tree);
+            std::cerr << names[type] << (delayed ? " delayed" : " immediate") << ": " << countErrors(buffer, tree) << " errors";
+            /* Change a letter inside a string */
+            buffer[buffer.find("user") + 1] ^= 0x01;
+            std::cerr << ", " << countErrors(buffer, tree) << " of 7 when corrupted" << std::endl;
+        }
+
+    /* A writer to a stream flushes before a delayed digest is known */
+    JKSN::JKSNEncoder sha256;
+    sha256.setChecksum(JKSN::JKSN_CHECKSUM_SHA256, true);
+    std::ostringstream stream;
+    {
+        JKSN::JKSNWriter writer(sha256, stream);
+        writer.beginArray();
+        for(int i = 0; i < 20000; ++i)
+            writer.value("user" + std::to_string(i));
+        writer.end();
+    }
+    std::cerr << "Streamed delayed SHA-256: " << countErrors(stream.str(), JKSN::parse(stream.str())) << " errors" << std::endl;
+    std::string written;
+    sha256.setChecksum(JKSN::JKSN_CHECKSUM_CRC32);
+    JKSN::JKSNWriter(sha256, written).beginArray(2).value(1).value("x").end();
+    std::cerr << "Written CRC32: " << countErrors(written, JKSN::JKSNValue({1, "x"})) << " errors" << std::endl;
+
+    /* Nested checksums cover the inner digest, and items can have their own */
+    std::string nested("jk!\xf8\xf1\x62\x80\xb0\x1f\x43""abc\xeb", 14);
+    std::cerr << "Nested: " << countErrors(nested, "abc") << " errors" << std::endl;
+    JKSN::JKSNEncoder items;
+    items.setChecksum(JKSN::JKSN_CHECKSUM_DJB_HASH, true);
+    std::string array = "jk!\x82" + items.dump(1, false) + items.dump("abc", false);
+    std::cerr << "Items: " << countErrors(array, JKSN::JKSNValue({1, "abc"})) << " errors" << std::endl;
+
+    std::cout << encoder.dump(tree);
+    return 0;
+}
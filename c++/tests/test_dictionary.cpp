@@ -0,0 +1,44 @@
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+
+int main() {
+    /* A few hundred strings share 256 hashes, so in one pass they keep evicting each other */
+    std::vector<JKSN::JKSNValue> rows;
+    uint32_t seed = 1;
+    for(int i = 0; i < 20000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        unsigned city = (seed >> 16) % 300;
+        rows.push_back(JKSN::JKSNValue::fromObject({
+            {"id", i},
+            {"city", "city" + std::to_string(city)},
+            {"region", city % 2 ? "元素元素" : "region" + std::to_string(city % 7)}
+        }));
+    }
+    JKSN::JKSNValue table(std::move(rows));
+
+    JKSN::JKSNEncoder encoder;
+    std::string plain = encoder.dump(table);
+    encoder = JKSN::JKSNEncoder();
+    encoder.setOptimization(JKSN::JKSN_OPTIMIZE_DICTIONARY);
+    std::string buffer = encoder.dump(table);
+    const JKSN::jksn_dictionary_stats &stats = encoder.dictionaryStats();
+    std::cerr << "One pass: " << plain.size() << " bytes, with dictionary: " << buffer.size() << " bytes" << std::endl;
+    std::cerr << "Dictionary: " << stats.strings << " strings, " << stats.bytes_saved << " bytes saved in " << stats.seconds*1000 << " ms more" << std::endl;
+    if(stats.bytes_saved != plain.size() - buffer.size())
+        std::cerr << "Savings differ" << std::endl;
+    std::cerr << "Parse: " << (JKSN::parse(buffer) == table ? "identical" : "differs") << std::endl;
+    JKSN::JKSNIndex index;
+    JKSN::index(buffer.data(), buffer.size(), index);
+    std::cerr << "Index: " << (index.toValue(0) == table ? "identical" : "differs") << std::endl;
+
+    /* The hashtable carries over, and a value with nothing to gain is encoded in one pass */
+    JKSN::JKSNDecoder decoder;
+    decoder.parse(buffer);
+    JKSN::JKSNValue next({"city7", "city8", "元素元素", "x"});
+    std::string second = encoder.dump(next);
+    std::cerr << "Second message: " << (decoder.parse(second) == next ? "identical" : "differs") << ", " << encoder.dictionaryStats().strings << " strings" << std::endl;
+
+    std::cout << buffer;
+    return 0;
+}
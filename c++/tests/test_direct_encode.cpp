@@ -0,0 +1,78 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../jksn.cpp"
+
+static std::vector<JKSN::JKSNValue> samples() {
+    std::vector<JKSN::JKSNValue> result;
+    result.push_back(JKSN::JKSNValue({
+        nullptr, true, false, 0, 10, -1, 127, -129, 40000, 0x200000, -0x200000, intmax_t(1) << 40, -(intmax_t(1) << 40),
+        100, 101, 99, 130, 1000, 1.5f, 4.2e10, NAN, -INFINITY, 1.25L, JKSN::Unspecified()
+    }));
+    result.push_back(JKSN::JKSNValue({
+        "element", "元素", "element", "元素", "x", "",
+        JKSN::JKSNValue::fromBlob("blob"), JKSN::JKSNValue::fromBlob("blob"), std::string(300, 'a'), std::string(70000, 'b')
+    }));
+    std::vector<JKSN::JKSNValue> rows;
+    for(int i = 0; i < 100; ++i)
+        rows.push_back(JKSN::JKSNValue::fromMap({
+            {"id", 1000 + i},
+            {"name", "user" + std::to_string(i % 7)},
+            {"score", i * 0.5},
+            {"tags", JKSN::JKSNValue({JKSN::JKSNValue::fromMap({{"k", i}}), JKSN::JKSNValue::fromMap({{"k", i + 1}, {"v", "w"}})})}
+        }));
+    rows.push_back(JKSN::JKSNValue::fromMap({{"extra", true}}));
+    result.push_back(JKSN::JKSNValue(std::move(rows)));
+    result.push_back(JKSN::JKSNValue({
+        JKSN::JKSNValue::fromMap({{"a", 1}}),
+        JKSN::JKSNValue::fromMap({{"b", 2}})
+    }));
+    return result;
+}
+
+int main() {
+    const std::vector<JKSN::JKSNValue> values = samples();
+    /* Sizes the proxy encoder wrote before it was retired, the second round
+       with the hashtable and the last integer left over from the first */
+    const size_t expected_sizes[] = {78, 70335, 2569, 9, 78, 20, 2526, 9};
+    bool ok = true;
+    JKSN::JKSNEncoderPrivate direct_encoder;
+    JKSN::JKSNEncoderPrivate echo_encoder;
+    JKSN::JKSNDecoder decoder;
+    size_t sample = 0;
+    for(size_t round = 0; round < 2; ++round)
+        for(const JKSN::JKSNValue &value : values) {
+            std::string direct_result;
+            direct_encoder.dumpToBuffer(value, direct_result);
+            /* Compared as bytes, as NAN is not equal to itself */
+            std::string echo_result;
+            echo_encoder.dumpToBuffer(decoder.parse(direct_result), echo_result);
+            if(direct_result.size() != expected_sizes[sample] || echo_result != direct_result) {
+                std::cout << "Mismatch: " << expected_sizes[sample] << " bytes expected, " << direct_result.size() << " bytes written" << std::endl;
+                ok = false;
+            }
+            ++sample;
+        }
+    /* Deltas between the extremes wrap around, to INTMAX_MIN after -1 */
+    const JKSN::JKSNValue extremes({-1, INTMAX_MAX, -INTMAX_MAX, 1, INTMAX_MAX, -1, -INTMAX_MAX});
+    std::string extremes_result;
+    JKSN::JKSNEncoderPrivate().dumpToBuffer(extremes, extremes_result);
+    if(JKSN::parse(extremes_result) != extremes) {
+        std::cout << "Mismatch: extremes" << std::endl;
+        ok = false;
+    }
+    std::cout << (ok ? "Output is identical" : "Output differs") << std::endl;
+
+    const size_t iterations = 200;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::string buffer;
+    for(size_t i = 0; i < iterations; ++i)
+        for(const JKSN::JKSNValue &value : values) {
+            buffer.clear();
+            JKSN::JKSNEncoderPrivate().dumpToBuffer(value, buffer);
+        }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    std::cout << "Direct encoder: " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << " us" << std::endl;
+    return ok ? 0 : 1;
+}
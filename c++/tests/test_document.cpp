@@ -0,0 +1,18 @@
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include "jksn.hpp"
+
+int main(int argc, char *argv[]) {
+    /* With -c, strings are copied into the document and the input is dropped before dumping */
+    bool copy_strings = argc > 1 && std::strcmp(argv[1], "-c") == 0;
+    std::string buffer((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+    JKSN::JKSNDocument document(copy_strings);
+    JKSN::JKSNView root = JKSN::parse(buffer.data(), buffer.size(), document);
+    std::cerr << "Parsed " << document.bytesParsed() << " of " << buffer.size() << " bytes" << std::endl;
+    if(copy_strings)
+        std::string().swap(buffer);
+    JKSN::dump(root.toValue(), std::cout);
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+#include "decode_paths.hpp"
+
+int main() {
+    int failures = 0;
+    /* More hot strings than the hashtable has slots */
+    std::vector<JKSN::JKSNValue> rows;
+    uint32_t seed = 1;
+    for(int i = 0; i < 5000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        unsigned city = (seed >> 16) % 1000;
+        rows.push_back(JKSN::JKSNValue::fromObject({
+            {"id", i},
+            {"city", "city" + std::to_string(city)},
+            {"region", city % 2 ? "元素" + std::to_string(city % 300) : "region" + std::to_string(city % 300)}
+        }));
+    }
+    JKSN::JKSNValue table(std::move(rows));
+
+    JKSN::JKSNEncoder encoder;
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_DICTIONARY);
+    std::string buffer = encoder.dump(table);
+    std::string plain = JKSN::dump(table);
+    std::cerr << "Without dictionary: " << plain.size() << " bytes, with: " << buffer.size() << " bytes" << std::endl;
+    JKSN::JKSNValue next({"city7", "元素7", "region8", "new"});
+    std::string second = encoder.dump(next);
+    /* Turning it off again is announced as well */
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_NONE);
+    std::string third = encoder.dump(next);
+    failures += check("Hot strings", {buffer, second, third}, {table, next, next});
+
+    /* Entries are replaced once all 65536 are taken */
+    std::vector<JKSN::JKSNValue> many;
+    for(int i = 0; i < 70000; ++i)
+        many.push_back("s" + std::to_string(i));
+    JKSN::JKSNValue first_batch(many);
+    std::vector<JKSN::JKSNValue> reused;
+    for(int i = 0; i < 70000; i += 7)
+        reused.push_back("s" + std::to_string(i));
+    JKSN::JKSNValue second_batch(reused);
+    encoder = JKSN::JKSNEncoder();
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_ALL);
+    std::string evicting = encoder.dump(first_batch);
+    std::string reusing = encoder.dump(second_batch);
+    std::string again = encoder.dump(second_batch);
+    failures += check("Eviction", {evicting, reusing, again}, {first_batch, second_batch, second_batch});
+
+    /* A peer that was not asked gets nothing out of the specification */
+    std::cerr << "Not negotiated: " << (JKSN::JKSNEncoder().dump(table) == plain ? "identical" : "differs") << std::endl;
+    JKSN::JKSNDecoder decoder;
+    decoder.setExtensions(JKSN::JKSN_EXTENSION_NONE);
+    try {
+        decoder.parse(buffer);
+        std::cerr << "Refused extension: decoded" << std::endl;
+    } catch(const JKSN::JKSNDecodeError &) {
+    }
+
+    std::cout << buffer;
+    return failures != 0;
+}
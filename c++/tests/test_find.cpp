@@ -0,0 +1,56 @@
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+
+static void check(const std::string &buffer, const char *path, const JKSN::JKSNValue &expected) {
+    JKSN::JKSNValue found = JKSN::find(buffer, path);
+    std::cerr << path << ": " << (found == expected ? "identical" : "differs") << std::endl;
+}
+
+int main() {
+    /* Skimmed strings, UTF-16 strings and integers are still referred to after them */
+    std::vector<JKSN::JKSNValue> users;
+    for(int i = 0; i < 20; ++i)
+        users.push_back(JKSN::JKSNValue::fromObject({
+            {"id", 1000 + i},
+            {"name", i % 2 ? "元素元素" : "user" + std::to_string(i % 3)},
+            {"tags", JKSN::JKSNValue({"a", "b", JKSN::JKSNValue::fromBlob("blob"), i})}
+        }));
+    JKSN::JKSNValue tree = JKSN::JKSNValue::fromObject({
+        {"skipped", JKSN::JKSNValue({"元素元素", "user1", JKSN::JKSNValue::fromBlob("blob"), 999})},
+        {"users", JKSN::JKSNValue(std::move(users))},
+        {"a/b~c", "escaped"},
+        {"tail", JKSN::JKSNValue({nullptr, true, JKSN::JKSNValue({1, 2})})}
+    });
+    std::string buffer = JKSN::dump(tree);
+
+    check(buffer, "", tree);
+    check(buffer, "/users/7/name", "元素元素");
+    check(buffer, "/users/6/name", "user0");
+    check(buffer, "/users/5", tree.toObject().at("users").toVector()[5]);
+    check(buffer, "/users/19/tags/2", JKSN::JKSNValue::fromBlob("blob"));
+    check(buffer, "/users/19/tags/3", 19);
+    check(buffer, "/users/3/id", 1003);
+    check(buffer, "/a~1b~0c", "escaped");
+    check(buffer, "/tail/2/1", 2);
+
+    for(const char *path : {"/users/20", "/users/x", "/missing", "/tail/0/0"})
+        try {
+            JKSN::find(buffer, path);
+            std::cerr << path << ": was found" << std::endl;
+        } catch(const std::out_of_range &) {
+        }
+
+    /* A decoder reads the whole message, so the next one can refer to its hashtable */
+    JKSN::JKSNEncoder encoder;
+    JKSN::JKSNDecoder decoder;
+    std::string first = encoder.dump(tree);
+    std::string second = encoder.dump(JKSN::JKSNValue({"元素元素", "user2", 1019}));
+    JKSN::JKSNDocument document;
+    JKSN::JKSNView id = decoder.find(first.data(), first.size(), "/users/0/id", document);
+    std::cerr << "First message: " << (id.toInt() == 1000 && document.bytesParsed() == first.size() ? "complete" : "incomplete") << std::endl;
+    std::cerr << "Second message: " << (decoder.parse(second) == JKSN::JKSNValue({"元素元素", "user2", 1019}) ? "identical" : "differs") << std::endl;
+
+    std::cout << buffer;
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+
+int main() {
+    bool ok = true;
+    JKSN::JKSNObject object;
+    for(int i = 999; i >= 0; --i)
+        object["key" + std::to_string(i)] = i;
+    for(int i = 0; i < 1000; ++i)
+        ok = ok && object.at("key" + std::to_string(i)).toInt() == i;
+    ok = ok && object.begin()->first.toString() == "key999" && object.count("key1000") == 0;
+    for(int i = 0; i < 1000; i += 2)
+        object.erase("key" + std::to_string(i));
+    ok = ok && object.size() == 500 && object.count("key10") == 0 && object.at("key11").toInt() == 11;
+    std::cout << (ok ? "Lookups are correct" : "Lookups are wrong") << std::endl;
+
+    /* Round-trips keep the member order, and comparisons ignore it */
+    JKSN::JKSNValue value = JKSN::JKSNValue::fromObject({{"z", 1}, {"a", 2}, {"m", 3}});
+    JKSN::JKSNValue parsed = JKSN::parse(JKSN::dump(value));
+    for(const JKSN::JKSNObject::value_type &item : parsed.toObject())
+        std::cout << item.first.toString() << " ";
+    std::cout << std::endl;
+    std::cout << (parsed == JKSN::JKSNValue::fromMap(value.toMap()) ? "Equal" : "Not equal") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "jksn.hpp"
+
+static bool sameBits(const JKSN::JKSNValue &a, const JKSN::JKSNValue &b) {
+    const std::vector<JKSN::JKSNValue> &x = a.toVector(), &y = b.toVector();
+    if(x.size() != y.size())
+        return false;
+    for(size_t i = 0; i < x.size(); ++i) {
+        double p = x[i].toDouble(), q = y[i].toDouble();
+        if(x[i].getType() != JKSN::JKSN_DOUBLE || y[i].getType() != JKSN::JKSN_DOUBLE || std::memcmp(&p, &q, 8) != 0)
+            return false;
+    }
+    return true;
+}
+
+/* Each message announces the extension itself */
+static std::string pack(const JKSN::JKSNValue &value) {
+    JKSN::JKSNEncoder encoder;
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_FLOAT_ARRAY);
+    return encoder.dump(value);
+}
+
+int main() {
+    /* A slowly changing gauge */
+    std::vector<JKSN::JKSNValue> samples;
+    for(int i = 0; i < 10000; ++i)
+        samples.push_back(20.0 + std::round(std::sin(i / 500.0) * 400) / 100);
+    JKSN::JKSNValue gauge(std::move(samples));
+
+    std::string buffer = pack(gauge);
+    std::string plain = JKSN::dump(gauge);
+    std::cerr << "Gauge: " << plain.size() << " bytes, XOR compressed: " << buffer.size() << " bytes" << std::endl;
+    std::cerr << "Parse: " << (sameBits(JKSN::parse(buffer), gauge) ? "identical" : "differs") << std::endl;
+    std::istringstream stream(buffer);
+    std::cerr << "Parse(istream): " << (sameBits(JKSN::parse(stream), gauge) ? "identical" : "differs") << std::endl;
+    JKSN::JKSNDocument document;
+    std::cerr << "Document: " << (sameBits(JKSN::parse(buffer.data(), buffer.size(), document).toValue(), gauge) ? "identical" : "differs") << std::endl;
+    std::cerr << "/1234: " << (JKSN::find(buffer, "/1234") == gauge.toVector()[1234] ? "identical" : "differs") << std::endl;
+    JKSN::JKSNIndex index;
+    JKSN::index(buffer.data(), buffer.size(), index);
+    std::cerr << "Index: " << index.length(0) << " items, " << (index.toValue(index.find("/9999")) == gauge.toVector()[9999] ? "identical" : "differs") << std::endl;
+
+    /* Special values keep their bits, and columns of a swapped array are packed too */
+    JKSN::JKSNValue special({0.0, -0.0, double(NAN), -double(NAN), double(INFINITY), -double(INFINITY), 5e-324, 1.7976931348623157e308, 0.1, 0.1});
+    std::vector<JKSN::JKSNValue> rows;
+    for(int i = 0; i < 200; ++i)
+        rows.push_back(JKSN::JKSNValue::fromObject({{"ts", 1000 + i}, {"temp", 36.6 + (i % 10) / 10.0}, {"load", i % 3 == 0 ? 0.5 : 0.25}}));
+    JKSN::JKSNValue table(std::move(rows));
+    std::string special_buffer = pack(special);
+    std::string table_buffer = pack(table);
+    std::cerr << "Special values: " << (sameBits(JKSN::parse(special_buffer), special) ? "identical" : "differs") << std::endl;
+    std::cerr << "Swapped: " << JKSN::dump(table).size() << " bytes, XOR compressed: " << table_buffer.size() << " bytes" << std::endl;
+    std::cerr << "/150/temp: " << (JKSN::find(table_buffer, "/150/temp") == table.toVector()[150].toObject().at("temp") ? "identical" : "differs") << std::endl;
+
+    std::string messages = buffer + table_buffer;
+    size_t values = 0;
+    bool identical = true;
+    JKSN::JKSNIncrementalDecoder incremental;
+    for(char c : messages)
+        for(JKSN::jksn_feed_status status = incremental.feed(&c, 1); status == JKSN::JKSN_FEED_VALUE; status = incremental.feed(nullptr, 0))
+            identical = identical && incremental.value() == (values++ == 0 ? gauge : table);
+    std::cerr << "Incremental: " << (identical && values == 2 ? "identical" : "differs") << std::endl;
+    JKSN::JKSNReader reader(table_buffer.data(), table_buffer.size());
+    size_t tokens = 0;
+    while(reader.next() != JKSN::JKSN_TOKEN_NONE)
+        ++tokens;
+    std::cerr << "Reader: " << tokens << " tokens" << std::endl;
+
+    /* Arrays that would not get shorter are left alone */
+    JKSN::JKSNEncoder encoder;
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_FLOAT_ARRAY);
+    encoder.dump(nullptr);
+    std::cerr << "Mixed: " << (encoder.dump(JKSN::JKSNValue({1.5, 2.5, 3})) == JKSN::dump(JKSN::JKSNValue({1.5, 2.5, 3})) ? "identical" : "differs") << std::endl;
+    std::cerr << "Random: " << (encoder.dump(JKSN::JKSNValue({0.1, 1e300})) == JKSN::dump(JKSN::JKSNValue({0.1, 1e300})) ? "identical" : "differs") << std::endl;
+
+    /* A packed array that does not hold its items is refused */
+    try {
+        std::string corrupted = buffer;
+        corrupted[corrupted.find('\xe2') + 3] ^= 0x7f;
+        JKSN::parse(corrupted);
+        std::cerr << "Corrupted size: decoded" << std::endl;
+    } catch(const JKSN::JKSNDecodeError &) {
+    }
+
+    std::cout << buffer;
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+
+/* Feeds the stream in chunks of the given size and counts the values that match */
+static size_t feedChunks(const std::string &stream, size_t chunk, const std::vector<JKSN::JKSNValue> &expected) {
+    JKSN::JKSNIncrementalDecoder decoder;
+    size_t matched = 0;
+    for(size_t i = 0; i < stream.size(); i += chunk) {
+        JKSN::jksn_feed_status status = decoder.feed(stream.data() + i, std::min(chunk, stream.size() - i));
+        while(status == JKSN::JKSN_FEED_VALUE) {
+            if(matched < expected.size() && decoder.value() == expected[matched])
+                ++matched;
+            status = decoder.feed(nullptr, 0);
+        }
+        if(status == JKSN::JKSN_FEED_ERROR) {
+            std::cerr << "Error: " << decoder.error() << std::endl;
+            break;
+        }
+    }
+    if(decoder.buffered() != 0)
+        std::cerr << decoder.buffered() << " bytes left over" << std::endl;
+    return matched;
+}
+
+int main() {
+    std::vector<JKSN::JKSNValue> users;
+    for(int i = 0; i < 20; ++i)
+        users.push_back(JKSN::JKSNValue::fromObject({
+            {"id", 1000 + i},
+            {"name", i % 2 ? "元素元素" : "user" + std::to_string(i % 3)},
+            {"tags", JKSN::JKSNValue({"a", "b", JKSN::JKSNValue::fromBlob("blob"), i})}
+        }));
+    std::vector<JKSN::JKSNValue> expected;
+    expected.push_back(JKSN::JKSNValue::fromObject({
+        {"users", JKSN::JKSNValue(std::move(users))},
+        {"tail", JKSN::JKSNValue({nullptr, true, 1.5, JKSN::JKSNValue({1, 2})})}
+    }));
+    /* Later values refer to the hashtable and last integer of earlier ones */
+    expected.push_back(JKSN::JKSNValue({"元素元素", "user2", 1019, JKSN::JKSNValue::fromBlob("blob")}));
+    expected.push_back(JKSN::JKSNValue(nullptr));
+
+    JKSN::JKSNEncoder encoder;
+    std::string stream;
+    for(const JKSN::JKSNValue &value : expected)
+        encoder.dump(value, stream);
+    std::string lengthless;
+    JKSN::JKSNWriter(encoder, lengthless).beginArray().value(1020).value("user1").beginArray().end().end();
+    stream += lengthless;
+    expected.push_back(JKSN::JKSNValue({1020, "user1", JKSN::JKSNValue(std::vector<JKSN::JKSNValue>())}));
+
+    for(size_t chunk : {size_t(1), size_t(2), size_t(7), size_t(64), stream.size()})
+        std::cerr << "Chunks of " << chunk << " bytes: " << feedChunks(stream, chunk, expected) << " of " << expected.size() << " values" << std::endl;
+
+    JKSN::JKSNIncrementalDecoder decoder;
+    if(decoder.feed("\x81\x6a", 2) != JKSN::JKSN_FEED_ERROR || decoder.feed("\x01", 1) != JKSN::JKSN_FEED_ERROR)
+        std::cerr << "Corrupted stream was not detected" << std::endl;
+
+    std::cout << stream;
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+
+int main() {
+    std::vector<JKSN::JKSNValue> users;
+    for(int i = 0; i < 20; ++i)
+        users.push_back(JKSN::JKSNValue::fromObject({
+            {"id", 1000 + i},
+            {"name", i % 2 ? "元素元素" : "user" + std::to_string(i % 3)},
+            {"tags", JKSN::JKSNValue({"a", "b", JKSN::JKSNValue::fromBlob("blob"), i})}
+        }));
+    JKSN::JKSNValue tree = JKSN::JKSNValue::fromObject({
+        {"元素元素", JKSN::JKSNValue({"元素元素", "user1", JKSN::JKSNValue::fromBlob("blob"), 999})},
+        {"users", JKSN::JKSNValue(std::move(users))},
+        {"tail", JKSN::JKSNValue({nullptr, true, JKSN::JKSNValue({1, 2})})}
+    });
+    std::string buffer = JKSN::dump(tree);
+
+    JKSN::JKSNIndex index;
+    JKSN::index(buffer.data(), buffer.size(), index);
+    std::cerr << "Indexed " << index.size() << " values in " << index.bytesParsed() << " of " << buffer.size() << " bytes" << std::endl;
+    std::cerr << "Root: " << (index.toValue(0) == tree ? "identical" : "differs") << std::endl;
+
+    /* Swapped rows and UTF-16 keys are reached like any other value */
+    size_t user = index.find("/users/7");
+    std::cerr << "/users/7: " << (index.toValue(user) == tree.toObject().at("users").toVector()[7] ? "identical" : "differs") << std::endl;
+    std::cerr << "/users/7/name: " << (index.toValue(index.at(user, "name")) == "元素元素" ? "identical" : "differs") << std::endl;
+    std::cerr << "/元素元素/3: " << (index.toValue(index.find("/元素元素/3")) == 999 ? "identical" : "differs") << std::endl;
+    size_t tail = index.find("/tail");
+    std::cerr << "/tail: " << index.length(tail) << " items at offset " << index.offset(tail) << ", control 0x" << std::hex << unsigned(index.control(tail)) << std::dec << std::endl;
+
+    JKSN::JKSNDocument document(true);
+    JKSN::JKSNView tags = index.materialize(index.find("/users/19/tags"), document);
+    std::cerr << "/users/19/tags: " << (tags.toValue() == JKSN::JKSNValue({"a", "b", JKSN::JKSNValue::fromBlob("blob"), 19}) ? "identical" : "differs") << std::endl;
+
+    try {
+        index.find("/users/20");
+        std::cerr << "/users/20: was found" << std::endl;
+    } catch(const std::out_of_range &) {
+    }
+
+    /* Lengthless arrays are counted once their end is found */
+    std::string lengthless;
+    JKSN::JKSNWriter(lengthless).beginArray().value(1).value("x").beginArray().end().end();
+    JKSN::index(lengthless.data(), lengthless.size(), index);
+    std::cerr << "Lengthless array: " << index.length(0) << " items, " << (index.toValue(0) == JKSN::JKSNValue({1, "x", JKSN::JKSNValue(std::vector<JKSN::JKSNValue>())}) ? "identical" : "differs") << std::endl;
+
+    /* A decoder keeps the hashtable for the next message */
+    JKSN::JKSNEncoder encoder;
+    JKSN::JKSNDecoder decoder;
+    std::string first = encoder.dump(tree);
+    std::string second = encoder.dump(JKSN::JKSNValue({"元素元素", "user2", 1019}));
+    decoder.index(first.data(), first.size(), index);
+    decoder.index(second.data(), second.size(), index);
+    std::cerr << "Second message: " << (index.toValue(0) == JKSN::JKSNValue({"元素元素", "user2", 1019}) ? "identical" : "differs") << std::endl;
+
+    std::cout << buffer;
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+#include "decode_paths.hpp"
+
+/* Events with a counter, a clock and a gauge, which are close to their own last value but not to each other */
+static std::vector<JKSN::JKSNValue> events(uint32_t &seed, int first, int count) {
+    std::vector<JKSN::JKSNValue> result;
+    for(int i = first; i < first + count; ++i) {
+        seed = seed * 1103515245 + 12345;
+        result.push_back(JKSN::JKSNValue::fromObject({
+            {"id", 100000 + i},
+            {"ts", intmax_t(1700000000000) + i * 1000 + (seed >> 16) % 50},
+            {"count", 5000 + (i % 40) * 3},
+            {"温度", -200 + i % 9}
+        }));
+        /* Mixed with other values, so it is not swapped */
+        if(i % 10 == 9)
+            result.push_back("heartbeat");
+    }
+    return result;
+}
+
+int main() {
+    int failures = 0;
+    uint32_t seed = 1;
+    JKSN::JKSNValue first(events(seed, 0, 2000));
+    JKSN::JKSNValue second(events(seed, 2000, 100));
+    JKSN::JKSNEncoder plain_encoder, encoder;
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_KEY_DELTAS);
+    std::string plain = plain_encoder.dump(first);
+    std::string buffer = encoder.dump(first);
+    /* The next message goes on from the last value of each key */
+    std::string next = encoder.dump(second);
+    std::cerr << "Without key deltas: " << plain.size() << " bytes, with: " << buffer.size() << " bytes, next: " << plain_encoder.dump(second).size() << " bytes, with: " << next.size() << " bytes" << std::endl;
+    failures += check("Events", {buffer, next}, {first, second});
+    std::cerr << "/1234/ts: " << (JKSN::find(buffer, "/1234/ts") == first.toVector()[1234].toObject().at("ts") ? "identical" : "differs") << std::endl;
+    JKSN::JKSNReader reader(buffer.data(), buffer.size());
+    size_t tokens = 0;
+    while(reader.next() != JKSN::JKSN_TOKEN_NONE)
+        ++tokens;
+    std::cerr << "Reader: " << tokens << " tokens" << std::endl;
+
+    /* Nested values and swapped columns use the context of their own key */
+    std::vector<JKSN::JKSNValue> rows;
+    for(int i = 0; i < 300; ++i)
+        rows.push_back(JKSN::JKSNValue::fromObject({
+            {"id", 7000 + i},
+            {"position", JKSN::JKSNValue::fromObject({{"x", 100000 + i * 3}, {"y", -100000 - i}})},
+            {"samples", JKSN::JKSNValue({1000000 + i, 1000000 + i * 2})}
+        }));
+    JKSN::JKSNValue nested = JKSN::JKSNValue::fromObject({{"rows", JKSN::JKSNValue(std::move(rows))}, {"total", 300}});
+    std::string nested_buffer = encoder.dump(nested);
+    failures += check("Nested", {buffer, next, nested_buffer}, {first, second, nested});
+
+    /* Turning it off forgets the last value of every key */
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_NONE);
+    std::string off = encoder.dump(second);
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_KEY_DELTAS);
+    std::string on = encoder.dump(second);
+    failures += check("Reset", {buffer, off, on}, {first, second, second});
+
+    /* With every other extension */
+    JKSN::JKSNEncoder all;
+    all.setExtensions(JKSN::JKSN_EXTENSION_ALL);
+    std::string all_buffer = all.dump(first);
+    std::string all_nested = all.dump(nested);
+    failures += check("All extensions", {all_buffer, all_nested}, {first, nested});
+
+    /* A writer streams the events one by one */
+    JKSN::JKSNEncoder writer_encoder;
+    writer_encoder.setExtensions(JKSN::JKSN_EXTENSION_KEY_DELTAS);
+    std::string written, written_plain;
+    JKSN::JKSNWriter writer(writer_encoder, written), plain_writer(written_plain);
+    for(JKSN::JKSNWriter *each : {&writer, &plain_writer}) {
+        each->beginArray();
+        for(const JKSN::JKSNValue &event : second.toVector())
+            if(event.isObject()) {
+                each->beginObject(3).key("id").value(event.toObject().at("id"));
+                each->key("ts").value(event.toObject().at("ts").toInt());
+                each->key("count").beginArray(1).value(event.toObject().at("count")).end().end();
+            }
+        each->end();
+    }
+    std::vector<JKSN::JKSNValue> expected;
+    for(const JKSN::JKSNValue &event : second.toVector())
+        if(event.isObject())
+            expected.push_back(JKSN::JKSNValue::fromObject({
+                {"id", event.toObject().at("id")},
+                {"ts", event.toObject().at("ts")},
+                {"count", JKSN::JKSNValue({event.toObject().at("count")})}
+            }));
+    std::cerr << "Written: " << written_plain.size() << " bytes, with key deltas: " << written.size() << " bytes, " << (JKSN::parse(written) == JKSN::JKSNValue(std::move(expected)) ? "identical" : "differs") << std::endl;
+
+    /* A peer that was not asked gets the deltas against the last integer */
+    std::cerr << "Not negotiated: " << (JKSN::JKSNEncoder().dump(first) == plain ? "identical" : "differs") << std::endl;
+    JKSN::JKSNDecoder decoder;
+    decoder.setExtensions(JKSN::JKSN_EXTENSION_NONE);
+    try {
+        decoder.parse(buffer);
+        std::cerr << "Refused extension: decoded" << std::endl;
+    } catch(const JKSN::JKSNDecodeError &) {
+    }
+
+    std::cout << buffer;
+    return failures != 0;
+}
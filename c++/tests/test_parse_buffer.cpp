@@ -0,0 +1,13 @@
+#include <iostream>
+#include <iterator>
+#include <string>
+#include "jksn.hpp"
+
+int main() {
+    std::string buffer((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+    size_t bytes_parsed;
+    JKSN::JKSNValue value = JKSN::parse(buffer.data(), buffer.size(), bytes_parsed);
+    std::cerr << "Parsed " << bytes_parsed << " of " << buffer.size() << " bytes" << std::endl;
+    JKSN::dump(value, std::cout);
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include "jksn.hpp"
+
+/* Rebuilds the value from the tokens, starting at the current one */
+static JKSN::JKSNValue readValue(JKSN::JKSNReader &reader) {
+    switch(reader.getToken()) {
+    case JKSN::JKSN_TOKEN_VALUE:
+        return reader.value().toValue();
+    case JKSN::JKSN_TOKEN_ARRAY_BEGIN:
+        {
+            std::vector<JKSN::JKSNValue> result;
+            while(reader.next() != JKSN::JKSN_TOKEN_END)
+                result.push_back(readValue(reader));
+            return JKSN::JKSNValue(std::move(result));
+        }
+    case JKSN::JKSN_TOKEN_OBJECT_BEGIN:
+        {
+            JKSN::JKSNObject result;
+            while(reader.next() != JKSN::JKSN_TOKEN_END) {
+                JKSN::JKSNValue key = readValue(reader);
+                reader.next();
+                result[std::move(key)] = readValue(reader);
+            }
+            return JKSN::JKSNValue(std::move(result));
+        }
+    case JKSN::JKSN_TOKEN_SWAPPED_BEGIN:
+        {
+            std::vector<JKSN::JKSNValue> result;
+            while(reader.next() != JKSN::JKSN_TOKEN_END) {
+                JKSN::JKSNValue column_name = readValue(reader);
+                reader.next();
+                const std::vector<JKSN::JKSNValue> column = readValue(reader).toVector();
+                if(result.size() < column.size())
+                    result.resize(column.size(), JKSN::JKSNValue::fromObject(JKSN::JKSNObject()));
+                for(size_t i = 0; i < column.size(); ++i)
+                    if(!column[i].isUnspecified())
+                        result[i].toObject()[column_name] = column[i];
+            }
+            return JKSN::JKSNValue(std::move(result));
+        }
+    default:
+        throw JKSN::JKSNDecodeError("unexpected token");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    /* With -t, row-col swapped arrays are transposed by the reader */
+    bool transpose = argc > 1 && std::strcmp(argv[1], "-t") == 0;
+    std::string buffer((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+    JKSN::JKSNReader reader(buffer.data(), buffer.size(), true, transpose);
+    reader.next();
+    JKSN::JKSNValue value = readValue(reader);
+    if(reader.next() != JKSN::JKSN_TOKEN_NONE)
+        std::cerr << "Reader did not finish" << std::endl;
+    std::cerr << "Parsed " << reader.bytesParsed() << " of " << buffer.size() << " bytes" << std::endl;
+    JKSN::dump(value, std::cout);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "jksn.hpp"
+
+int main() {
+    std::vector<JKSN::JKSNValue> messages;
+    for(int i = 0; i < 10; ++i)
+        messages.push_back(JKSN::JKSNValue::fromObject({
+            {"id", 1000 + i},
+            {"name", i % 2 ? "元素元素" : "user" + std::to_string(i % 3)},
+            {"status", "online"}
+        }));
+    std::vector<std::string> hot = {"id", "name", "status", "online", "元素元素", "user0", "user1", "user2"};
+
+    /* Every message starts with a fresh encoder and decoder, as after reconnecting */
+    size_t cold_size = 0, warm_size = 0;
+    for(const JKSN::JKSNValue &message : messages) {
+        cold_size += JKSN::dump(message).size();
+        JKSN::JKSNEncoder encoder;
+        encoder.refreshHashtable(hot);
+        std::string preload = encoder.dump(nullptr);
+        std::string buffer = encoder.dump(message);
+        warm_size += buffer.size();
+        JKSN::JKSNDecoder decoder;
+        decoder.parse(preload);
+        if(decoder.parse(buffer) != message)
+            std::cerr << "Message " << message.toObject().at("id").toInt() << " differs" << std::endl;
+    }
+    std::cerr << "Without refresher: " << cold_size << " bytes, with: " << warm_size << " bytes" << std::endl;
+
+    /* Strings already there are left out, and clearing drops everything queued before */
+    JKSN::JKSNEncoder encoder;
+    encoder.refreshHashtable({"status", "online"});
+    std::string first = encoder.dump(messages[0]);
+    encoder.refreshHashtable({"status", "online"});
+    std::string second = encoder.dump(nullptr);
+    std::cerr << "Refresher of known strings: " << (second == JKSN::dump(nullptr) ? "omitted" : "sent") << std::endl;
+    encoder.refreshHashtable({"id"});
+    encoder.refreshHashtable({"name", "status"}, true);
+    std::string third = encoder.dump(messages[1]);
+    std::string fourth = encoder.dump(messages[2]);
+
+    std::string stream = first + second + third + fourth;
+    JKSN::JKSNDecoder decoder;
+    std::istringstream input(stream);
+    bool identical = decoder.parse(input) == messages[0] && decoder.parse(input) == JKSN::JKSNValue(nullptr) &&
+        decoder.parse(input) == messages[1] && decoder.parse(input) == messages[2];
+    std::cerr << "Stream: " << (identical ? "identical" : "differs") << std::endl;
+
+    JKSN::JKSNIncrementalDecoder incremental;
+    size_t values = 0;
+    for(char c : stream)
+        for(JKSN::jksn_feed_status status = incremental.feed(&c, 1); status == JKSN::JKSN_FEED_VALUE; status = incremental.feed(nullptr, 0))
+            ++values;
+    std::cerr << "Incremental: " << values << " of 4 values" << std::endl;
+
+    /* A writer sends the refresher before its value too */
+    encoder.refreshHashtable({"offline"});
+    std::string written;
+    JKSN::JKSNWriter(encoder, written).beginArray(2).value("offline").value("offline").end();
+    std::cerr << "Writer: " << (decoder.parse(written) == JKSN::JKSNValue({"offline", "offline"}) ? "identical" : "differs") << std::endl;
+
+    std::cout << stream;
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+
+int main() {
+    std::vector<JKSN::JKSNValue> expected;
+    for(int i = 0; i < 5; ++i)
+        expected.push_back(JKSN::JKSNValue::fromObject({
+            {"id", 1000 + i},
+            {"name", i % 2 ? "元素元素" : "user"},
+            {"data", JKSN::JKSNValue::fromBlob("blob")}
+        }));
+    /* Back-references and delta integers span values, and only some have a header */
+    JKSN::JKSNEncoder encoder;
+    std::string stream;
+    std::vector<size_t> begins;
+    for(size_t i = 0; i < expected.size(); ++i) {
+        begins.push_back(stream.size());
+        encoder.dump(expected[i], stream, i % 2 == 0);
+    }
+
+    /* The last value is cut short, as if the socket had more to send */
+    size_t cut = stream.size() - 2;
+    JKSN::JKSNSessionReader reader(stream.data(), cut);
+    size_t count = 0;
+    while(reader.next()) {
+        std::cerr << "Value " << count << " at " << reader.begin() << ".." << reader.end() << ": " << (reader.value().toValue() == expected[count] ? "identical" : "differs") << std::endl;
+        ++count;
+    }
+    std::cerr << "Parsed " << reader.bytesParsed() << " of " << cut << " bytes" << std::endl;
+
+    /* The rest is read again once it has arrived */
+    std::string rest = stream.substr(reader.bytesParsed());
+    reader.reset(rest.data(), rest.size());
+    while(reader.next()) {
+        std::cerr << "Value " << count << " at " << reader.begin() << ".." << reader.end() << ": " << (reader.value().toValue() == expected[count] ? "identical" : "differs") << std::endl;
+        ++count;
+    }
+    std::cerr << "Read " << count << " of " << expected.size() << " values" << std::endl;
+
+    /* Or cut inside the header of the next value */
+    for(size_t header_part = 1; header_part < 3; ++header_part) {
+        JKSN::JKSNSessionReader split(stream.data(), begins[2] + header_part);
+        count = 0;
+        while(split.next())
+            ++count;
+        std::cerr << "Cut after \"" << stream.substr(begins[2], header_part) << "\": " << count << " values, " << split.bytesParsed() << " of " << begins[2] << " bytes" << std::endl;
+    }
+
+    std::cout << stream;
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+#include "decode_paths.hpp"
+
+int main() {
+    int failures = 0;
+    /* RPC responses, the same records again and again, not always in an array */
+    std::vector<JKSN::JKSNValue> responses;
+    for(int i = 0; i < 50; ++i) {
+        std::vector<JKSN::JKSNValue> items;
+        for(int j = 0; j < 5; ++j) {
+            JKSN::JKSNObject item;
+            /* Keys are inserted in a different order each time */
+            if((i + j) % 2) {
+                item["status"] = j % 3 ? "ok" : "retry";
+                item["requestId"] = i * 100 + j;
+                item["elapsedMilliseconds"] = 0.5 * j;
+            } else {
+                item["elapsedMilliseconds"] = 0.5 * j;
+                item["requestId"] = i * 100 + j;
+                item["status"] = j % 3 ? "ok" : "retry";
+            }
+            items.push_back(JKSN::JKSNValue(std::move(item)));
+        }
+        /* Mixed with other values, so it is not swapped */
+        items.push_back("end");
+        responses.push_back(JKSN::JKSNValue::fromObject({
+            {"jsonrpc", "2.0"},
+            {"id", i},
+            {"result", JKSN::JKSNValue::fromObject({{"items", JKSN::JKSNValue(std::move(items))}, {"more", i % 2 == 0}})}
+        }));
+    }
+
+    JKSN::JKSNEncoder plain_encoder, encoder;
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_SHAPES);
+    std::vector<std::string> messages;
+    size_t plain_size = 0, size = 0;
+    for(const JKSN::JKSNValue &response : responses) {
+        plain_size += plain_encoder.dump(response).size();
+        messages.push_back(encoder.dump(response));
+        size += messages.back().size();
+    }
+    std::cerr << "Without shapes: " << plain_size << " bytes, with: " << size << " bytes" << std::endl;
+    failures += check("Responses", messages, responses);
+
+    /* Turning them off forgets them, and a peer that was not asked gets plain objects */
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_NONE);
+    std::string off = encoder.dump(responses[0]);
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_SHAPES);
+    std::string on = encoder.dump(responses[1]);
+    failures += check("Reset", {messages[0], off, on}, {responses[0], responses[0], responses[1]});
+    std::cerr << "Not negotiated: " << (JKSN::JKSNEncoder().dump(responses[0]) == JKSN::dump(responses[0]) ? "identical" : "differs") << std::endl;
+    JKSN::JKSNDocument document;
+    std::cerr << "/result/items/2/status: " << (JKSN::JKSNDecoder().parse(messages[0].data(), messages[0].size(), document).at("result").at("items")[2].at("status").toString() == "ok" ? "identical" : "differs") << std::endl;
+
+    /* Every object keeps the order its keys were inserted in */
+    bool same_order = true;
+    JKSN::JKSNDecoder order_decoder;
+    for(size_t i = 0; i < 2; ++i) {
+        JKSN::JKSNValue response = order_decoder.parse(messages[i]);
+        const std::vector<JKSN::JKSNValue> &decoded = response.toObject().at("result").toObject().at("items").toVector();
+        const std::vector<JKSN::JKSNValue> &original = responses[i].toObject().at("result").toObject().at("items").toVector();
+        for(size_t j = 0; j < original.size(); ++j)
+            if(original[j].isObject()) {
+                auto a = decoded[j].toObject().begin(), b = original[j].toObject().begin();
+                for(; b != original[j].toObject().end(); ++a, ++b)
+                    same_order = same_order && a->first == b->first;
+            }
+    }
+    std::cerr << "Key order: " << (same_order ? "identical" : "differs") << std::endl;
+
+    /* Keys that share a hashtable slot, "val" and "ab" both hash to 0xe3 */
+    JKSN::JKSNValue colliding({
+        8,
+        JKSN::JKSNValue::fromObject({
+            {"ab", JKSN::JKSNValue::fromObject({
+                {"ab", JKSN::JKSNValue::fromObject({{"id", 9}})},
+                {"val", JKSN::JKSNValue(std::vector<JKSN::JKSNValue>())},
+                {"id", JKSN::JKSNValue({10, 6})}
+            })},
+            {"id", 14}
+        }),
+        JKSN::JKSNValue({
+            JKSN::JKSNValue::fromObject({{"val", JKSN::JKSNValue::fromObject({{"ab", 13}})}, {"ts", JKSN::JKSNValue({3})}}),
+            JKSN::JKSNValue::fromObject({{"id", JKSN::JKSNValue(std::vector<JKSN::JKSNValue>())}})
+        })
+    });
+    JKSN::JKSNEncoder colliding_encoder;
+    colliding_encoder.setExtensions(JKSN::JKSN_EXTENSION_SHAPES);
+    failures += check("Colliding keys", {colliding_encoder.dump(colliding)}, {colliding});
+
+    /* A shape that was never sent is refused */
+    try {
+        JKSN::JKSNEncoder announcer;
+        announcer.setExtensions(JKSN::JKSN_EXTENSION_SHAPES);
+        std::string unknown = announcer.dump(nullptr);
+        unknown.back() = char(0xe7);
+        JKSN::parse(unknown + "\x05\x01");
+        std::cerr << "Unknown shape: decoded" << std::endl;
+    } catch(const JKSN::JKSNDecodeError &) {
+    }
+
+    std::cout << messages[0];
+    return failures != 0;
+}
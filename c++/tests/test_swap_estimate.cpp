@@ -0,0 +1,72 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../jksn.cpp"
+
+static JKSN::JKSNValue makeRows(size_t rows, int kind) {
+    std::vector<JKSN::JKSNValue> result;
+    result.reserve(rows);
+    for(size_t i = 0; i < rows; ++i) {
+        JKSN::JKSNObject row;
+        row["id"] = JKSN::JKSNValue(uintmax_t(i));
+        switch(kind) {
+        case 0: /* Uniform rows */
+            row["name"] = "user" + std::to_string(i % 97);
+            row["score"] = i * 0.25;
+            break;
+        case 1: /* Sparse optional columns */
+            if(i % 10 == 0)
+                row["note"] = std::string(i % 40, 'n');
+            if(i % 3 == 0)
+                row["flag"] = true;
+            break;
+        case 2: /* Every row has its own key */
+            row["key" + std::to_string(i)] = std::string(i % 13, 'k');
+            break;
+        default: /* Values of very different sizes, with nested containers */
+            row["text"] = std::string((i * 7919) % 300, 't');
+            row["list"] = JKSN::JKSNValue({int(i), int(i + 1)});
+            row["child"] = JKSN::JKSNValue::fromObject({{"x", int(i)}});
+            break;
+        }
+        result.push_back(JKSN::JKSNValue(std::move(row)));
+    }
+    return JKSN::JKSNValue(std::move(result));
+}
+
+int main() {
+    static const char *const kinds[] = {"uniform", "sparse", "unique keys", "mixed sizes"};
+    bool ok = true;
+    for(size_t rows : {size_t(300), size_t(5000), size_t(100000)})
+        for(int kind = 0; kind < 4; ++kind) {
+            /* Measuring unique keys exactly takes quadratic time */
+            if(kind == 2 && rows > 5000)
+                continue;
+            JKSN::JKSNValue value = makeRows(rows, kind);
+            size_t straight, swapped, estimated_straight, estimated_swapped;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            JKSN::JKSNEncoderPrivate::testEstimate(value, false, straight, swapped);
+            std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+            JKSN::JKSNEncoderPrivate::testEstimate(value, true, estimated_straight, estimated_swapped);
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            bool agree = (estimated_swapped < estimated_straight) == (swapped < straight);
+            ok = ok && agree;
+            std::cout << rows << " rows, " << kinds[kind] << ": straight " << straight << " (estimate "
+                      << (double(estimated_straight) - double(straight)) * 100 / double(straight) << "%), swapped " << swapped << " (estimate "
+                      << (double(estimated_swapped) - double(swapped)) * 100 / double(swapped) << "%), "
+                      << (agree ? "same decision" : "DIFFERENT DECISION") << ", "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(middle - start).count() << " us measured, "
+                      << std::chrono::duration_cast<std::chrono::microseconds>(end - middle).count() << " us estimated" << std::endl;
+        }
+
+    /* Time the whole encoder on a large array, which is now estimated rather than measured */
+    JKSN::JKSNValue value = makeRows(100000, 0);
+    std::string buffer;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    JKSN::JKSNEncoderPrivate().dumpToBuffer(value, buffer);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    std::cout << "Encoded " << buffer.size() << " bytes in " << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() << " us" << std::endl;
+    ok = ok && JKSN::parse(buffer, false) == value;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+#include "decode_paths.hpp"
+
+int main() {
+    int failures = 0;
+    /* One array of each width */
+    std::vector<JKSN::JKSNValue> bytes, shorts, ints, longs, floats;
+    uint32_t seed = 1;
+    for(int i = 0; i < 1000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        bytes.push_back(int8_t(seed >> 16));
+        shorts.push_back(int16_t(seed >> 8));
+        ints.push_back(int32_t(seed));
+        longs.push_back(intmax_t(seed) << 31 | i);
+        floats.push_back(float(seed) / 65536.0f);
+    }
+    JKSN::JKSNValue widths = JKSN::JKSNValue::fromObject({
+        {"int8", JKSN::JKSNValue(std::move(bytes))},
+        {"int16", JKSN::JKSNValue(std::move(shorts))},
+        {"int32", JKSN::JKSNValue(std::move(ints))},
+        {"int64", JKSN::JKSNValue(std::move(longs))},
+        {"float", JKSN::JKSNValue(std::move(floats))},
+        {"special", JKSN::JKSNValue({0.0f, -0.0f, float(INFINITY), -float(INFINITY), 1e-45f})}
+    });
+    std::string buffer = pack(widths, JKSN::JKSN_EXTENSION_TYPED_ARRAY);
+    int widths_differ = countDiffers(buffer, widths);
+    failures += widths_differ;
+    std::cerr << "Widths: " << JKSN::dump(widths).size() << " bytes, typed: " << buffer.size() << " bytes, " << widths_differ << " paths differ" << std::endl;
+    std::cerr << "/int16/500: " << (JKSN::find(buffer, "/int16/500") == widths.toObject().at("int16").toVector()[500] ? "identical" : "differs") << std::endl;
+    JKSN::JKSNIndex index;
+    JKSN::index(buffer.data(), buffer.size(), index);
+    std::cerr << "Index: " << (index.toValue(index.find("/int64/999")) == widths.toObject().at("int64").toVector()[999] ? "identical" : "differs") << std::endl;
+
+    /* A writer hands over a whole vector, and a view hands one back */
+    std::vector<double> samples;
+    for(int i = 0; i < 100000; ++i)
+        samples.push_back(std::sin(i / 100.0) * 1000);
+    JKSN::JKSNEncoder encoder;
+    encoder.setExtensions(JKSN::JKSN_EXTENSION_TYPED_ARRAY);
+    std::string written;
+    JKSN::JKSNWriter(encoder, written).beginObject(1).key("samples").array(samples.data(), samples.size()).end();
+    JKSN::JKSNDecoder decoder;
+    JKSN::JKSNDocument document;
+    std::vector<double> decoded = decoder.parse(written.data(), written.size(), document).at("samples").toDoubleVector();
+    bool identical = decoded.size() == samples.size() && std::memcmp(decoded.data(), samples.data(), samples.size()*8) == 0;
+    std::cerr << "Written doubles: " << written.size() << " bytes, " << (identical ? "identical" : "differs") << std::endl;
+    std::vector<int32_t> counters = {100000, -100000, 7, 1 << 30};
+    std::string counters_buffer;
+    JKSN::JKSNWriter(encoder, counters_buffer).array(counters.data(), counters.size());
+    std::cerr << "Written int32: " << (decoder.parse(counters_buffer) == JKSN::JKSNValue({100000, -100000, 7, 1 << 30}) ? "identical" : "differs") << std::endl;
+
+    /* The reader walks the items, and columns of a swapped array are packed too */
+    std::vector<JKSN::JKSNValue> rows;
+    for(int i = 0; i < 200; ++i)
+        rows.push_back(JKSN::JKSNValue::fromObject({{"id", i * 7919 % 1000}, {"temp", 36.6f + float(i % 10) / 10.0f}}));
+    JKSN::JKSNValue table(std::move(rows));
+    std::string table_buffer = pack(table, JKSN::JKSN_EXTENSION_TYPED_ARRAY);
+    int table_differ = countDiffers(table_buffer, table);
+    failures += table_differ;
+    std::cerr << "Swapped: " << JKSN::dump(table).size() << " bytes, typed: " << table_buffer.size() << " bytes, " << table_differ << " paths differ" << std::endl;
+    JKSN::JKSNReader reader(table_buffer.data(), table_buffer.size());
+    size_t tokens = 0;
+    while(reader.next() != JKSN::JKSN_TOKEN_NONE)
+        ++tokens;
+    std::cerr << "Reader: " << tokens << " tokens" << std::endl;
+
+    /* Integers that are shorter as deltas stay as they are */
+    std::vector<JKSN::JKSNValue> sequence;
+    for(int i = 0; i < 1000; ++i)
+        sequence.push_back(1000000 + i);
+    JKSN::JKSNValue counting(std::move(sequence));
+    size_t pragma = pack(nullptr, JKSN::JKSN_EXTENSION_TYPED_ARRAY).size() - JKSN::dump(nullptr).size();
+    std::cerr << "Counting: " << (pack(counting, JKSN::JKSN_EXTENSION_TYPED_ARRAY).size() - pragma == JKSN::dump(counting).size() ? "identical" : "differs") << std::endl;
+
+    /* A packed array that does not hold its items is refused */
+    try {
+        std::string corrupted = buffer;
+        corrupted[corrupted.find('\xe3') + 3] ^= 0x7f;
+        JKSN::parse(corrupted);
+        std::cerr << "Corrupted size: decoded" << std::endl;
+    } catch(const JKSN::JKSNDecodeError &) {
+    }
+
+    std::cout << buffer;
+    return failures != 0;
+}
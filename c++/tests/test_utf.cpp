@@ -12,12 +12,12 @@ int main(int argc, char *argv[]) {
             break;
         }
     if(to_utf8) {
-        std::u16string utf16str;
-        char buf[2];
-        while(std::cin.read(buf, 2))
-            utf16str.push_back(char16_t(uint8_t(buf[0]) | uint16_t(uint8_t(buf[1])) << 8));
-        std::cerr << "Input UTF-16 size: " << utf16str.size() << std::endl;
-        std::cout << JKSN::UTF16ToUTF8(utf16str);
+        std::stringstream sstr;
+        while(sstr << std::cin.rdbuf()) {
+        }
+        const std::string &utf16str = sstr.str();
+        std::cerr << "Input UTF-16 size: " << utf16str.size()/2 << std::endl;
+        std::cout << JKSN::UTF16LEToUTF8(utf16str.data(), utf16str.size()/2);
     } else {
         std::stringstream sstr;
         while(sstr << std::cin.rdbuf()) {
@@ -0,0 +1,64 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../jksn.cpp"
+
+static std::string corpus(const std::vector<std::string> &pieces, size_t size) {
+    std::string result;
+    uint32_t seed = 1;
+    while(result.size() < size) {
+        seed = seed * 1103515245 + 12345;
+        result += pieces[(seed >> 16) % pieces.size()];
+    }
+    return result;
+}
+
+int main() {
+    const size_t corpus_size = 1 << 20;
+    const size_t iterations = 20;
+    const std::vector<std::pair<const char *, std::string>> corpora = {
+        {"ASCII", corpus({"lorem ", "ipsum ", "dolor ", "sit ", "amet, ", "consectetur "}, corpus_size)},
+        {"Latin", corpus({"caf\xc3\xa9 ", "na\xc3\xafve ", "\xc3\xa9t\xc3\xa9 ", "stra\xc3\x9f" "e ", "ni\xc3\xb1o "}, corpus_size)},
+        {"CJK", corpus({"\xe4\xb8\xad\xe6\x96\x87", "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e", "\xed\x95\x9c\xea\xb5\xad\xec\x96\xb4", "\xef\xbc\x8c"}, corpus_size)},
+        {"Emoji", corpus({"\xf0\x9f\x98\x80", "\xf0\x9f\x91\x8d", "\xf0\x9f\x8e\x89 ", "ok "}, corpus_size)}
+    };
+    bool ok = true;
+    for(const std::pair<const char *, std::string> &item : corpora) {
+        const std::string &utf8str = item.second;
+        size_t utf16_length;
+        bool is_shorter = JKSN::UTF16IsShorter(utf8str, utf16_length);
+        std::string utf16str = JKSN::UTF8ToUTF16LE(utf8str, true);
+        if(is_shorter != (utf16str.size() < utf8str.size()) || (is_shorter && utf16_length*2 != utf16str.size())) {
+            std::cout << item.first << ": size mismatch" << std::endl;
+            ok = false;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        size_t total = 0;
+        for(size_t i = 0; i < iterations; ++i)
+            total += JKSN::UTF16IsShorter(utf8str, utf16_length) ? 1 : 0;
+        std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < iterations; ++i)
+            total += JKSN::UTF8ToUTF16LE(utf8str).size();
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        double bytes = double(utf8str.size() * iterations);
+        std::cout << item.first << ": " << (is_shorter ? "UTF-16" : "UTF-8") << ", count "
+                  << bytes / std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(middle - start).count() << " MB/s, transcode "
+                  << bytes / std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(end - middle).count() << " MB/s, ";
+
+        if(JKSN::UTF16LEToUTF8(utf16str.data(), utf16str.size()/2) != utf8str) {
+            std::cout << item.first << ": round trip mismatch" << std::endl;
+            ok = false;
+        }
+        start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < iterations; ++i)
+            total += JKSN::UTF16LEToUTF8(utf16str.data(), utf16str.size()/2).size();
+        end = std::chrono::steady_clock::now();
+        std::cout << "decode " << bytes / std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(end - start).count() << " MB/s" << std::endl;
+        if(total == 0)
+            ok = false;
+    }
+    std::cout << (ok ? "Conversions are consistent" : "Conversions differ") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <string>
+#include "jksn.hpp"
+
+int main() {
+    /* Rows are written one at a time, the same bytes as dumping the whole tree */
+    JKSN::JKSNEncoder encoder;
+    std::string written;
+    {
+        JKSN::JKSNWriter writer(encoder, written);
+        writer.beginObject(3);
+        writer.key("name").value("元素");
+        writer.key("rows").beginArray(100);
+        for(int i = 0; i < 100; ++i) {
+            writer.beginArray(4);
+            writer.value(1000 + i).value("user" + std::to_string(i % 7)).value(i * 0.5);
+            writer.blob("blob");
+            writer.end();
+        }
+        writer.end();
+        writer.key("tail").beginArray(3).value(nullptr).value(true).value(JKSN::JKSNValue({1, 2})).end();
+        writer.end();
+        if(!writer.complete())
+            std::cerr << "Writer is not complete" << std::endl;
+    }
+
+    std::vector<JKSN::JKSNValue> rows;
+    for(int i = 0; i < 100; ++i)
+        rows.push_back(JKSN::JKSNValue({1000 + i, "user" + std::to_string(i % 7), i * 0.5, JKSN::JKSNValue::fromBlob("blob")}));
+    JKSN::JKSNValue tree = JKSN::JKSNValue::fromObject({
+        {"name", "元素"},
+        {"rows", JKSN::JKSNValue(std::move(rows))},
+        {"tail", JKSN::JKSNValue({nullptr, true, JKSN::JKSNValue({1, 2})})}
+    });
+    std::cerr << (written == JKSN::dump(tree) ? "Output is identical" : "Output differs") << std::endl;
+
+    std::cout << written;
+
+    /* A second message through the same encoder still refers to its hashtable */
+    std::string second;
+    JKSN::JKSNWriter(encoder, second, false).beginArray(2).value("user3").value(1099).end();
+    std::cerr << "Second message: " << second.size() << " bytes" << std::endl;
+
+    std::string lengthless;
+    JKSN::JKSNWriter(lengthless).beginArray().value(1).value("x").end();
+    std::cerr << (JKSN::parse(lengthless) == JKSN::JKSNValue({1, "x"}) ? "Lengthless array is identical" : "Lengthless array differs") << std::endl;
+
+    try {
+        JKSN::JKSNWriter(written).beginArray(1).end();
+        std::cerr << "Missing item was not detected" << std::endl;
+    } catch(const JKSN::JKSNEncodeError &) {
+    }
+    return 0;
+}